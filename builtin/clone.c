@@ -16,6 +16,7 @@
 #include "refs.h"
 #include "refspec.h"
 #include "object-store.h"
+#include "bundle-uri.h"
 #include "tree.h"
 #include "tree-walk.h"
 #include "unpack-trees.h"
@@ -65,6 +66,7 @@ static int option_dissociate;
 static int max_jobs = -1;
 static struct string_list option_recurse_submodules = STRING_LIST_INIT_NODUP;
 static struct list_objects_filter_options filter_options;
+static struct string_list option_bundle_uri = STRING_LIST_INIT_DUP;
 
 static int recurse_submodules_cb(const struct option *opt,
 				 const char *arg, int unset)
@@ -141,6 +143,8 @@ static struct option builtin_clone_options[] = {
 	OPT_SET_INT('6', "ipv6", &family, N_("use IPv6 addresses only"),
 			TRANSPORT_FAMILY_IPV6),
 	OPT_PARSE_LIST_OBJECTS_FILTER(&filter_options),
+	OPT_STRING_LIST(0, "bundle-uri", &option_bundle_uri, N_("uri"),
+			N_("start from the bundle at <uri> before fetching from the remote")),
 	OPT_END()
 };
 
@@ -917,6 +921,9 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 
 	if (option_depth || option_since || option_not.nr)
 		deepen = 1;
+	if (option_bundle_uri.nr && (deepen || filter_options.choice))
+		die(_("--bundle-uri is incompatible with --depth, --shallow-since, "
+		      "--shallow-exclude and --filter"));
 	if (option_single_branch == -1)
 		option_single_branch = deepen ? 1 : 0;
 
@@ -1101,6 +1108,8 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 			warning(_("--shallow-exclude is ignored in local clones; use file:// instead."));
 		if (filter_options.choice)
 			warning(_("--filter is ignored in local clones; use file:// instead."));
+		if (option_bundle_uri.nr)
+			warning(_("--bundle-uri is ignored in local clones; use file:// instead."));
 		if (!access(mkpath("%s/shallow", path), F_OK)) {
 			if (option_local > 0)
 				warning(_("source repository is shallow, ignoring --local"));
@@ -1148,6 +1157,17 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 
 	refs = transport_get_remote_refs(transport, &ref_prefixes);
 
+	if (refs && !is_local && !deepen && !filter_options.choice) {
+		int use_advertised = 0;
+
+		if (!option_bundle_uri.nr &&
+		    !git_config_get_bool("transfer.bundleuri", &use_advertised) &&
+		    use_advertised)
+			transport_get_bundle_uris(transport, &option_bundle_uri);
+		fetch_bundle_uris(the_repository, &option_bundle_uri,
+				  use_advertised);
+	}
+
 	if (refs) {
 		mapped_refs = wanted_peer_refs(refs, &rs.items[0]);
 		/*
@@ -6,6 +6,9 @@
 #include "builtin.h"
 #include "submodule.h"
 #include "repository.h"
+#include "alias.h"
+#include "tempfile.h"
+#include "argv-array.h"
 
 static struct rev_info log_tree_opt;
 
@@ -81,13 +84,6 @@ static int diff_tree_stdin(char *line)
 	return -1;
 }
 
-static const char diff_tree_usage[] =
-"git diff-tree [--stdin] [-m] [-c] [--cc] [-s] [-v] [--pretty] [-t] [-r] [--root] "
-"[<common-diff-options>] <tree-ish> [<tree-ish>] [<path>...]\n"
-"  -r            diff recursively\n"
-"  --root        include the initial commit as diff against /dev/null\n"
-COMMON_DIFF_OPTIONS_HELP;
-
 static void diff_tree_tweak_rev(struct rev_info *rev, struct setup_revision_opt *opt)
 {
 	if (!rev->diffopt.output_format) {
@@ -98,29 +94,182 @@ static void diff_tree_tweak_rev(struct rev_info *rev, struct setup_revision_opt
 	}
 }
 
+static int setup_diff_tree_revisions(int argc, const char **argv,
+				     struct rev_info *rev, const char *prefix)
+{
+	struct setup_revision_opt s_r_opt;
+
+	repo_init_revisions(the_repository, rev, prefix);
+	rev->abbrev = 0;
+	rev->diff = 1;
+	rev->disable_stdin = 1;
+	memset(&s_r_opt, 0, sizeof(s_r_opt));
+	s_r_opt.tweak = diff_tree_tweak_rev;
+
+	return setup_revisions(argc, argv, rev, &s_r_opt);
+}
+
+/*
+ * Answer one "--batch" request, writing its diff to the scratch file
+ * "out" first so that it can be sent with its size.  The diff options
+ * are parsed afresh from the command line "base" for each request, so
+ * that what one request does to them does not leak into the next.
+ */
+static int diff_tree_batch_one(const char *request, FILE *out,
+			       const struct argv_array *base,
+			       const char *prefix)
+{
+	char *buf = xstrdup(request);
+	const char **argv = NULL;
+	const char **base_argv;
+	struct rev_info rev;
+	struct diff_options *opts = &rev.diffopt;
+	unsigned default_format;
+	struct object_id oid;
+	struct tree *tree[2];
+	int i, argc, ret = -1;
+	char copybuf[8192];
+	long size;
+
+	/* setup_revisions() shuffles the array it is given */
+	ALLOC_ARRAY(base_argv, base->argc + 1);
+	COPY_ARRAY(base_argv, base->argv, base->argc + 1);
+	setup_diff_tree_revisions(base->argc, base_argv, &rev, prefix);
+
+	argc = split_cmdline(buf, &argv);
+	if (argc < 0) {
+		error(_("cannot parse request: %s"),
+		      split_cmdline_strerror(argc));
+		goto out;
+	}
+	if (argc < 2) {
+		error(_("need two trees to compare"));
+		goto out;
+	}
+	for (i = 0; i < 2; i++) {
+		if (get_oid(argv[i], &oid) ||
+		    !(tree[i] = parse_tree_indirect(&oid))) {
+			error(_("not a tree object: %s"), argv[i]);
+			goto out;
+		}
+	}
+
+	/*
+	 * The options of the request come on top of the ones from the
+	 * command line, except that an output format given here replaces
+	 * the default one instead of adding to it.
+	 */
+	default_format = opts->output_format;
+	opts->output_format = 0;
+	for (i = 2; i < argc; ) {
+		int n;
+
+		if (!strcmp(argv[i], "--")) {
+			clear_pathspec(&opts->pathspec);
+			parse_pathspec(&opts->pathspec, 0, 0, prefix, argv + i + 1);
+			break;
+		}
+		n = diff_opt_parse(opts, argv + i, argc - i, prefix);
+		if (n <= 0) {
+			error(_("unknown option: %s"), argv[i]);
+			goto out;
+		}
+		i += n;
+	}
+	if (!opts->output_format)
+		opts->output_format = default_format;
+	opts->file = out;
+	opts->close_file = 0;
+	diff_setup_done(opts);
+
+	diff_tree_oid(&tree[0]->object.oid, &tree[1]->object.oid, "", opts);
+	diffcore_std(opts);
+	diff_flush(opts);
+
+	if (fflush(out) || (size = ftell(out)) < 0)
+		die_errno(_("unable to write diff to temporary file"));
+	printf("%s %s %ld\n", oid_to_hex(&tree[0]->object.oid),
+	       oid_to_hex(&tree[1]->object.oid), size);
+	rewind(out);
+	while (size > 0) {
+		size_t n = fread(copybuf, 1, sizeof(copybuf), out);
+		if (!n)
+			die_errno(_("unable to read diff from temporary file"));
+		if (fwrite(copybuf, 1, n, stdout) != n)
+			die_errno(_("unable to write diff"));
+		size -= n;
+	}
+	putchar('\n');
+	rewind(out);
+	if (ftruncate(fileno(out), 0))
+		die_errno(_("unable to truncate temporary file"));
+	ret = 0;
+
+out:
+	for (i = 0; i < opts->anchors_nr; i++)
+		free(opts->anchors[i]);
+	free(opts->anchors);
+	clear_pathspec(&opts->pathspec);
+	clear_pathspec(&rev.prune_data);
+	free(base_argv);
+	free(argv);
+	free(buf);
+	return ret;
+}
+
+/*
+ * Serve diff requests read from the standard input until it is closed,
+ * keeping the parsed objects, the delta base cache and the rename
+ * detection caches of this process warm from one request to the next.
+ */
+static void diff_tree_batch(const struct argv_array *base, const char *prefix)
+{
+	struct strbuf request = STRBUF_INIT;
+	struct tempfile *tmp;
+	FILE *out;
+
+	tmp = mks_tempfile_t("git-diff-tree-XXXXXX");
+	if (!tmp)
+		die_errno(_("unable to create temporary file"));
+	out = fdopen_tempfile(tmp, "w+");
+	if (!out)
+		die_errno(_("unable to open temporary file"));
+
+	while (strbuf_getline(&request, stdin) != EOF) {
+		if (diff_tree_batch_one(request.buf, out, base, prefix) < 0)
+			printf("%s error\n", request.buf);
+		fflush(stdout);
+	}
+
+	delete_tempfile(&tmp);
+	strbuf_release(&request);
+}
+
+static const char diff_tree_usage[] =
+"git diff-tree [--stdin | --batch] [-m] [-c] [--cc] [-s] [-v] [--pretty] [-t] [-r] [--root] "
+"[<common-diff-options>] <tree-ish> [<tree-ish>] [<path>...]\n"
+"  -r            diff recursively\n"
+"  --root        include the initial commit as diff against /dev/null\n"
+COMMON_DIFF_OPTIONS_HELP;
+
 int cmd_diff_tree(int argc, const char **argv, const char *prefix)
 {
 	char line[1000];
 	struct object *tree1, *tree2;
 	static struct rev_info *opt = &log_tree_opt;
-	struct setup_revision_opt s_r_opt;
-	int read_stdin = 0;
+	struct argv_array base = ARGV_ARRAY_INIT;
+	int read_stdin = 0, batch = 0;
 
 	if (argc == 2 && !strcmp(argv[1], "-h"))
 		usage(diff_tree_usage);
 
 	git_config(git_diff_basic_config, NULL); /* no "diff" UI options */
-	repo_init_revisions(the_repository, opt, prefix);
 	if (read_cache() < 0)
 		die(_("index file corrupt"));
-	opt->abbrev = 0;
-	opt->diff = 1;
-	opt->disable_stdin = 1;
-	memset(&s_r_opt, 0, sizeof(s_r_opt));
-	s_r_opt.tweak = diff_tree_tweak_rev;
 
 	precompose_argv(argc, argv);
-	argc = setup_revisions(argc, argv, opt, &s_r_opt);
+	argv_array_pushv(&base, argv);
+	argc = setup_diff_tree_revisions(argc, argv, opt, prefix);
 
 	while (--argc > 0) {
 		const char *arg = *++argv;
@@ -129,9 +278,22 @@ int cmd_diff_tree(int argc, const char **argv, const char *prefix)
 			read_stdin = 1;
 			continue;
 		}
+		if (!strcmp(arg, "--batch")) {
+			batch = 1;
+			continue;
+		}
 		usage(diff_tree_usage);
 	}
 
+	if (batch) {
+		if (read_stdin || opt->pending.nr)
+			usage(diff_tree_usage);
+		diff_tree_batch(&base, prefix);
+		argv_array_clear(&base);
+		return 0;
+	}
+	argv_array_clear(&base);
+
 	/*
 	 * NOTE!  We expect "a..b" to expand to "^a b" but it is
 	 * perfectly valid for revision range parser to yield "b ^a",
@@ -23,6 +23,7 @@
 #include "submodule.h"
 #include "submodule-config.h"
 #include "object-store.h"
+#include "grep-index.h"
 
 static char const * const grep_usage[] = {
 	N_("git grep [<options>] [-e] <pattern> [<rev>...] [[--] <path>...]"),
@@ -34,6 +35,162 @@ static int recurse_submodules;
 #define GREP_NUM_THREADS_DEFAULT 8
 static int num_threads;
 
+/* The trigram index, if grep.trigramIndex is set, and what to look up. */
+static int use_grep_index;
+static struct grep_index_query *grep_index_query;
+
+/*
+ * The entry to add to the trigram index for the blob "gs" was read from
+ * ("oid" for a file known to have the contents of that blob), now that
+ * its contents are loaded anyway.
+ */
+static struct grep_index_entry *new_grep_index_entry(struct grep_source *gs,
+						     const struct object_id *oid)
+{
+	if (gs->type == GREP_SOURCE_OID)
+		oid = gs->identifier;
+	if (!use_grep_index || !oid || !gs->buf || grep_index_contains(oid))
+		return NULL;
+	return grep_index_entry_new(oid, gs->buf, gs->size);
+}
+
+/*
+ * When searching several trees, the same blob is usually found in many
+ * of them.  Each blob (with each userdiff driver, which may change how
+ * it is searched) is searched only once, and its output is kept with
+ * the names of the source left out, to be filled in with the name of
+ * every place the blob is found at.
+ */
+static int dedup_blobs;
+static struct hashmap grep_blobs;
+
+struct grep_blob {
+	struct hashmap_entry ent;
+	struct object_id oid;
+	struct userdiff_driver *driver;
+	int done, hit;
+	struct strbuf out;
+	size_t *name_at;
+	size_t name_nr, name_alloc;
+};
+
+static int grep_blob_cmp(const void *unused_cmp_data,
+			 const void *entry, const void *entry_or_key,
+			 const void *unused_keydata)
+{
+	const struct grep_blob *a = entry, *b = entry_or_key;
+
+	return a->driver != b->driver || oidcmp(&a->oid, &b->oid);
+}
+
+/*
+ * The blob "gs" reads, with its driver loaded. Sets "found" if it was
+ * already seen; otherwise it is for the caller to search it.
+ */
+static struct grep_blob *find_grep_blob(struct grep_opt *opt,
+					struct grep_source *gs, int *found)
+{
+	struct grep_blob key, *blob;
+
+	grep_source_load_driver(gs, opt->repo->index);
+	oidcpy(&key.oid, gs->identifier);
+	key.driver = gs->driver;
+	hashmap_entry_init(&key, sha1hash(key.oid.hash));
+
+	blob = hashmap_get(&grep_blobs, &key, NULL);
+	*found = !!blob;
+	if (!blob) {
+		blob = xcalloc(1, sizeof(*blob));
+		hashmap_entry_init(blob, key.ent.hash);
+		oidcpy(&blob->oid, &key.oid);
+		blob->driver = key.driver;
+		strbuf_init(&blob->out, 0);
+		hashmap_add(&grep_blobs, blob);
+	}
+	return blob;
+}
+
+static void free_grep_blobs(void)
+{
+	struct hashmap_iter iter;
+	struct grep_blob *blob;
+
+	hashmap_iter_init(&grep_blobs, &iter);
+	while ((blob = hashmap_iter_next(&iter))) {
+		strbuf_release(&blob->out);
+		free(blob->name_at);
+	}
+	hashmap_free(&grep_blobs, 1);
+}
+
+static void record_output(struct grep_opt *opt, const void *buf, size_t size)
+{
+	struct grep_blob *blob = opt->output_priv;
+	strbuf_add(&blob->out, buf, size);
+}
+
+static void record_name(struct grep_opt *opt, const char *name)
+{
+	struct grep_blob *blob = opt->output_priv;
+	ALLOC_GROW(blob->name_at, blob->name_nr + 1, blob->name_alloc);
+	blob->name_at[blob->name_nr++] = blob->out.len;
+}
+
+/* Search "gs" and record its output in "blob". */
+static int search_grep_blob(struct grep_opt *opt, struct grep_source *gs,
+			    struct grep_blob *blob)
+{
+	void (*output)(struct grep_opt *, const void *, size_t) = opt->output;
+	void *output_priv = opt->output_priv;
+	int hit;
+
+	opt->output = record_output;
+	opt->output_name = record_name;
+	opt->output_priv = blob;
+	hit = grep_source(opt, gs);
+	opt->output = output;
+	opt->output_name = NULL;
+	opt->output_priv = output_priv;
+	return hit;
+}
+
+/* Show the output of "blob" as the output for "name". */
+static void show_grep_blob(struct grep_opt *opt, const struct grep_blob *blob,
+			   const char *name)
+{
+	size_t i, start = 0;
+
+	for (i = 0; i < blob->name_nr; i++) {
+		opt->output(opt, blob->out.buf + start,
+			    blob->name_at[i] - start);
+		grep_output_name(opt, name);
+		start = blob->name_at[i];
+	}
+	opt->output(opt, blob->out.buf + start, blob->out.len - start);
+}
+
+static int skip_first_line;
+
+static void write_output(const char *p, size_t len)
+{
+	/* Skip the leading hunk mark of the first file. */
+	if (skip_first_line) {
+		while (len) {
+			len--;
+			if (*p++ == '\n')
+				break;
+		}
+		skip_first_line = 0;
+	}
+
+	write_or_die(1, p, len);
+}
+
+static void strbuf_out(struct grep_opt *opt, const void *buf, size_t size)
+{
+	strbuf_add(opt->output_priv, buf, size);
+}
+
 #ifndef NO_PTHREADS
 static pthread_t *threads;
 
@@ -43,6 +200,9 @@ static pthread_t *threads;
  */
 struct work_item {
 	struct grep_source source;
+	struct object_id oid; /* see new_grep_index_entry() */
+	struct grep_blob *blob;
+	char search_blob;
 	char done;
 	struct strbuf out;
 };
@@ -91,9 +251,12 @@ static pthread_cond_t cond_write;
 /* Signalled when we are finished with everything. */
 static pthread_cond_t cond_result;
 
-static int skip_first_line;
+/* Signalled when a blob has been searched for all its duplicates. */
+static pthread_cond_t cond_blob;
 
-static void add_work(struct grep_opt *opt, const struct grep_source *gs)
+static void add_work(struct grep_opt *opt, const struct grep_source *gs,
+		     const struct object_id *oid, struct grep_blob *blob,
+		     int search_blob)
 {
 	grep_lock();
 
@@ -102,6 +265,12 @@ static void add_work(struct grep_opt *opt, const struct grep_source *gs)
 	}
 
 	todo[todo_end].source = *gs;
+	if (oid)
+		oidcpy(&todo[todo_end].oid, oid);
+	else
+		oidclr(&todo[todo_end].oid);
+	todo[todo_end].blob = blob;
+	todo[todo_end].search_blob = search_blob;
 	if (opt->binary != GREP_BINARY_TEXT)
 		grep_source_load_driver(&todo[todo_end].source,
 					opt->repo->index);
@@ -142,22 +311,8 @@ static void work_done(struct work_item *w)
 	for(; todo[todo_done].done && todo_done != todo_start;
 	    todo_done = (todo_done+1) % ARRAY_SIZE(todo)) {
 		w = &todo[todo_done];
-		if (w->out.len) {
-			const char *p = w->out.buf;
-			size_t len = w->out.len;
-
-			/* Skip the leading hunk mark of the first file. */
-			if (skip_first_line) {
-				while (len) {
-					len--;
-					if (*p++ == '\n')
-						break;
-				}
-				skip_first_line = 0;
-			}
-
-			write_or_die(1, p, len);
-		}
+		if (w->out.len)
+			write_output(w->out.buf, w->out.len);
 		grep_source_clear(&w->source);
 	}
 
@@ -177,11 +332,38 @@ static void *run(void *arg)
 
 	while (1) {
 		struct work_item *w = get_work();
+		struct grep_index_entry *entry;
 		if (!w)
 			break;
 
-		opt->output_priv = w;
-		hit |= grep_source(opt, &w->source);
+		opt->output_priv = &w->out;
+		if (!w->blob) {
+			hit |= grep_source(opt, &w->source);
+		} else if (w->search_blob) {
+			int blob_hit = search_grep_blob(opt, &w->source,
+							w->blob);
+			grep_lock();
+			w->blob->hit = blob_hit;
+			w->blob->done = 1;
+			pthread_cond_broadcast(&cond_blob);
+			grep_unlock();
+		} else {
+			grep_lock();
+			while (!w->blob->done)
+				pthread_cond_wait(&cond_blob, &grep_mutex);
+			grep_unlock();
+		}
+		if (w->blob) {
+			show_grep_blob(opt, w->blob, w->source.name);
+			hit |= w->blob->hit;
+		}
+		entry = new_grep_index_entry(&w->source,
+					     is_null_oid(&w->oid) ? NULL : &w->oid);
+		if (entry) {
+			grep_lock();
+			grep_index_add(entry);
+			grep_unlock();
+		}
 		grep_source_clear_data(&w->source);
 		work_done(w);
 	}
@@ -191,23 +373,18 @@ static void *run(void *arg)
 	return (void*) (intptr_t) hit;
 }
 
-static void strbuf_out(struct grep_opt *opt, const void *buf, size_t size)
-{
-	struct work_item *w = opt->output_priv;
-	strbuf_add(&w->out, buf, size);
-}
-
 static void start_threads(struct grep_opt *opt)
 {
 	int i;
 
 	pthread_mutex_init(&grep_mutex, NULL);
-	pthread_mutex_init(&grep_read_mutex, NULL);
 	pthread_mutex_init(&grep_attr_mutex, NULL);
 	pthread_cond_init(&cond_add, NULL);
 	pthread_cond_init(&cond_write, NULL);
 	pthread_cond_init(&cond_result, NULL);
+	pthread_cond_init(&cond_blob, NULL);
 	grep_use_locks = 1;
+	enable_obj_read_lock();
 
 	for (i = 0; i < ARRAY_SIZE(todo); i++) {
 		strbuf_init(&todo[i].out, 0);
@@ -256,12 +433,13 @@ static int wait_all(void)
 	free(threads);
 
 	pthread_mutex_destroy(&grep_mutex);
-	pthread_mutex_destroy(&grep_read_mutex);
 	pthread_mutex_destroy(&grep_attr_mutex);
 	pthread_cond_destroy(&cond_add);
 	pthread_cond_destroy(&cond_write);
 	pthread_cond_destroy(&cond_result);
+	pthread_cond_destroy(&cond_blob);
 	grep_use_locks = 0;
+	disable_obj_read_lock();
 
 	return hit;
 }
@@ -303,14 +481,27 @@ static int grep_cmd_config(const char *var, const char *value, void *cb)
 	return st;
 }
 
-static void *lock_and_read_oid_file(const struct object_id *oid, enum object_type *type, unsigned long *size)
+/*
+ * Show the output of "blob" for "name" when not using threads, where
+ * it is otherwise written out directly.
+ */
+static int show_blob_output(struct grep_opt *opt, struct grep_blob *blob,
+			    const char *name)
 {
-	void *data;
-
-	grep_read_lock();
-	data = read_object_file(oid, type, size);
-	grep_read_unlock();
-	return data;
+	struct strbuf out = STRBUF_INIT;
+	void (*output)(struct grep_opt *, const void *, size_t) = opt->output;
+	void *output_priv = opt->output_priv;
+
+	opt->output = strbuf_out;
+	opt->output_priv = &out;
+	show_grep_blob(opt, blob, name);
+	opt->output = output;
+	opt->output_priv = output_priv;
+
+	if (out.len)
+		write_output(out.buf, out.len);
+	strbuf_release(&out);
+	return blob->hit;
 }
 
 static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
@@ -319,6 +510,11 @@ static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
 {
 	struct strbuf pathbuf = STRBUF_INIT;
 	struct grep_source gs;
+	struct grep_blob *blob = NULL;
+	int found = 0, hit;
+
+	if (!grep_index_may_match(grep_index_query, oid))
+		return 0;
 
 	if (opt->relative && opt->prefix_length) {
 		quote_path_relative(filename + tree_name_len, opt->prefix, &pathbuf);
@@ -330,27 +526,50 @@ static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
 	grep_source_init(&gs, GREP_SOURCE_OID, pathbuf.buf, path, oid);
 	strbuf_release(&pathbuf);
 
+	if (dedup_blobs) {
+		blob = find_grep_blob(opt, &gs, &found);
+		if (found && !num_threads) {
+			hit = show_blob_output(opt, blob, gs.name);
+			grep_source_clear(&gs);
+			return hit;
+		}
+	}
+
 #ifndef NO_PTHREADS
 	if (num_threads) {
 		/*
 		 * add_work() copies gs and thus assumes ownership of
 		 * its fields, so do not call grep_source_clear()
 		 */
-		add_work(opt, &gs);
+		add_work(opt, &gs, NULL, blob, !found);
 		return 0;
 	} else
 #endif
 	{
-		int hit;
+		struct grep_index_entry *entry;
 
-		hit = grep_source(opt, &gs);
+		if (blob) {
+			blob->hit = search_grep_blob(opt, &gs, blob);
+			blob->done = 1;
+			hit = show_blob_output(opt, blob, gs.name);
+		} else {
+			hit = grep_source(opt, &gs);
+		}
+		entry = new_grep_index_entry(&gs, NULL);
+		if (entry)
+			grep_index_add(entry);
 
 		grep_source_clear(&gs);
 		return hit;
 	}
 }
 
-static int grep_file(struct grep_opt *opt, const char *filename)
+/*
+ * "oid" is the blob "filename" is known to have the contents of, if
+ * any.
+ */
+static int grep_file(struct grep_opt *opt, const char *filename,
+		     const struct object_id *oid)
 {
 	struct strbuf buf = STRBUF_INIT;
 	struct grep_source gs;
@@ -369,20 +588,52 @@ static int grep_file(struct grep_opt *opt, const char *filename)
 		 * add_work() copies gs and thus assumes ownership of
 		 * its fields, so do not call grep_source_clear()
 		 */
-		add_work(opt, &gs);
+		add_work(opt, &gs, oid, NULL, 0);
 		return 0;
 	} else
 #endif
 	{
+		struct grep_index_entry *entry;
 		int hit;
 
 		hit = grep_source(opt, &gs);
+		entry = new_grep_index_entry(&gs, oid);
+		if (entry)
+			grep_index_add(entry);
 
 		grep_source_clear(&gs);
 		return hit;
 	}
 }
 
+/*
+ * The blob of "ce" if its file "path" in the working tree is known to
+ * have the same contents, so that the trigram index can speak for it.
+ */
+static const struct object_id *worktree_blob(struct repository *repo,
+					     const struct cache_entry *ce,
+					     const char *path)
+{
+	struct stat st;
+	int clean;
+
+	if (!use_grep_index || ce_stage(ce) || lstat(path, &st))
+		return NULL;
+
+	/* both may look at attributes, which the threads use, too */
+#ifndef NO_PTHREADS
+	if (grep_use_locks)
+		pthread_mutex_lock(&grep_attr_mutex);
+#endif
+	clean = !ie_match_stat(repo->index, ce, &st, 0) &&
+		!would_convert_to_git(repo->index, ce->name);
+#ifndef NO_PTHREADS
+	if (grep_use_locks)
+		pthread_mutex_unlock(&grep_attr_mutex);
+#endif
+	return clean ? &ce->oid : NULL;
+}
+
 static void append_path(struct grep_opt *opt, const void *data, size_t len)
 {
 	struct string_list *path_list = opt->output_priv;
@@ -422,11 +673,21 @@ static int grep_submodule(struct grep_opt *opt, struct repository *superproject,
 	struct repository submodule;
 	int hit;
 
-	if (!is_submodule_active(superproject, path))
+	/*
+	 * Reading the submodule's config and .gitmodules may read objects
+	 * and touch the global object store while the worker threads are
+	 * reading blobs, so keep this part under the object read lock.
+	 */
+	obj_read_lock();
+	if (!is_submodule_active(superproject, path)) {
+		obj_read_unlock();
 		return 0;
+	}
 
-	if (repo_submodule_init(&submodule, superproject, path))
+	if (repo_submodule_init(&submodule, superproject, path)) {
+		obj_read_unlock();
 		return 0;
+	}
 
 	repo_read_gitmodules(&submodule);
 
@@ -440,9 +701,8 @@ static int grep_submodule(struct grep_opt *opt, struct repository *superproject,
 	 * store is no longer global and instead is a member of the repository
 	 * object.
 	 */
-	grep_read_lock();
 	add_to_alternates_memory(submodule.objects->objectdir);
-	grep_read_unlock();
+	obj_read_unlock();
 
 	if (oid) {
 		struct object *object;
@@ -453,10 +713,8 @@ static int grep_submodule(struct grep_opt *opt, struct repository *superproject,
 
 		object = parse_object_or_die(oid, oid_to_hex(oid));
 
-		grep_read_lock();
 		data = read_object_with_reference(&object->oid, tree_type,
 						  &size, NULL);
-		grep_read_unlock();
 
 		if (!data)
 			die(_("unable to read tree (%s)"), oid_to_hex(&object->oid));
@@ -513,7 +771,12 @@ static int grep_cache(struct grep_opt *opt, struct repository *repo,
 				hit |= grep_oid(opt, &ce->oid, name.buf,
 						 0, name.buf);
 			} else {
-				hit |= grep_file(opt, name.buf);
+				const struct object_id *oid =
+					worktree_blob(repo, ce, name.buf);
+
+				if (oid && !grep_index_may_match(grep_index_query, oid))
+					continue;
+				hit |= grep_file(opt, name.buf, oid);
 			}
 		} else if (recurse_submodules && S_ISGITLINK(ce->ce_mode) &&
 			   submodule_path_match(repo->index, pathspec, name.buf, NULL)) {
@@ -578,7 +841,7 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 			void *data;
 			unsigned long size;
 
-			data = lock_and_read_oid_file(entry.oid, &type, &size);
+			data = read_object_file(entry.oid, &type, &size);
 			if (!data)
 				die(_("unable to read tree (%s)"),
 				    oid_to_hex(entry.oid));
@@ -615,10 +878,8 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 		struct strbuf base;
 		int hit, len;
 
-		grep_read_lock();
 		data = read_object_with_reference(&obj->oid, tree_type,
 						  &size, NULL);
-		grep_read_unlock();
 
 		if (!data)
 			die(_("unable to read tree (%s)"), oid_to_hex(&obj->oid));
@@ -682,7 +943,7 @@ static int grep_directory(struct grep_opt *opt, const struct pathspec *pathspec,
 	for (i = 0; i < dir.nr; i++) {
 		if (!dir_path_match(&the_index, dir.entries[i], pathspec, 0, NULL))
 			continue;
-		hit |= grep_file(opt, dir.entries[i]->name);
+		hit |= grep_file(opt, dir.entries[i]->name, NULL);
 		if (hit && opt->status_only)
 			break;
 	}
@@ -1039,7 +1300,7 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	pathspec.recurse_submodules = !!recurse_submodules;
 
 #ifndef NO_PTHREADS
-	if (list.nr || cached || show_in_pager)
+	if (show_in_pager)
 		num_threads = 0;
 	else if (num_threads == 0)
 		num_threads = GREP_NUM_THREADS_DEFAULT;
@@ -1053,6 +1314,11 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	num_threads = 0;
 #endif
 
+	if (!opt.allow_textconv && grep_index_enabled(the_repository)) {
+		use_grep_index = 1;
+		grep_index_query = grep_index_query_new(&opt);
+	}
+
 	if (!num_threads)
 		/*
 		 * The compiled patterns on the main path are only
@@ -1062,14 +1328,23 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 		 */
 		compile_grep_patterns(&opt);
 
+	/*
+	 * Threads, and the output recorded for blobs searched only
+	 * once, show the leading hunk mark of every file, so skip the
+	 * very first one.
+	 */
+	dedup_blobs = use_index && !cached && !untracked && list.nr > 1;
+	if ((num_threads || dedup_blobs) &&
+	    !(opt.name_only || opt.unmatch_name_only || opt.count) &&
+	    (opt.pre_context || opt.post_context ||
+	     opt.file_break || opt.funcbody))
+		skip_first_line = 1;
+	if (dedup_blobs)
+		hashmap_init(&grep_blobs, grep_blob_cmp, NULL, 0);
+
 #ifndef NO_PTHREADS
-	if (num_threads) {
-		if (!(opt.name_only || opt.unmatch_name_only || opt.count)
-		    && (opt.pre_context || opt.post_context ||
-			opt.file_break || opt.funcbody))
-			skip_first_line = 1;
+	if (num_threads)
 		start_threads(&opt);
-	}
 #endif
 
 	if (show_in_pager && (cached || list.nr))
@@ -1123,6 +1398,12 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 
 	if (num_threads)
 		hit |= wait_all();
+	if (dedup_blobs)
+		free_grep_blobs();
+	if (use_grep_index) {
+		grep_index_write(the_repository);
+		grep_index_query_free(grep_index_query);
+	}
 	if (hit && show_in_pager)
 		run_pager(&opt, prefix);
 	clear_pathspec(&pathspec);
@@ -14,9 +14,10 @@
 #include "thread-utils.h"
 #include "packfile.h"
 #include "object-store.h"
+#include "sha1-array.h"
 
 static const char index_pack_usage[] =
-"git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--verify] [--strict] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
+"git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--verify] [--strict] [--report-foreign=<file>] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
 
 struct object_entry {
 	struct pack_idx_entry idx;
@@ -84,6 +85,9 @@ static int verbose;
 static int show_resolving_progress;
 static int show_stat;
 static int check_self_contained_and_connected;
+static const char *report_foreign;
+static struct oid_array foreign_objects = OID_ARRAY_INIT;
+static struct oid_array thin_bases = OID_ARRAY_INIT;
 
 static struct progress *progress;
 
@@ -224,6 +228,11 @@ static unsigned check_object(struct object *obj)
 	if (!(obj->flags & FLAG_CHECKED)) {
 		unsigned long size;
 		int type = oid_object_info(the_repository, &obj->oid, &size);
+		if (type <= 0 && report_foreign && !do_fsck_object) {
+			/* leave it to the caller to find out it is missing */
+			oid_array_append(&foreign_objects, &obj->oid);
+			return 1;
+		}
 		if (type <= 0)
 			die(_("did not receive expected object %s"),
 			      oid_to_hex(&obj->oid));
@@ -232,6 +241,8 @@ static unsigned check_object(struct object *obj)
 			    oid_to_hex(&obj->oid),
 			    type_name(obj->type), type_name(type));
 		obj->flags |= FLAG_CHECKED;
+		if (report_foreign)
+			oid_array_append(&foreign_objects, &obj->oid);
 		return 1;
 	}
 
@@ -1389,6 +1400,8 @@ static void fix_unresolved_deltas(struct hashfile *f)
 			die(_("local object %s is corrupt"), oid_to_hex(&d->oid));
 		base_obj->obj = append_obj_to_pack(f, d->oid.hash,
 					base_obj->data, base_obj->size, type);
+		if (report_foreign)
+			oid_array_append(&thin_bases, &d->oid);
 		find_unresolved_deltas(base_obj);
 		display_progress(progress, nr_resolved_deltas);
 	}
@@ -1441,6 +1454,38 @@ static void write_special_file(const char *suffix, const char *msg,
 	strbuf_release(&name_buf);
 }
 
+static int write_foreign_object(const struct object_id *oid, void *data)
+{
+	fprintf(data, "%s\n", oid_to_hex(oid));
+	return 0;
+}
+
+/*
+ * The bases added to complete a thin pack are in the pack, but nothing
+ * checked what they refer to. Those that objects of the pack refer to
+ * are foreign objects already.
+ */
+static int write_thin_base(const struct object_id *oid, void *data)
+{
+	struct object *obj = lookup_object(the_repository, oid->hash);
+
+	if (!obj || !(obj->flags & FLAG_LINK))
+		fprintf(data, "%s base\n", oid_to_hex(oid));
+	return 0;
+}
+
+static void write_foreign_objects(const char *path)
+{
+	FILE *fp = xfopen(path, "w");
+
+	oid_array_for_each_unique(&foreign_objects, write_foreign_object, fp);
+	oid_array_for_each_unique(&thin_bases, write_thin_base, fp);
+	if (fclose(fp))
+		die_errno(_("could not write '%s'"), path);
+	oid_array_clear(&foreign_objects);
+	oid_array_clear(&thin_bases);
+}
+
 static void final(const char *final_pack_name, const char *curr_pack_name,
 		  const char *final_index_name, const char *curr_index_name,
 		  const char *keep_msg, const char *promisor_msg,
@@ -1703,6 +1748,8 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 			} else if (!strcmp(arg, "--check-self-contained-and-connected")) {
 				strict = 1;
 				check_self_contained_and_connected = 1;
+			} else if (skip_prefix(arg, "--report-foreign=", &report_foreign)) {
+				strict = 1;
 			} else if (!strcmp(arg, "--fsck-objects")) {
 				do_fsck_object = 1;
 			} else if (!strcmp(arg, "--verify")) {
@@ -1815,6 +1862,8 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	free(ref_deltas);
 	if (strict)
 		foreign_nr = check_objects();
+	if (report_foreign)
+		write_foreign_objects(report_foreign);
 
 	if (show_stat)
 		show_pack_info(stat_only);
@@ -6,8 +6,20 @@
 #include "blob.h"
 #include "exec-cmd.h"
 #include "merge-blobs.h"
-
-static const char merge_tree_usage[] = "git merge-tree <base-tree> <branch1> <branch2>";
+#include "parse-options.h"
+#include "commit.h"
+#include "commit-reach.h"
+#include "quote.h"
+#include "merge-recursive.h"
+#include "merge-in-memory.h"
+#include "alloc.h"
+
+static const char * const merge_tree_usage[] = {
+	N_("git merge-tree [--write-tree] [<options>] <branch1> <branch2>"),
+	N_("git merge-tree [--write-tree] [<options>] --stdin"),
+	N_("git merge-tree [--trivial-merge] <base-tree> <branch1> <branch2>"),
+	NULL
+};
 
 struct merge_list {
 	struct merge_list *next;
@@ -27,7 +39,7 @@ static void add_merge_entry(struct merge_list *entry)
 	merge_result_end = &entry->next;
 }
 
-static void merge_trees(struct tree_desc t[3], const char *base);
+static void trivial_merge_trees(struct tree_desc t[3], const char *base);
 
 static const char *explanation(struct merge_list *entry)
 {
@@ -107,7 +119,7 @@ static void show_diff(struct merge_list *entry)
 	xdemitconf_t xecfg;
 	xdemitcb_t ecb;
 
-	xpp.flags = 0;
+	memset(&xpp, 0, sizeof(xpp));
 	memset(&xecfg, 0, sizeof(xecfg));
 	xecfg.ctxlen = 3;
 	ecb.outf = show_outf;
@@ -222,7 +234,7 @@ static void unresolved_directory(const struct traverse_info *info,
 	buf2 = fill_tree_descriptor(t + 2, ENTRY_OID(n + 2));
 #undef ENTRY_OID
 
-	merge_trees(t, newbase);
+	trivial_merge_trees(t, newbase);
 
 	free(buf0);
 	free(buf1);
@@ -339,7 +351,7 @@ static int threeway_callback(int n, unsigned long mask, unsigned long dirmask, s
 	return mask;
 }
 
-static void merge_trees(struct tree_desc t[3], const char *base)
+static void trivial_merge_trees(struct tree_desc t[3], const char *base)
 {
 	struct traverse_info info;
 
@@ -361,18 +373,16 @@ static void *get_tree_descriptor(struct tree_desc *desc, const char *rev)
 	return buf;
 }
 
-int cmd_merge_tree(int argc, const char **argv, const char *prefix)
+static int trivial_merge(const char *base, const char *branch1,
+			 const char *branch2)
 {
 	struct tree_desc t[3];
 	void *buf1, *buf2, *buf3;
 
-	if (argc != 4)
-		usage(merge_tree_usage);
-
-	buf1 = get_tree_descriptor(t+0, argv[1]);
-	buf2 = get_tree_descriptor(t+1, argv[2]);
-	buf3 = get_tree_descriptor(t+2, argv[3]);
-	merge_trees(t, "");
+	buf1 = get_tree_descriptor(t+0, base);
+	buf2 = get_tree_descriptor(t+1, branch1);
+	buf3 = get_tree_descriptor(t+2, branch2);
+	trivial_merge_trees(t, "");
 	free(buf1);
 	free(buf2);
 	free(buf3);
@@ -380,3 +390,249 @@ int cmd_merge_tree(int argc, const char **argv, const char *prefix)
 	show_result();
 	return 0;
 }
+
+struct merge_tree_options {
+	int name_only;
+	int show_messages;
+	int use_stdin;
+};
+
+/*
+ * Stand-in for the merge of two merge bases, so that the merge base
+ * of the next one can be computed against it.
+ */
+static struct commit *make_virtual_commit(struct tree *tree,
+					  struct commit *parent1,
+					  struct commit *parent2)
+{
+	struct commit *commit = alloc_commit_node(the_repository);
+
+	commit->maybe_tree = tree;
+	commit->object.parsed = 1;
+	commit_list_insert(parent1, &commit->parents);
+	commit_list_insert(parent2, &commit->parents->next);
+	return commit;
+}
+
+/*
+ * Come up with a single merge base tree when there are several merge
+ * bases, by merging them with each other the way merge-recursive does.
+ * Returns NULL if the merge bases could not be merged.
+ */
+static struct tree *merge_bases_tree(struct merge_options *opt,
+				     struct commit_list *bases)
+{
+	struct commit *merged = bases->item;
+	struct tree *tree = get_commit_tree(merged);
+	const char *branch1 = opt->branch1, *branch2 = opt->branch2;
+	const char *ancestor = opt->ancestor;
+	struct commit_list *iter;
+
+	opt->branch1 = "Temporary merge branch 1";
+	opt->branch2 = "Temporary merge branch 2";
+	opt->ancestor = "merged common ancestors";
+	opt->call_depth++;
+	for (iter = bases->next; tree && iter; iter = iter->next) {
+		struct merge_in_memory_result result = MERGE_IN_MEMORY_RESULT_INIT;
+		struct commit_list *inner = get_merge_bases(merged, iter->item);
+		struct tree *inner_tree;
+
+		if (inner)
+			inner_tree = merge_bases_tree(opt, inner);
+		else
+			inner_tree = lookup_tree(the_repository,
+						 the_hash_algo->empty_tree);
+		free_commit_list(inner);
+
+		if (!inner_tree ||
+		    merge_trees_in_memory(opt, tree,
+					  get_commit_tree(iter->item),
+					  inner_tree, &result) < 0) {
+			tree = NULL;
+		} else {
+			tree = lookup_tree(the_repository, &result.tree);
+			merged = make_virtual_commit(tree, merged, iter->item);
+		}
+		merge_in_memory_result_release(&result);
+	}
+	opt->call_depth--;
+	opt->branch1 = branch1;
+	opt->branch2 = branch2;
+	opt->ancestor = ancestor;
+	return tree;
+}
+
+static void show_conflicts(struct merge_tree_options *o,
+			   struct merge_in_memory_result *result)
+{
+	struct string_list_item *item;
+
+	for_each_string_list_item(item, &result->conflicts) {
+		struct merge_conflict *c = item->util;
+		int stage;
+
+		if (o->name_only) {
+			write_name_quoted(item->string, stdout, '\n');
+			continue;
+		}
+		for (stage = 1; stage <= 3; stage++) {
+			struct merge_conflict_stage *s = &c->stages[stage - 1];
+
+			if (!s->mode)
+				continue;
+			printf("%06o %s %d\t", s->mode, oid_to_hex(&s->oid),
+			       stage);
+			write_name_quoted(item->string, stdout, '\n');
+		}
+	}
+
+	if (!o->show_messages || !result->conflicts.nr)
+		return;
+	putchar('\n');
+	for_each_string_list_item(item, &result->conflicts) {
+		struct merge_conflict *c = item->util;
+		printf(_("CONFLICT (%s): %s\n"), c->type, item->string);
+	}
+}
+
+/*
+ * Merge <branch1> and <branch2> and show the result.  Returns 1 if the
+ * merge was clean, 0 if it had conflicts, and -1 with a message in
+ * "err" if it could not be done at all.
+ */
+static int real_merge(struct merge_tree_options *o,
+		      const char *branch1, const char *branch2,
+		      struct strbuf *err)
+{
+	struct commit *parent1, *parent2;
+	struct commit_list *merge_bases;
+	struct merge_options opt;
+	struct merge_in_memory_result result = MERGE_IN_MEMORY_RESULT_INIT;
+	struct strbuf ancestor = STRBUF_INIT;
+	struct tree *base_tree;
+	int clean;
+
+	parent1 = get_merge_parent(branch1);
+	if (!parent1) {
+		strbuf_addf(err, _("could not resolve ref '%s'"), branch1);
+		return -1;
+	}
+	parent2 = get_merge_parent(branch2);
+	if (!parent2) {
+		strbuf_addf(err, _("could not resolve ref '%s'"), branch2);
+		return -1;
+	}
+
+	merge_bases = get_merge_bases(parent1, parent2);
+	if (!merge_bases) {
+		strbuf_addstr(err, _("refusing to merge unrelated histories"));
+		return -1;
+	}
+
+	init_merge_options(&opt);
+	opt.branch1 = branch1;
+	opt.branch2 = branch2;
+	if (merge_bases->next)
+		strbuf_addstr(&ancestor, "merged common ancestors");
+	else
+		strbuf_add_unique_abbrev(&ancestor,
+					 &merge_bases->item->object.oid,
+					 DEFAULT_ABBREV);
+	opt.ancestor = ancestor.buf;
+	base_tree = merge_bases_tree(&opt, merge_bases);
+	free_commit_list(merge_bases);
+
+	if (!base_tree)
+		clean = -1;
+	else
+		clean = merge_trees_in_memory(&opt, get_commit_tree(parent1),
+					      get_commit_tree(parent2),
+					      base_tree, &result);
+	if (clean < 0) {
+		strbuf_addf(err, _("failed to merge '%s' and '%s'"),
+			    branch1, branch2);
+	} else {
+		if (o->use_stdin)
+			printf("%d\n", clean);
+		printf("%s\n", oid_to_hex(&result.tree));
+		show_conflicts(o, &result);
+		if (o->use_stdin)
+			putchar('\0');
+		fflush(stdout);
+	}
+
+	merge_in_memory_result_release(&result);
+	strbuf_release(&ancestor);
+	strbuf_release(&opt.obuf);
+	string_list_clear(&opt.df_conflict_file_set, 0);
+	return clean;
+}
+
+int cmd_merge_tree(int argc, const char **argv, const char *prefix)
+{
+	struct merge_tree_options o = { 0 };
+	struct strbuf err = STRBUF_INIT;
+	int clean;
+	enum { MODE_UNKNOWN, MODE_TRIVIAL, MODE_REAL } mode = MODE_UNKNOWN;
+	struct option options[] = {
+		OPT_CMDMODE(0, "write-tree", &mode,
+			    N_("do a real merge instead of a trivial merge"),
+			    MODE_REAL),
+		OPT_CMDMODE(0, "trivial-merge", &mode,
+			    N_("do a trivial merge only"), MODE_TRIVIAL),
+		OPT_BOOL(0, "name-only", &o.name_only,
+			 N_("list filenames without modes/oids/stages")),
+		OPT_BOOL(0, "messages", &o.show_messages,
+			 N_("also show informational/conflict messages")),
+		OPT_BOOL(0, "stdin", &o.use_stdin,
+			 N_("perform multiple merges, one per line of input")),
+		OPT_END()
+	};
+
+	o.show_messages = 1;
+	argc = parse_options(argc, argv, prefix, options, merge_tree_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+
+	if (o.use_stdin) {
+		struct strbuf buf = STRBUF_INIT;
+
+		if (mode == MODE_TRIVIAL)
+			die(_("--trivial-merge is incompatible with --stdin"));
+		if (argc)
+			usage_with_options(merge_tree_usage, options);
+		while (strbuf_getline(&buf, stdin) != EOF) {
+			struct string_list split = STRING_LIST_INIT_NODUP;
+
+			strbuf_reset(&err);
+			if (string_list_split_in_place(&split, buf.buf, ' ', -1) != 2)
+				strbuf_addf(&err, _("malformed input line: '%s'"),
+					    buf.buf);
+			else
+				real_merge(&o, split.items[0].string,
+					   split.items[1].string, &err);
+			if (err.len) {
+				printf("-1\n%s\n", err.buf);
+				putchar('\0');
+				fflush(stdout);
+			}
+			string_list_clear(&split, 0);
+		}
+		strbuf_release(&buf);
+		strbuf_release(&err);
+		return 0;
+	}
+
+	if (mode == MODE_UNKNOWN)
+		mode = argc == 3 ? MODE_TRIVIAL : MODE_REAL;
+	if (mode == MODE_TRIVIAL) {
+		if (argc != 3)
+			usage_with_options(merge_tree_usage, options);
+		return trivial_merge(argv[0], argv[1], argv[2]);
+	}
+	if (argc != 2)
+		usage_with_options(merge_tree_usage, options);
+	clean = real_merge(&o, argv[0], argv[1], &err);
+	if (clean < 0)
+		die("%s", err.buf);
+	return !clean;
+}
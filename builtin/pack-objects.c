@@ -101,6 +101,20 @@ static int exclude_promisor_objects;
 
 static int use_delta_islands;
 
+/*
+ * Packs that uploadpack.packfileURI says clients can download on their
+ * own; with --uri-protocol, the objects they contain are left out of the
+ * pack, and the packs they were taken from are listed before it.
+ */
+struct packfile_uri {
+	struct object_id hash;
+	const char *uri;
+	struct packed_git *pack;
+	unsigned used : 1;
+};
+static struct packfile_uri *packfile_uris;
+static int packfile_uris_nr, packfile_uris_alloc;
+
 static unsigned long delta_cache_size = 0;
 static unsigned long max_delta_cache_size = DEFAULT_DELTA_CACHE_SIZE;
 static unsigned long cache_max_small_delta_size = 1000;
@@ -1035,8 +1049,14 @@ static int want_found_object(int exclude, struct packed_git *p)
 		return 0;
 	if (p->pack_local &&
 	    ((ignore_packed_keep_on_disk && p->pack_keep) ||
-	     (ignore_packed_keep_in_core && p->pack_keep_in_core)))
+	     (ignore_packed_keep_in_core && p->pack_keep_in_core))) {
+		int i;
+
+		for (i = 0; i < packfile_uris_nr; i++)
+			if (packfile_uris[i].pack == p)
+				packfile_uris[i].used = 1;
 		return 0;
+	}
 
 	/* we don't know yet; keep looking for more packs */
 	return -1;
@@ -2748,6 +2768,24 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 			    pack_idx_opts.version);
 		return 0;
 	}
+	if (!strcmp(k, "uploadpack.packfileuri")) {
+		struct packfile_uri *u;
+		struct object_id hash;
+		const char *end;
+
+		if (!v)
+			return config_error_nonbool(k);
+		if (parse_oid_hex(v, &hash, &end) || *end != ' ')
+			die(_("value of %s must be of the form "
+			      "'<pack-hash> <uri>' (got '%s')"), k, v);
+		ALLOC_GROW(packfile_uris, packfile_uris_nr + 1,
+			   packfile_uris_alloc);
+		u = &packfile_uris[packfile_uris_nr++];
+		memset(u, 0, sizeof(*u));
+		oidcpy(&u->hash, &hash);
+		u->uri = xstrdup(end + 1);
+		return 0;
+	}
 	return git_default_config(k, v, cb);
 }
 
@@ -3202,6 +3240,58 @@ static void add_extra_kept_packs(const struct string_list *names)
 	}
 }
 
+/*
+ * Keep the objects of the packs that can be downloaded with one of
+ * "protocols" out of the pack we write.
+ */
+static void add_packfile_uri_packs(const struct string_list *protocols)
+{
+	int i;
+
+	if (!protocols->nr)
+		return;
+
+	for (i = 0; i < packfile_uris_nr; i++) {
+		struct packfile_uri *u = &packfile_uris[i];
+		const char *colon = strchr(u->uri, ':');
+		char *protocol;
+		struct packed_git *p;
+
+		if (!colon)
+			continue;
+		protocol = xstrndup(u->uri, colon - u->uri);
+		if (unsorted_string_list_has_string(
+				(struct string_list *)protocols, protocol)) {
+			for (p = get_all_packs(the_repository); p; p = p->next) {
+				if (!p->pack_local ||
+				    hashcmp(p->sha1, u->hash.hash))
+					continue;
+				p->pack_keep_in_core = 1;
+				ignore_packed_keep_in_core = 1;
+				u->pack = p;
+				break;
+			}
+		}
+		free(protocol);
+	}
+}
+
+/*
+ * Tell the reader of our output which of the packs it has to download,
+ * one "<pack-hash> <uri>" line each, followed by an empty line.
+ */
+static void write_packfile_uris(void)
+{
+	int i;
+
+	for (i = 0; i < packfile_uris_nr; i++)
+		if (packfile_uris[i].used)
+			printf("%s %s\n", oid_to_hex(&packfile_uris[i].hash),
+			       packfile_uris[i].uri);
+	printf("\n");
+	fflush(stdout);
+}
+
 static int option_parse_index_version(const struct option *opt,
 				      const char *arg, int unset)
 {
@@ -3241,6 +3331,7 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 	int rev_list_unpacked = 0, rev_list_all = 0, rev_list_reflog = 0;
 	int rev_list_index = 0;
 	struct string_list keep_pack_list = STRING_LIST_INIT_NODUP;
+	struct string_list uri_protocols = STRING_LIST_INIT_NODUP;
 	struct option pack_objects_options[] = {
 		OPT_SET_INT('q', "quiet", &progress,
 			    N_("do not show progress meter"), 0),
@@ -3325,6 +3416,9 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 			 N_("do not pack objects in promisor packfiles")),
 		OPT_BOOL(0, "delta-islands", &use_delta_islands,
 			 N_("respect islands during delta compression")),
+		OPT_STRING_LIST(0, "uri-protocol", &uri_protocols,
+				N_("protocol"),
+				N_("exclude any configured uploadpack.packfileuri with this protocol")),
 		OPT_END(),
 	};
 
@@ -3429,6 +3523,9 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 		use_bitmap_index = 0;
 	}
 
+	if (uri_protocols.nr && !pack_to_stdout)
+		die(_("cannot use --uri-protocol without --stdout"));
+
 	/*
 	 * "soft" reasons not to use bitmaps - for on-disk repack by default we want
 	 *
@@ -3458,6 +3555,7 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 		progress = 2;
 
 	add_extra_kept_packs(&keep_pack_list);
+	add_packfile_uri_packs(&uri_protocols);
 	if (ignore_packed_keep_on_disk) {
 		struct packed_git *p;
 		for (p = get_all_packs(the_repository); p; p = p->next)
@@ -3500,6 +3598,8 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 		return 0;
 	if (nr_result)
 		prepare_pack(window, depth);
+	if (uri_protocols.nr)
+		write_packfile_uris();
 	write_pack_file();
 	if (progress)
 		fprintf_ln(stderr,
@@ -28,6 +28,9 @@
 #include "object-store.h"
 #include "protocol.h"
 #include "commit-reach.h"
+#include "serve.h"
+#include "tree.h"
+#include "tree-walk.h"
 
 static const char * const receive_pack_usage[] = {
 	N_("git receive-pack <git-dir>"),
@@ -58,6 +61,10 @@ static off_t max_input_size;
 static int report_status;
 static int use_sideband;
 static int use_atomic;
+static int batch_updates;
+static int pack_refs_threshold = 1000;
+static int pack_connectivity_check;
+static unsigned int ref_update_flags;
 static int use_push_options;
 static int quiet;
 static int prefer_ofs_delta = 1;
@@ -96,6 +103,15 @@ static int keepalive_in_sec = 5;
 
 static struct tmp_objdir *tmp_objdir;
 
+/*
+ * The pack index-pack stored, the objects it refers to without
+ * containing them, and the bases index-pack added to it without
+ * checking them, when receive.packConnectivityCheck is in effect.
+ */
+static struct packed_git *received_pack;
+static struct oidset foreign_objects = OIDSET_INIT;
+static struct oidset thin_bases = OIDSET_INIT;
+
 static enum deny_action parse_deny_action(const char *var, const char *value)
 {
 	if (value) {
@@ -228,6 +244,21 @@ static int receive_pack_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (strcmp(var, "receive.batchupdates") == 0) {
+		batch_updates = git_config_bool(var, value);
+		return 0;
+	}
+
+	if (strcmp(var, "receive.packrefsthreshold") == 0) {
+		pack_refs_threshold = git_config_int(var, value);
+		return 0;
+	}
+
+	if (strcmp(var, "receive.packconnectivitycheck") == 0) {
+		pack_connectivity_check = git_config_bool(var, value);
+		return 0;
+	}
+
 	return git_default_config(var, value, cb);
 }
 
@@ -312,7 +343,8 @@ struct command {
 	struct command *next;
 	const char *error_string;
 	unsigned int skip_update:1,
-		     did_not_exist:1;
+		     did_not_exist:1,
+		     ignore_old_oid:1;
 	int index;
 	struct object_id old_oid;
 	struct object_id new_oid;
@@ -1017,6 +1049,33 @@ static const char *update_worktree(unsigned char *sha1)
 	return retval;
 }
 
+/*
+ * Add the update of "cmd", once update() has accepted it, to
+ * "transaction".
+ */
+static int queue_ref_update(struct ref_transaction *transaction,
+			    struct command *cmd, struct strbuf *err)
+{
+	struct strbuf namespaced_name = STRBUF_INIT;
+	int ret;
+
+	strbuf_addf(&namespaced_name, "%s%s", get_git_namespace(),
+		    cmd->ref_name);
+	if (is_null_oid(&cmd->new_oid))
+		ret = ref_transaction_delete(transaction,
+					     namespaced_name.buf,
+					     cmd->ignore_old_oid ?
+					     NULL : &cmd->old_oid,
+					     0, "push", err);
+	else
+		ret = ref_transaction_update(transaction,
+					     namespaced_name.buf,
+					     &cmd->new_oid, &cmd->old_oid,
+					     ref_update_flags, "push", err);
+	strbuf_release(&namespaced_name);
+	return ret;
+}
+
 static const char *update(struct command *cmd, struct shallow_info *si)
 {
 	const char *name = cmd->ref_name;
@@ -1126,7 +1185,7 @@ static const char *update(struct command *cmd, struct shallow_info *si)
 	if (is_null_oid(new_oid)) {
 		struct strbuf err = STRBUF_INIT;
 		if (!parse_object(the_repository, old_oid)) {
-			old_oid = NULL;
+			cmd->ignore_old_oid = 1;
 			if (ref_exists(name)) {
 				rp_warning("Allowing deletion of corrupt ref.");
 			} else {
@@ -1134,10 +1193,7 @@ static const char *update(struct command *cmd, struct shallow_info *si)
 				cmd->did_not_exist = 1;
 			}
 		}
-		if (ref_transaction_delete(transaction,
-					   namespaced_name,
-					   old_oid,
-					   0, "push", &err)) {
+		if (queue_ref_update(transaction, cmd, &err)) {
 			rp_error("%s", err.buf);
 			strbuf_release(&err);
 			return "failed to delete";
@@ -1151,11 +1207,7 @@ static const char *update(struct command *cmd, struct shallow_info *si)
 		    update_shallow_ref(cmd, si))
 			return "shallow error";
 
-		if (ref_transaction_update(transaction,
-					   namespaced_name,
-					   new_oid, old_oid,
-					   0, "push",
-					   &err)) {
+		if (queue_ref_update(transaction, cmd, &err)) {
 			rp_error("%s", err.buf);
 			strbuf_release(&err);
 
@@ -1326,6 +1378,247 @@ static int iterate_receive_command_list(void *cb_data, struct object_id *oid)
 	return -1; /* end of list */
 }
 
+/* Remember to update object flag allocation in object.h */
+#define CLOSURE_SEEN	(1u<<22)
+#define UNVERIFIED	(1u<<23)
+
+struct closure_check {
+	struct oidset tips;
+	int tips_collected;
+	struct tree **bases;
+	int bases_nr, bases_alloc;
+	int unverified_nr;
+};
+
+static int add_tip(const char *refname, const struct object_id *oid,
+		   int flag, void *data)
+{
+	struct oidset *tips = data;
+	struct object_id peeled;
+
+	oidset_insert(tips, oid);
+	if (!peel_ref(refname, &peeled))
+		oidset_insert(tips, &peeled);
+	return 0;
+}
+
+static void add_alternate_tip(const struct object_id *oid, void *data)
+{
+	oidset_insert(data, oid);
+}
+
+/*
+ * Whether "oid" is what a ref of ours or of an alternate points at,
+ * and is therefore known to be connected.
+ */
+static int is_tip(struct closure_check *c, const struct object_id *oid)
+{
+	if (!c->tips_collected) {
+		head_ref(add_tip, &c->tips);
+		for_each_ref(add_tip, &c->tips);
+		for_each_alternate_ref(add_alternate_tip, &c->tips);
+		c->tips_collected = 1;
+	}
+	return oidset_contains(&c->tips, oid);
+}
+
+/* Whether "oid" is in the received pack and its links were checked. */
+static int in_received_pack(const struct object_id *oid)
+{
+	return !oidset_contains(&foreign_objects, oid) &&
+		!oidset_contains(&thin_bases, oid) &&
+		find_pack_entry_one(oid->hash, received_pack);
+}
+
+/*
+ * Walk the tree "ours" from the received pack alongside the connected
+ * tree "theirs", and mark the foreign entries of "ours" that are the
+ * same object at the same path in "theirs" as verified.
+ */
+static void match_trees(struct closure_check *c, struct tree *ours,
+			struct tree *theirs)
+{
+	struct tree_desc od, td;
+	struct name_entry oe, te;
+	int have_te;
+
+	if (ours->object.flags & CLOSURE_SEEN)
+		return;
+	ours->object.flags |= CLOSURE_SEEN;
+	if (parse_tree(ours) || parse_tree(theirs))
+		return;
+
+	init_tree_desc(&od, ours->buffer, ours->size);
+	init_tree_desc(&td, theirs->buffer, theirs->size);
+	have_te = tree_entry(&td, &te);
+	while (c->unverified_nr && tree_entry(&od, &oe)) {
+		struct object *o;
+		int cmp = 1;
+
+		while (have_te &&
+		       (cmp = base_name_compare(te.path, tree_entry_len(&te), te.mode,
+						oe.path, tree_entry_len(&oe), oe.mode)) < 0)
+			have_te = tree_entry(&td, &te);
+		if (cmp || !S_ISDIR(oe.mode) || !S_ISDIR(te.mode))
+			continue;
+
+		if (oideq(oe.oid, te.oid)) {
+			o = lookup_object(the_repository, oe.oid->hash);
+			if (o && (o->flags & UNVERIFIED)) {
+				o->flags &= ~UNVERIFIED;
+				c->unverified_nr--;
+			}
+		} else if (in_received_pack(oe.oid)) {
+			match_trees(c, lookup_tree(the_repository, oe.oid),
+				    lookup_tree(the_repository, te.oid));
+		}
+	}
+}
+
+static int check_foreign_object(const struct object_id *oid,
+				struct closure_check *c)
+{
+	struct object *o;
+
+	switch (oid_object_info(the_repository, oid, NULL)) {
+	case OBJ_BLOB:
+		/* index-pack made sure it exists, and it refers to nothing */
+		return 0;
+	case OBJ_TREE:
+		o = &lookup_tree(the_repository, oid)->object;
+		o->flags |= UNVERIFIED;
+		c->unverified_nr++;
+		return 0;
+	case OBJ_COMMIT:
+		if (!is_tip(c, oid))
+			return -1;
+		o = parse_object(the_repository, oid);
+		if (!o || o->type != OBJ_COMMIT)
+			return -1;
+		ALLOC_GROW(c->bases, c->bases_nr + 1, c->bases_alloc);
+		c->bases[c->bases_nr++] = get_commit_tree((struct commit *)o);
+		return 0;
+	case OBJ_TAG:
+		return is_tip(c, oid) ? 0 : -1;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Verify the trees the received pack refers to by matching the trees
+ * of its commits against those of the commits it builds upon.
+ */
+static void verify_foreign_trees(struct closure_check *c,
+				 struct command *commands)
+{
+	struct commit_list *list = NULL;
+	struct command *cmd;
+	int i;
+
+	for (cmd = commands; cmd; cmd = cmd->next) {
+		struct object *o;
+
+		if (is_null_oid(&cmd->new_oid) ||
+		    !in_received_pack(&cmd->new_oid))
+			continue;
+		o = parse_object(the_repository, &cmd->new_oid);
+		while (o && o->type == OBJ_TAG &&
+		       in_received_pack(&((struct tag *)o)->tagged->oid))
+			o = parse_object(the_repository,
+					 &((struct tag *)o)->tagged->oid);
+		if (o && o->type == OBJ_COMMIT &&
+		    !(o->flags & CLOSURE_SEEN)) {
+			o->flags |= CLOSURE_SEEN;
+			commit_list_insert((struct commit *)o, &list);
+		}
+	}
+
+	while (list && c->unverified_nr) {
+		struct commit *commit = pop_commit(&list);
+		struct commit_list *p;
+		struct tree *tree;
+
+		if (parse_commit(commit))
+			continue;
+		tree = get_commit_tree(commit);
+		for (i = 0; i < c->bases_nr; i++) {
+			if (oideq(&tree->object.oid, &c->bases[i]->object.oid)) {
+				if (tree->object.flags & UNVERIFIED) {
+					tree->object.flags &= ~UNVERIFIED;
+					c->unverified_nr--;
+				}
+			} else if (in_received_pack(&tree->object.oid)) {
+				match_trees(c, tree, c->bases[i]);
+			}
+		}
+
+		for (p = commit->parents; p; p = p->next) {
+			struct commit *parent = p->item;
+
+			if (parent->object.flags & CLOSURE_SEEN ||
+			    !in_received_pack(&parent->object.oid))
+				continue;
+			parent->object.flags |= CLOSURE_SEEN;
+			commit_list_insert(parent, &list);
+		}
+	}
+	free_commit_list(list);
+}
+
+/*
+ * Return 1 if the new values of all refs are known to be connected
+ * without walking the history: each of them must either be pointed at
+ * by one of our refs already, or be in the received pack, whose
+ * objects index-pack checked refer only to objects in the pack or to
+ * the "foreign" objects it reported. These must exist and in turn be
+ * connected: blobs trivially are, commits and tags must be tips, and
+ * trees must be found at the same path in the trees of the commits the
+ * pack builds upon. Return 0 if any of this cannot be established, in
+ * which case the usual check is needed.
+ */
+static int pack_closure_connected(struct command *commands,
+				  struct shallow_info *si)
+{
+	struct closure_check c = { OIDSET_INIT };
+	struct command *cmd;
+	int ret = 0;
+
+	if (!pack_connectivity_check || si->nr_ours || si->nr_theirs ||
+	    is_repository_shallow(the_repository))
+		return 0;
+
+	for (cmd = commands; cmd; cmd = cmd->next) {
+		if (is_null_oid(&cmd->new_oid) || cmd->skip_update)
+			continue;
+		if (!(received_pack && in_received_pack(&cmd->new_oid)) &&
+		    !is_tip(&c, &cmd->new_oid))
+			goto out;
+	}
+
+	if (received_pack) {
+		struct oidset_iter iter;
+		const struct object_id *oid;
+
+		oidset_iter_init(&foreign_objects, &iter);
+		while ((oid = oidset_iter_next(&iter)))
+			if (check_foreign_object(oid, &c))
+				goto out;
+		if (c.unverified_nr)
+			verify_foreign_trees(&c, commands);
+		if (c.unverified_nr)
+			goto out;
+	}
+
+	trace_printf("trace: receive-pack: connectivity established from "
+		     "the received pack\n");
+	ret = 1;
+out:
+	oidset_clear(&c.tips);
+	free(c.bases);
+	return ret;
+}
+
 static void reject_updates_to_hidden(struct command *commands)
 {
 	struct strbuf refname_full = STRBUF_INIT;
@@ -1406,6 +1699,117 @@ static void execute_commands_non_atomic(struct command *commands,
 	strbuf_release(&err);
 }
 
+/*
+ * Commit "t", which holds the updates of the "nr" commands of "batch".
+ * If it fails, retry each half of the batch in its own transaction, so
+ * that a few failing updates cost a few more transactions rather than
+ * one per ref, until the commands that fail are found.
+ */
+static void commit_batch(struct ref_transaction *t,
+			 struct command **batch, int nr,
+			 int *nr_transactions)
+{
+	struct strbuf err = STRBUF_INIT;
+	int i, half;
+
+	(*nr_transactions)++;
+	if (!ref_transaction_commit(t, &err)) {
+		ref_transaction_free(t);
+		strbuf_release(&err);
+		return;
+	}
+	ref_transaction_free(t);
+
+	if (nr == 1) {
+		rp_error("%s", err.buf);
+		batch[0]->error_string = "failed to update ref";
+		strbuf_release(&err);
+		return;
+	}
+
+	half = nr / 2;
+	for (i = 0; i < 2; i++) {
+		struct command **part = i ? batch + half : batch;
+		int part_nr = i ? nr - half : half;
+		int j;
+
+		strbuf_reset(&err);
+		t = ref_transaction_begin(&err);
+		if (!t) {
+			rp_error("%s", err.buf);
+			for (j = 0; j < part_nr; j++)
+				part[j]->error_string = "transaction failed to start";
+			continue;
+		}
+		for (j = 0; j < part_nr; j++) {
+			if (queue_ref_update(t, part[j], &err))
+				BUG("could not queue an update accepted before: %s",
+				    err.buf);
+		}
+		commit_batch(t, part, part_nr, nr_transactions);
+	}
+	strbuf_release(&err);
+}
+
+static void execute_commands_batched(struct command *commands,
+				     struct shallow_info *si)
+{
+	struct command *cmd, **batch = NULL;
+	int nr = 0, alloc = 0, nr_transactions = 0, nr_failed = 0, i;
+	struct strbuf err = STRBUF_INIT;
+
+	/*
+	 * Writing many refs at once is cheaper in packed-refs than as
+	 * loose refs, but packed-refs is rewritten as a whole.
+	 */
+	for (cmd = commands; cmd; cmd = cmd->next)
+		if (should_process_cmd(cmd))
+			nr++;
+	if (pack_refs_threshold > 0 && nr >= pack_refs_threshold)
+		ref_update_flags = REF_WRITE_PACKED;
+	nr = 0;
+
+	transaction = ref_transaction_begin(&err);
+	if (!transaction) {
+		rp_error("%s", err.buf);
+		for (cmd = commands; cmd; cmd = cmd->next)
+			if (should_process_cmd(cmd))
+				cmd->error_string = "transaction failed to start";
+		goto cleanup;
+	}
+
+	for (cmd = commands; cmd; cmd = cmd->next) {
+		if (!should_process_cmd(cmd))
+			continue;
+
+		cmd->error_string = update(cmd, si);
+		if (cmd->error_string)
+			continue;
+
+		ALLOC_GROW(batch, nr + 1, alloc);
+		batch[nr++] = cmd;
+	}
+
+	if (nr)
+		commit_batch(transaction, batch, nr, &nr_transactions);
+	else
+		ref_transaction_free(transaction);
+	transaction = NULL;
+
+	for (i = 0; i < nr; i++)
+		if (batch[i]->error_string)
+			nr_failed++;
+	trace_printf("trace: receive-pack: %d ref update(s) in %d transaction(s), "
+		     "%d failed%s\n", nr, nr_transactions, nr_failed,
+		     ref_update_flags & REF_WRITE_PACKED ?
+		     ", written to packed-refs" : "");
+
+cleanup:
+	ref_update_flags = 0;
+	free(batch);
+	strbuf_release(&err);
+}
+
 static void execute_commands_atomic(struct command *commands,
 					struct shallow_info *si)
 {
@@ -1458,6 +1862,7 @@ static void execute_commands(struct command *commands,
 	struct iterate_data data;
 	struct async muxer;
 	int err_fd = 0;
+	uint64_t start;
 
 	if (unpacker_error) {
 		for (cmd = commands; cmd; cmd = cmd->next)
@@ -1479,8 +1884,13 @@ static void execute_commands(struct command *commands,
 	opt.err_fd = err_fd;
 	opt.progress = err_fd && !quiet;
 	opt.env = tmp_objdir_env(tmp_objdir);
-	if (check_connected(iterate_receive_command_list, &data, &opt))
+	start = getnanotime();
+	if (pack_closure_connected(commands, si)) {
+		if (err_fd)
+			close(err_fd);
+	} else if (check_connected(iterate_receive_command_list, &data, &opt))
 		set_connectivity_errors(commands, si);
+	trace_performance_since(start, "check connectivity");
 
 	if (use_sideband)
 		finish_async(&muxer);
@@ -1513,10 +1923,14 @@ static void execute_commands(struct command *commands,
 	free(head_name_to_free);
 	head_name = head_name_to_free = resolve_refdup("HEAD", 0, NULL, NULL);
 
+	start = getnanotime();
 	if (use_atomic)
 		execute_commands_atomic(commands, si);
+	else if (batch_updates)
+		execute_commands_batched(commands, si);
 	else
 		execute_commands_non_atomic(commands, si);
+	trace_performance_since(start, "update refs");
 
 	if (shallow_update)
 		warn_if_skipped_connectivity_check(commands, si);
@@ -1680,12 +2094,65 @@ static void push_header_arg(struct argv_array *args, struct pack_header *hdr)
 			ntohl(hdr->hdr_version), ntohl(hdr->hdr_entries));
 }
 
+static struct packed_git *find_received_pack(void)
+{
+	struct packed_git *pack;
+	const char *name;
+	size_t len;
+
+	/* the lockfile is "<objdir>/pack/pack-<hash>.keep" */
+	if (!pack_lockfile)
+		return NULL;
+	name = strrchr(pack_lockfile, '/');
+	name = name ? name + 1 : pack_lockfile;
+	if (!strip_suffix(name, ".keep", &len))
+		return NULL;
+
+	for (pack = get_packed_git(the_repository); pack; pack = pack->next) {
+		const char *base = strrchr(pack->pack_name, '/');
+
+		base = base ? base + 1 : pack->pack_name;
+		if (!strncmp(base, name, len) && !strcmp(base + len, ".pack"))
+			return pack;
+	}
+	return NULL;
+}
+
+static int read_foreign_objects(const char *path)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct object_id oid;
+	const char *p;
+	int ret = 0;
+
+	if (strbuf_read_file(&buf, path, 0) < 0)
+		ret = -1;
+	for (p = buf.buf; !ret && *p; p++) {
+		if (parse_oid_hex(p, &oid, &p))
+			ret = -1;
+		else if (skip_prefix(p, " base", &p))
+			oidset_insert(&thin_bases, &oid);
+		else
+			oidset_insert(&foreign_objects, &oid);
+		if (*p != '\n')
+			ret = -1;
+	}
+	strbuf_release(&buf);
+
+	if (ret) {
+		oidset_clear(&foreign_objects);
+		oidset_clear(&thin_bases);
+	}
+	return ret;
+}
+
 static const char *unpack(int err_fd, struct shallow_info *si)
 {
 	struct pack_header hdr;
 	const char *hdr_err;
 	int status;
 	struct child_process child = CHILD_PROCESS_INIT;
+	struct tempfile *foreign_file = NULL;
 	int fsck_objects = (receive_fsck_objects >= 0
 			    ? receive_fsck_objects
 			    : transfer_fsck_objects >= 0
@@ -1762,18 +2229,35 @@ static const char *unpack(int err_fd, struct shallow_info *si)
 		if (max_input_size)
 			argv_array_pushf(&child.args, "--max-input-size=%"PRIuMAX,
 				(uintmax_t)max_input_size);
+		if (pack_connectivity_check && !alt_shallow_file) {
+			foreign_file = mks_tempfile(git_path("foreign_XXXXXX"));
+			if (foreign_file && !close_tempfile_gently(foreign_file))
+				argv_array_pushf(&child.args, "--report-foreign=%s",
+						 get_tempfile_path(foreign_file));
+			else
+				delete_tempfile(&foreign_file);
+		}
 		child.out = -1;
 		child.err = err_fd;
 		child.git_cmd = 1;
 		status = start_command(&child);
-		if (status)
+		if (status) {
+			delete_tempfile(&foreign_file);
 			return "index-pack fork failed";
+		}
 		pack_lockfile = index_pack_lockfile(child.out);
 		close(child.out);
 		status = finish_command(&child);
-		if (status)
+		if (status) {
+			delete_tempfile(&foreign_file);
 			return "index-pack abnormal exit";
+		}
 		reprepare_packed_git(the_repository);
+		if (foreign_file) {
+			if (!read_foreign_objects(get_tempfile_path(foreign_file)))
+				received_pack = find_received_pack();
+			delete_tempfile(&foreign_file);
+		}
 	}
 	return NULL;
 }
@@ -1917,13 +2401,138 @@ static int delete_only(struct command *commands)
 	return 1;
 }
 
+/*
+ * Receive the pack (unless only deleting refs), update the refs as
+ * "commands" say, report the outcome to the client if it asked for it
+ * and run the post-update hooks and housekeeping.
+ */
+static void receive_commands(struct command *commands,
+			     struct oid_array *shallow,
+			     struct string_list *push_options)
+{
+	const char *unpack_status = NULL;
+	struct oid_array ref = OID_ARRAY_INIT;
+	struct shallow_info si;
+
+	if (!check_cert_push_options(push_options)) {
+		struct command *cmd;
+		for (cmd = commands; cmd; cmd = cmd->next)
+			cmd->error_string = "inconsistent push options";
+	}
+
+	prepare_shallow_info(&si, shallow);
+	if (!si.nr_ours && !si.nr_theirs)
+		shallow_update = 0;
+	if (!delete_only(commands)) {
+		unpack_status = unpack_with_sideband(&si);
+		update_shallow_info(commands, &si, &ref);
+	}
+	use_keepalive = KEEPALIVE_ALWAYS;
+	execute_commands(commands, unpack_status, &si, push_options);
+	if (pack_lockfile)
+		unlink_or_warn(pack_lockfile);
+	if (report_status)
+		report(commands, unpack_status);
+	run_receive_hook(commands, "post-receive", 1, push_options);
+	run_update_post_hook(commands);
+	if (auto_gc) {
+		const char *argv_gc_auto[] = {
+			"gc", "--auto", "--quiet", NULL,
+		};
+		struct child_process proc = CHILD_PROCESS_INIT;
+
+		proc.no_stdin = 1;
+		proc.stdout_to_stderr = 1;
+		proc.err = use_sideband ? -1 : 0;
+		proc.git_cmd = 1;
+		proc.argv = argv_gc_auto;
+
+		close_all_packs(the_repository->objects);
+		if (!start_command(&proc)) {
+			if (use_sideband)
+				copy_to_sideband(proc.err, -1, NULL);
+			finish_command(&proc);
+		}
+	}
+	if (auto_update_server_info)
+		update_server_info(0);
+	clear_shallow_info(&si);
+	oid_array_clear(&ref);
+}
+
+static int push_advertise(struct repository *r, struct strbuf *value)
+{
+	if (value) {
+		strbuf_addstr(value, "report-status delete-refs quiet");
+		if (advertise_atomic_push)
+			strbuf_addstr(value, " atomic");
+		if (prefer_ofs_delta)
+			strbuf_addstr(value, " ofs-delta");
+		if (advertise_push_options)
+			strbuf_addstr(value, " push-options");
+	}
+	return 1;
+}
+
+/*
+ * The protocol v2 "push" command: the request lists the features the
+ * client uses, push options, shallow commits and ref updates, and the
+ * pack follows it. The response is multiplexed on side-band.
+ */
+static int push_v2(struct repository *r, struct argv_array *keys,
+		   struct packet_reader *request)
+{
+	static int pushed;
+	struct command *commands = NULL, **tail = &commands;
+	struct oid_array shallow = OID_ARRAY_INIT;
+	struct string_list push_options = STRING_LIST_INIT_DUP;
+
+	/* the state of a push is not meant to be reset */
+	if (pushed++)
+		die("only one push per connection is supported");
+
+	use_sideband = LARGE_PACKET_MAX;
+	while (packet_reader_read(request) == PACKET_READ_NORMAL) {
+		const char *arg = request->line;
+		struct object_id oid;
+
+		if (!strcmp(arg, "report-status"))
+			report_status = 1;
+		else if (!strcmp(arg, "quiet"))
+			quiet = 1;
+		else if (advertise_atomic_push && !strcmp(arg, "atomic"))
+			use_atomic = 1;
+		else if (advertise_push_options &&
+			 skip_prefix(arg, "push-option ", &arg))
+			string_list_append(&push_options, arg);
+		else if (skip_prefix(arg, "shallow ", &arg)) {
+			if (get_oid_hex(arg, &oid))
+				die("protocol error: expected shallow sha, got '%s'",
+				    arg);
+			oid_array_append(&shallow, &oid);
+		} else if (skip_prefix(arg, "update ", &arg))
+			tail = queue_command(tail, arg, strlen(arg));
+		else
+			die("unexpected line: '%s'", arg);
+	}
+	if (request->status != PACKET_READ_FLUSH)
+		die("expected flush after push request");
+
+	if (commands)
+		receive_commands(commands, &shallow, &push_options);
+	packet_flush(1);
+
+	string_list_clear(&push_options, 0);
+	oid_array_clear(&shallow);
+	return 0;
+}
+
 int cmd_receive_pack(int argc, const char **argv, const char *prefix)
 {
 	int advertise_refs = 0;
 	struct command *commands;
 	struct oid_array shallow = OID_ARRAY_INIT;
-	struct oid_array ref = OID_ARRAY_INIT;
-	struct shallow_info si;
+	struct serve_options serve_opts = SERVE_OPTIONS_INIT;
 
 	struct option options[] = {
 		OPT__QUIET(&quiet, N_("quiet")),
@@ -1960,11 +2569,13 @@ int cmd_receive_pack(int argc, const char **argv, const char *prefix)
 
 	switch (determine_protocol_version_server()) {
 	case protocol_v2:
-		/*
-		 * push support for protocol v2 has not been implemented yet,
-		 * so ignore the request to use v2 and fallback to using v0.
-		 */
-		break;
+		serve_opts.advertise_capabilities = advertise_refs;
+		serve_opts.stateless_rpc = stateless_rpc;
+		serve_opts.push_advertise = push_advertise;
+		serve_opts.push = push_v2;
+		serve(&serve_opts);
+		free((void *)push_cert_nonce);
+		return 0;
 	case protocol_v1:
 		/*
 		 * v1 is just the original protocol with a version string,
@@ -1987,62 +2598,16 @@ int cmd_receive_pack(int argc, const char **argv, const char *prefix)
 		return 0;
 
 	if ((commands = read_head_info(&shallow)) != NULL) {
-		const char *unpack_status = NULL;
 		struct string_list push_options = STRING_LIST_INIT_DUP;
 
 		if (use_push_options)
 			read_push_options(&push_options);
-		if (!check_cert_push_options(&push_options)) {
-			struct command *cmd;
-			for (cmd = commands; cmd; cmd = cmd->next)
-				cmd->error_string = "inconsistent push options";
-		}
-
-		prepare_shallow_info(&si, &shallow);
-		if (!si.nr_ours && !si.nr_theirs)
-			shallow_update = 0;
-		if (!delete_only(commands)) {
-			unpack_status = unpack_with_sideband(&si);
-			update_shallow_info(commands, &si, &ref);
-		}
-		use_keepalive = KEEPALIVE_ALWAYS;
-		execute_commands(commands, unpack_status, &si,
-				 &push_options);
-		if (pack_lockfile)
-			unlink_or_warn(pack_lockfile);
-		if (report_status)
-			report(commands, unpack_status);
-		run_receive_hook(commands, "post-receive", 1,
-				 &push_options);
-		run_update_post_hook(commands);
+		receive_commands(commands, &shallow, &push_options);
 		string_list_clear(&push_options, 0);
-		if (auto_gc) {
-			const char *argv_gc_auto[] = {
-				"gc", "--auto", "--quiet", NULL,
-			};
-			struct child_process proc = CHILD_PROCESS_INIT;
-
-			proc.no_stdin = 1;
-			proc.stdout_to_stderr = 1;
-			proc.err = use_sideband ? -1 : 0;
-			proc.git_cmd = 1;
-			proc.argv = argv_gc_auto;
-
-			close_all_packs(the_repository->objects);
-			if (!start_command(&proc)) {
-				if (use_sideband)
-					copy_to_sideband(proc.err, -1, NULL);
-				finish_command(&proc);
-			}
-		}
-		if (auto_update_server_info)
-			update_server_info(0);
-		clear_shallow_info(&si);
 	}
 	if (use_sideband)
 		packet_flush(1);
 	oid_array_clear(&shallow);
-	oid_array_clear(&ref);
 	free((void *)push_cert_nonce);
 	return 0;
 }
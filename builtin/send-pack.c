@@ -155,6 +155,7 @@ int cmd_send_pack(int argc, const char **argv, const char *prefix)
 	int from_stdin = 0;
 	struct push_cas_option cas = {0};
 	struct packet_reader reader;
+	enum protocol_version version;
 
 	struct option options[] = {
 		OPT__VERBOSITY(&verbose),
@@ -252,9 +253,9 @@ int cmd_send_pack(int argc, const char **argv, const char *prefix)
 			   PACKET_READ_CHOMP_NEWLINE |
 			   PACKET_READ_GENTLE_ON_EOF);
 
-	switch (discover_version(&reader)) {
+	switch (version = discover_version(&reader)) {
 	case protocol_v2:
-		die("support for protocol v2 not implemented yet");
+		get_remote_refs(fd[1], &reader, &remote_refs, 1, NULL, NULL);
 		break;
 	case protocol_v1:
 	case protocol_v0:
@@ -284,7 +285,7 @@ int cmd_send_pack(int argc, const char **argv, const char *prefix)
 	set_ref_status_for_push(remote_refs, args.send_mirror,
 		args.force_update);
 
-	ret = send_pack(&args, fd, conn, remote_refs, &extra_have);
+	ret = send_pack(&args, fd, conn, remote_refs, &extra_have, version);
 
 	if (helper_status)
 		print_helper_status(remote_refs);
@@ -0,0 +1,165 @@
+#include "cache.h"
+#include "config.h"
+#include "bundle.h"
+#include "bundle-uri.h"
+#include "object-store.h"
+#include "packfile.h"
+#include "pkt-line.h"
+#include "refs.h"
+#include "repository.h"
+#include "run-command.h"
+#include "string-list.h"
+#include "url.h"
+
+static void clear_ref_list(struct ref_list *list)
+{
+	int i;
+
+	for (i = 0; i < list->nr; i++)
+		free(list->list[i].name);
+	FREE_AND_NULL(list->list);
+	list->nr = list->alloc = 0;
+}
+
+/*
+ * Make the bundle at "uri" available as a local file, downloading it
+ * to "tmp" if needed.  Returns the path to the file, or NULL.  A server
+ * must not make us read our own files, so the URIs it "advertised"
+ * have to be HTTP ones.
+ */
+static const char *get_bundle(const char *uri, struct strbuf *tmp,
+			      int advertised)
+{
+	struct child_process cmd = CHILD_PROCESS_INIT;
+	const char *path;
+
+	if (advertised &&
+	    !starts_with(uri, "http://") && !starts_with(uri, "https://")) {
+		error(_("bundle uri '%s' advertised by the server is not "
+			"an http(s) URL"), uri);
+		return NULL;
+	}
+	if (skip_prefix(uri, "file://", &path))
+		return path;
+	if (!is_url(uri))
+		return uri;
+	if (!starts_with(uri, "http://") && !starts_with(uri, "https://")) {
+		error(_("unsupported protocol in bundle uri '%s'"), uri);
+		return NULL;
+	}
+
+	strbuf_addstr(tmp, git_path("bundle-uri-%"PRIuMAX,
+				    (uintmax_t)getpid()));
+	argv_array_pushl(&cmd.args, "http-fetch", NULL);
+	argv_array_pushf(&cmd.args, "--output=%s", tmp->buf);
+	argv_array_push(&cmd.args, uri);
+	cmd.git_cmd = 1;
+	if (run_command(&cmd)) {
+		error(_("unable to download bundle uri '%s'"), uri);
+		return NULL;
+	}
+	return tmp->buf;
+}
+
+/* Store the branches of the bundle as refs/bundles/<branch>. */
+static int write_bundle_refs(const struct bundle_header *header,
+			     const char *uri)
+{
+	struct ref_transaction *transaction;
+	struct strbuf refname = STRBUF_INIT;
+	struct strbuf msg = STRBUF_INIT;
+	struct strbuf err = STRBUF_INIT;
+	int i, ret = 0;
+
+	strbuf_addf(&msg, "bundle-uri: %s", uri);
+	transaction = ref_transaction_begin(&err);
+	if (!transaction)
+		ret = error("%s", err.buf);
+	for (i = 0; !ret && i < header->references.nr; i++) {
+		const struct ref_list_entry *e = &header->references.list[i];
+		const char *branch;
+
+		if (!skip_prefix(e->name, "refs/heads/", &branch))
+			continue;
+		strbuf_reset(&refname);
+		strbuf_addf(&refname, "refs/bundles/%s", branch);
+		if (ref_transaction_update(transaction, refname.buf, &e->oid,
+					   NULL, 0, msg.buf, &err))
+			ret = error("%s", err.buf);
+	}
+	if (!ret && ref_transaction_commit(transaction, &err))
+		ret = error("%s", err.buf);
+
+	ref_transaction_free(transaction);
+	strbuf_release(&refname);
+	strbuf_release(&msg);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int fetch_bundle_uri(struct repository *r, const char *uri,
+			    int advertised)
+{
+	struct bundle_header header;
+	struct strbuf tmp = STRBUF_INIT;
+	const char *path;
+	int fd, ret = -1;
+
+	memset(&header, 0, sizeof(header));
+	path = get_bundle(uri, &tmp, advertised);
+	if (!path)
+		goto out;
+
+	fd = read_bundle_header(path, &header);
+	if (fd < 0)
+		goto out;
+	if (unbundle(&header, fd, 0))
+		goto out;
+	reprepare_packed_git(r);
+	ret = write_bundle_refs(&header, uri);
+
+out:
+	if (tmp.len)
+		unlink_or_warn(tmp.buf);
+	strbuf_release(&tmp);
+	clear_ref_list(&header.prerequisites);
+	clear_ref_list(&header.references);
+	return ret;
+}
+
+int fetch_bundle_uris(struct repository *r, const struct string_list *uris,
+		      int advertised)
+{
+	int i, applied = 0;
+
+	for (i = 0; i < uris->nr; i++) {
+		const char *uri = uris->items[i].string;
+
+		if (fetch_bundle_uri(r, uri, advertised))
+			warning(_("skipping bundle uri '%s'"), uri);
+		else
+			applied++;
+	}
+	return applied;
+}
+
+int bundle_uri_advertise(struct repository *r, struct strbuf *value)
+{
+	return !!repo_config_get_value_multi(r, "uploadpack.bundleuri");
+}
+
+int bundle_uri_command(struct repository *r, struct argv_array *keys,
+		       struct packet_reader *request)
+{
+	const struct string_list *uris;
+	int i;
+
+	while (packet_reader_read(request) != PACKET_READ_FLUSH)
+		die("bundle-uri: unexpected argument: '%s'", request->line);
+
+	uris = repo_config_get_value_multi(r, "uploadpack.bundleuri");
+	for (i = 0; uris && i < uris->nr; i++)
+		packet_write_fmt(1, "%s\n", uris->items[i].string);
+	packet_flush(1);
+	return 0;
+}
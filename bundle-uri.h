@@ -0,0 +1,33 @@
+#ifndef BUNDLE_URI_H
+#define BUNDLE_URI_H
+
+struct repository;
+struct strbuf;
+struct string_list;
+struct argv_array;
+struct packet_reader;
+
+/*
+ * Bundle URIs let a clone or fetch start from bundles (see
+ * linkgit:git-bundle[1]) downloaded from a static server, so that only
+ * what they lack has to be negotiated and sent by the remote.  The
+ * branches of each bundle are stored as refs/bundles/<branch>, which
+ * the negotiation that follows then advertises as "have"s.
+ */
+
+/*
+ * Download the bundles at "uris", in order, and unbundle them into "r".
+ * A bundle that cannot be fetched or applied is skipped with a warning.
+ * If the URIs were "advertised" by the server rather than given by the
+ * user, only http:// and https:// ones are used.  Returns the number of
+ * bundles that were applied.
+ */
+int fetch_bundle_uris(struct repository *r, const struct string_list *uris,
+		      int advertised);
+
+/* The server side of the protocol v2 "bundle-uri" command. */
+int bundle_uri_advertise(struct repository *r, struct strbuf *value);
+int bundle_uri_command(struct repository *r, struct argv_array *keys,
+		       struct packet_reader *request);
+
+#endif
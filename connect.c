@@ -450,6 +450,32 @@ struct ref **get_remote_refs(int fd_out, struct packet_reader *reader,
 	return list;
 }
 
+void get_remote_bundle_uris(int fd_out, struct packet_reader *reader,
+			    struct string_list *uris,
+			    const struct string_list *server_options)
+{
+	int i;
+
+	packet_write_fmt(fd_out, "command=bundle-uri\n");
+
+	if (server_supports_v2("agent", 0))
+		packet_write_fmt(fd_out, "agent=%s", git_user_agent_sanitized());
+
+	if (server_options && server_options->nr &&
+	    server_supports_v2("server-option", 1))
+		for (i = 0; i < server_options->nr; i++)
+			packet_write_fmt(fd_out, "server-option=%s",
+					 server_options->items[i].string);
+
+	packet_flush(fd_out);
+
+	while (packet_reader_read(reader) == PACKET_READ_NORMAL)
+		string_list_append(uris, reader->line);
+
+	if (reader->status != PACKET_READ_FLUSH)
+		die(_("expected flush after bundle-uri listing"));
+}
+
 static const char *parse_feature_value(const char *feature_list, const char *feature, int *lenp)
 {
 	int len;
@@ -1229,14 +1255,6 @@ struct child_process *git_connect(int fd[2], const char *url,
 	enum protocol protocol;
 	enum protocol_version version = get_protocol_version_config();
 
-	/*
-	 * NEEDSWORK: If we are trying to use protocol v2 and we are planning
-	 * to perform a push, then fallback to v0 since the client doesn't know
-	 * how to push yet using v2.
-	 */
-	if (version == protocol_v2 && !strcmp("git-receive-pack", prog))
-		version = protocol_v0;
-
 	/* Without this we cannot rely on waitpid() to tell
 	 * what happened to our children.
 	 */
@@ -1,6 +1,11 @@
 #include "cache.h"
+#include "config.h"
 #include "diff.h"
 #include "diffcore.h"
+#include "oidmap.h"
+#include "object-store.h"
+#include "csum-file.h"
+#include "lockfile.h"
 
 /*
  * Idea here is very simple.
@@ -121,10 +126,273 @@ static int spanhash_cmp(const void *a_, const void *b_)
 		a->hashval > b->hashval ? 1 : 0;
 }
 
+/*
+ * The signatures computed by hash_chars() depend only on the contents
+ * of the blob, so we remember them by object name.  Rename detection
+ * in rebases and merges asks for the same blobs over and over, and a
+ * cached signature saves reading and hashing them again.
+ *
+ * Only the non-empty entries of the sorted table are kept, which is
+ * all diffcore_count_changes() looks at.  The text/binary decision of
+ * hash_chars() depends on the path (via attributes), but only matters
+ * for CRLF sequences, so blobs that have any are never cached.
+ *
+ * The cache is only used with diff.renameCache set; it is then read
+ * from $GIT_OBJECT_DIRECTORY/info/rename-cache when first needed and
+ * written back there once, when the process exits.
+ */
+struct count_cache_entry {
+	struct oidmap_entry entry;
+	unsigned long size;
+	unsigned int nr;
+	struct spanhash data[FLEX_ARRAY];
+};
+
+#define COUNT_CACHE_SIGNATURE 0x52434e54 /* "RCNT" */
+#define COUNT_CACHE_VERSION 1
+#define COUNT_CACHE_HEADER_SIZE 12
+
+/* Do not let the cache grow without bounds. */
+#define COUNT_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+static struct count_cache {
+	struct oidmap map;
+	size_t bytes;
+	char *filename;
+	unsigned initialized : 1;
+	unsigned enabled : 1;
+	unsigned dirty : 1;
+} count_cache;
+
+/* The hash version in the header is that of the object names we use. */
+static unsigned char count_cache_oid_version(void)
+{
+	return the_hash_algo - hash_algos;
+}
+
+static size_t count_cache_entry_bytes(unsigned int nr)
+{
+	return st_add(sizeof(struct count_cache_entry),
+		      st_mult(sizeof(struct spanhash), nr));
+}
+
+static struct count_cache_entry *count_cache_add(const struct object_id *oid,
+						 unsigned long size,
+						 unsigned int nr)
+{
+	struct count_cache_entry *e;
+	size_t bytes = count_cache_entry_bytes(nr);
+
+	if (count_cache.bytes + bytes > COUNT_CACHE_MAX_BYTES)
+		return NULL;
+	e = xmalloc(bytes);
+	oidcpy(&e->entry.oid, oid);
+	e->size = size;
+	e->nr = nr;
+	count_cache.bytes += bytes;
+	free(oidmap_put(&count_cache.map, e));
+	return e;
+}
+
+static char *get_count_cache_filename(struct repository *r)
+{
+	return xstrfmt("%s/info/rename-cache", r->objects->objectdir);
+}
+
+static int parse_count_cache(const unsigned char *buf, size_t len)
+{
+	const unsigned char *end;
+	unsigned int rawsz = the_hash_algo->rawsz;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	git_hash_ctx ctx;
+	uint32_t i, nr;
+
+	if (len < COUNT_CACHE_HEADER_SIZE + rawsz ||
+	    get_be32(buf) != COUNT_CACHE_SIGNATURE ||
+	    buf[4] != COUNT_CACHE_VERSION ||
+	    buf[5] != count_cache_oid_version())
+		return -1;
+	end = buf + len - rawsz;
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, buf, end - buf);
+	the_hash_algo->final_fn(hash, &ctx);
+	if (hashcmp(hash, end))
+		return -1;
+
+	nr = get_be32(buf + 8);
+	buf += COUNT_CACHE_HEADER_SIZE;
+	for (i = 0; i < nr; i++) {
+		struct count_cache_entry *e;
+		struct object_id oid;
+		uint64_t size;
+		uint32_t j, cnt;
+
+		if (end - buf < rawsz + 12)
+			return -1;
+		hashcpy(oid.hash, buf);
+		buf += rawsz;
+		size = ((uint64_t)get_be32(buf) << 32) | get_be32(buf + 4);
+		cnt = get_be32(buf + 8);
+		buf += 12;
+		if ((end - buf) / 8 < cnt)
+			return -1;
+		e = count_cache_add(&oid, size, cnt);
+		if (!e)
+			break;
+		for (j = 0; j < cnt; j++, buf += 8) {
+			e->data[j].hashval = get_be32(buf);
+			e->data[j].cnt = get_be32(buf + 4);
+		}
+	}
+	return 0;
+}
+
+static void load_count_cache(void)
+{
+	const char *filename = count_cache.filename;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = git_open(filename);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return;
+	}
+	map = xmmap(NULL, xsize_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (parse_count_cache(map, xsize_t(st.st_size))) {
+		warning(_("ignoring corrupt rename cache '%s'"), filename);
+		oidmap_free(&count_cache.map, 1);
+		oidmap_init(&count_cache.map, 0);
+		count_cache.bytes = 0;
+	}
+	munmap(map, xsize_t(st.st_size));
+}
+
+static void write_count_cache(void)
+{
+	struct lock_file lk = LOCK_INIT;
+	struct oidmap_iter iter;
+	struct count_cache_entry *e;
+	struct hashfile *f;
+	uint32_t nr = 0;
+
+	if (!count_cache.dirty)
+		return;
+	count_cache.dirty = 0;
+
+	if (safe_create_leading_directories(count_cache.filename) ||
+	    hold_lock_file_for_update(&lk, count_cache.filename, 0) < 0)
+		return; /* somebody else is writing it; they can have it */
+	f = hashfd(lk.tempfile->fd, lk.tempfile->filename.buf);
+
+	oidmap_iter_init(&count_cache.map, &iter);
+	while (oidmap_iter_next(&iter))
+		nr++;
+
+	hashwrite_be32(f, COUNT_CACHE_SIGNATURE);
+	hashwrite_u8(f, COUNT_CACHE_VERSION);
+	hashwrite_u8(f, count_cache_oid_version());
+	hashwrite_u8(f, 0); /* unused padding bytes */
+	hashwrite_u8(f, 0);
+	hashwrite_be32(f, nr);
+
+	oidmap_iter_init(&count_cache.map, &iter);
+	while ((e = oidmap_iter_next(&iter))) {
+		uint64_t size = e->size;
+		unsigned int i;
+
+		hashwrite(f, e->entry.oid.hash, the_hash_algo->rawsz);
+		hashwrite_be32(f, size >> 32);
+		hashwrite_be32(f, size & 0xffffffff);
+		hashwrite_be32(f, e->nr);
+		for (i = 0; i < e->nr; i++) {
+			hashwrite_be32(f, e->data[i].hashval);
+			hashwrite_be32(f, e->data[i].cnt);
+		}
+	}
+
+	/* it is only a cache, so losing it in a crash does not hurt */
+	finalize_hashfile(f, NULL, CSUM_HASH_IN_STREAM);
+	commit_lock_file(&lk);
+}
+
+static int prepare_count_cache(struct repository *r)
+{
+	int enabled;
+
+	if (count_cache.initialized)
+		return count_cache.enabled;
+	count_cache.initialized = 1;
+	if (repo_config_get_bool(r, "diff.renamecache", &enabled) ||
+	    !enabled || !r->objects->objectdir)
+		return 0;
+
+	count_cache.enabled = 1;
+	oidmap_init(&count_cache.map, 0);
+	count_cache.filename = get_count_cache_filename(r);
+	load_count_cache();
+	/*
+	 * Rename detection may run many times in one command (e.g. for
+	 * every commit of "git log -M"); write the cache only once.
+	 */
+	atexit(write_count_cache);
+	return 1;
+}
+
+static void cache_spanhash(struct repository *r,
+			   struct diff_filespec *one,
+			   struct spanhash_top *hash)
+{
+	struct count_cache_entry *e;
+	unsigned int nr = 0;
+
+	if (!prepare_count_cache(r) ||
+	    oidmap_get(&count_cache.map, &one->oid))
+		return;
+	while (nr < (1u << hash->alloc_log2) && hash->data[nr].cnt)
+		nr++;
+	e = count_cache_add(&one->oid, one->size, nr);
+	if (!e)
+		return;
+	COPY_ARRAY(e->data, hash->data, nr);
+	count_cache.dirty = 1;
+}
+
+int diffcore_count_from_cache(struct repository *r, struct diff_filespec *one)
+{
+	struct count_cache_entry *e;
+	struct spanhash_top *hash;
+
+	if (one->cnt_data)
+		return 1;
+	if (!one->oid_valid || !S_ISREG(one->mode))
+		return 0;
+	if (!prepare_count_cache(r))
+		return 0;
+	e = oidmap_get(&count_cache.map, &one->oid);
+	if (!e)
+		return 0;
+
+	hash = xmalloc(st_add(sizeof(*hash),
+			      st_mult(sizeof(struct spanhash), e->nr + 1)));
+	hash->alloc_log2 = 0;
+	hash->free = 0;
+	COPY_ARRAY(hash->data, e->data, e->nr);
+	hash->data[e->nr].hashval = 0;
+	hash->data[e->nr].cnt = 0;
+	one->cnt_data = hash;
+	one->size = e->size;
+	return 1;
+}
+
 static struct spanhash_top *hash_chars(struct repository *r,
 				       struct diff_filespec *one)
 {
-	int i, n;
+	int i, n, has_crlf = 0;
 	unsigned int accum1, accum2, hashval;
 	struct spanhash_top *hash;
 	unsigned char *buf = one->data;
@@ -146,8 +414,11 @@ static struct spanhash_top *hash_chars(struct repository *r,
 		sz--;
 
 		/* Ignore CR in CRLF sequence if text */
-		if (is_text && c == '\r' && sz && *buf == '\n')
-			continue;
+		if (c == '\r' && sz && *buf == '\n') {
+			has_crlf = 1;
+			if (is_text)
+				continue;
+		}
 
 		accum1 = (accum1 << 7) ^ (accum2 >> 25);
 		accum2 = (accum2 << 7) ^ (old_1 >> 25);
@@ -160,9 +431,17 @@ static struct spanhash_top *hash_chars(struct repository *r,
 		accum1 = accum2 = 0;
 	}
 	QSORT(hash->data, 1ul << hash->alloc_log2, spanhash_cmp);
+	if (one->oid_valid && !has_crlf)
+		cache_spanhash(r, one, hash);
 	return hash;
 }
 
+void diffcore_populate_count(struct repository *r, struct diff_filespec *one)
+{
+	if (!one->cnt_data)
+		one->cnt_data = hash_chars(r, one);
+}
+
 int diffcore_count_changes(struct repository *r,
 			   struct diff_filespec *src,
 			   struct diff_filespec *dst,
@@ -7,6 +7,8 @@
 #include "object-store.h"
 #include "hashmap.h"
 #include "progress.h"
+#include "config.h"
+#include "thread-utils.h"
 
 /* Table of rename/copy destinations */
 
@@ -156,6 +158,9 @@ static int estimate_similarity(struct repository *r,
 	if (!S_ISREG(src->mode) || !S_ISREG(dst->mode))
 		return 0;
 
+	diffcore_count_from_cache(r, src);
+	diffcore_count_from_cache(r, dst);
+
 	/*
 	 * Need to check that source and destination sizes are
 	 * filled in before comparing them.
@@ -364,6 +369,113 @@ static int find_exact_renames(struct diff_options *options)
 	return renames;
 }
 
+/*
+ * Drop the sources that have been renamed away already; they cannot be
+ * used again unless we are detecting copies.
+ */
+static void remove_used_rename_src(void)
+{
+	int i, nr = 0;
+
+	for (i = 0; i < rename_src_nr; i++) {
+		if (rename_src[i].p->one->rename_used)
+			continue;
+		rename_src[nr++] = rename_src[i];
+	}
+	rename_src_nr = nr;
+}
+
+struct basename_entry {
+	struct hashmap_entry entry;
+	const char *name;
+	int src; /* index in rename_src, -1 if none, -2 if not unique */
+	int dst; /* index in rename_dst, likewise */
+};
+
+static int basename_entry_cmp(const void *unused_cmp_data,
+			      const void *entry, const void *entry_or_key,
+			      const void *keydata)
+{
+	const struct basename_entry *a = entry, *b = entry_or_key;
+
+	return strcmp(a->name, keydata ? keydata : b->name);
+}
+
+static const char *path_basename(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+static void add_basename(struct hashmap *map, const char *path,
+			 int index, int is_src)
+{
+	const char *name = path_basename(path);
+	unsigned int hash = strhash(name);
+	struct basename_entry *e = hashmap_get_from_hash(map, hash, name);
+	int *slot;
+
+	if (!e) {
+		e = xmalloc(sizeof(*e));
+		hashmap_entry_init(e, hash);
+		e->name = name;
+		e->src = e->dst = -1;
+		hashmap_add(map, e);
+	}
+	slot = is_src ? &e->src : &e->dst;
+	*slot = (*slot == -1) ? index : -2;
+}
+
+/*
+ * A file that got moved to another directory usually keeps its
+ * name.  Before trying every source against every destination, pair
+ * up the sources and destinations whose basename is unique on both
+ * sides, if their contents are similar enough.  The bar is set higher
+ * than minimum_score, as we are not comparing against all other
+ * candidates.  Returns the number of renames found.
+ */
+static int find_basename_matches(struct diff_options *options,
+				 int minimum_score)
+{
+	int i, renames = 0;
+	int min_basename_score = minimum_score +
+		(int)(MAX_SCORE - minimum_score) / 2;
+	struct hashmap basenames;
+	struct hashmap_iter iter;
+	struct basename_entry *e;
+
+	hashmap_init(&basenames, basename_entry_cmp, NULL, rename_src_nr);
+	for (i = 0; i < rename_src_nr; i++)
+		add_basename(&basenames, rename_src[i].p->one->path, i, 1);
+	for (i = 0; i < rename_dst_nr; i++) {
+		if (rename_dst[i].pair)
+			continue; /* dealt with exact match already. */
+		add_basename(&basenames, rename_dst[i].two->path, i, 0);
+	}
+
+	hashmap_iter_init(&basenames, &iter);
+	while ((e = hashmap_iter_next(&iter))) {
+		struct diff_filespec *one, *two;
+		int score;
+
+		if (e->src < 0 || e->dst < 0)
+			continue;
+		one = rename_src[e->src].p->one;
+		two = rename_dst[e->dst].two;
+		score = estimate_similarity(options->repo, one, two,
+					    min_basename_score);
+		diff_free_filespec_blob(one);
+		diff_free_filespec_blob(two);
+		if (score < min_basename_score)
+			continue;
+		record_rename_pair(e->dst, e->src, score);
+		renames++;
+	}
+
+	hashmap_free(&basenames, 1);
+	return renames;
+}
+
 #define NUM_CANDIDATE_PER_DST 4
 static void record_if_better(struct diff_score m[], struct diff_score *o)
 {
@@ -428,6 +540,206 @@ static int too_many_rename_candidates(int num_create,
 	return 1;
 }
 
+/*
+ * Fill in the NUM_CANDIDATE_PER_DST best sources for a destination.
+ * If "prepared" is set, the count data of all candidates have been
+ * computed upfront by prepare_rename_counts(); we then only look at
+ * them, which makes this safe to call from multiple threads.
+ */
+static void score_rename_dst(struct diff_options *options, int dst_index,
+			     struct diff_score *m, int minimum_score,
+			     int skip_unmodified, int prepared)
+{
+	struct diff_filespec *two = rename_dst[dst_index].two;
+	int j;
+
+	for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+		m[j].dst = -1;
+
+	for (j = 0; j < rename_src_nr; j++) {
+		struct diff_filespec *one = rename_src[j].p->one;
+		struct diff_score this_src;
+
+		if (skip_unmodified &&
+		    diff_unmodified_pair(rename_src[j].p))
+			continue;
+
+		if (prepared && (!one->cnt_data || !two->cnt_data))
+			this_src.score = 0;
+		else
+			this_src.score = estimate_similarity(options->repo,
+							     one, two,
+							     minimum_score);
+		this_src.name_score = basename_same(one, two);
+		this_src.dst = dst_index;
+		this_src.src = j;
+		record_if_better(m, &this_src);
+		if (prepared)
+			continue;
+		/*
+		 * Once we run estimate_similarity,
+		 * We do not need the text anymore.
+		 */
+		diff_free_filespec_blob(one);
+		diff_free_filespec_blob(two);
+	}
+}
+
+static void prepare_rename_count(struct repository *r,
+				 struct diff_filespec *one)
+{
+	if (!S_ISREG(one->mode) || diffcore_count_from_cache(r, one))
+		return;
+	if (!diff_populate_filespec(r, one, 0))
+		diffcore_populate_count(r, one);
+	diff_free_filespec_blob(one);
+}
+
+/*
+ * Compute the count data of every candidate, so that the scoring
+ * itself does not need to read any objects or files.
+ */
+static void prepare_rename_counts(struct repository *r,
+				  const int *dsts, int dst_cnt,
+				  int skip_unmodified)
+{
+	int i;
+
+	for (i = 0; i < rename_src_nr; i++) {
+		if (skip_unmodified &&
+		    diff_unmodified_pair(rename_src[i].p))
+			continue;
+		prepare_rename_count(r, rename_src[i].p->one);
+	}
+	for (i = 0; i < dst_cnt; i++)
+		prepare_rename_count(r, rename_dst[dsts[i]].two);
+}
+
+#ifdef NO_PTHREADS
+static int score_renames_threaded(struct diff_options *options,
+				  const int *dsts, int dst_cnt,
+				  struct diff_score *mx, int minimum_score,
+				  int skip_unmodified, struct progress *progress)
+{
+	return 0;
+}
+#else
+
+/*
+ * Mostly randomly chosen: we cap the parallelism to 32 threads, and
+ * want to have at least 20000 pairs to score per thread for it to be
+ * worth starting one.
+ */
+#define MAX_RENAME_THREADS (32)
+#define RENAME_THREAD_COST (20000)
+
+struct rename_progress {
+	uint64_t n;
+	struct progress *progress;
+	pthread_mutex_t mutex;
+};
+
+struct rename_thread_data {
+	pthread_t pthread;
+	struct diff_options *options;
+	const int *dsts;
+	int nr;
+	struct diff_score *mx;
+	int minimum_score;
+	int skip_unmodified;
+	struct rename_progress *progress;
+};
+
+static void *score_renames_thread(void *_data)
+{
+	struct rename_thread_data *p = _data;
+	int i;
+
+	for (i = 0; i < p->nr; i++) {
+		score_rename_dst(p->options, p->dsts[i],
+				 &p->mx[i * NUM_CANDIDATE_PER_DST],
+				 p->minimum_score, p->skip_unmodified, 1);
+		if (p->progress) {
+			struct rename_progress *pd = p->progress;
+
+			pthread_mutex_lock(&pd->mutex);
+			pd->n += rename_src_nr;
+			display_progress(pd->progress, pd->n);
+			pthread_mutex_unlock(&pd->mutex);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Score the similarity matrix using several threads, each of which
+ * fills its own rows of "mx".  Returns 0 if the matrix is too small
+ * for this to be worth it, leaving the work to the caller.
+ */
+static int score_renames_threaded(struct diff_options *options,
+				  const int *dsts, int dst_cnt,
+				  struct diff_score *mx, int minimum_score,
+				  int skip_unmodified, struct progress *progress)
+{
+	struct rename_thread_data data[MAX_RENAME_THREADS];
+	struct rename_progress pd;
+	int threads, i, work, offset;
+
+	threads = (uint64_t)dst_cnt * rename_src_nr / RENAME_THREAD_COST;
+	if (threads > online_cpus())
+		threads = online_cpus();
+	if (dst_cnt > 1 && threads < 2 &&
+	    git_env_bool("GIT_TEST_RENAME_THREADS", 0))
+		threads = 2;
+	if (threads < 2)
+		return 0;
+	if (threads > MAX_RENAME_THREADS)
+		threads = MAX_RENAME_THREADS;
+	if (threads > dst_cnt)
+		threads = dst_cnt;
+
+	prepare_rename_counts(options->repo, dsts, dst_cnt, skip_unmodified);
+
+	memset(&pd, 0, sizeof(pd));
+	if (progress) {
+		pd.progress = progress;
+		pthread_mutex_init(&pd.mutex, NULL);
+	}
+
+	offset = 0;
+	work = DIV_ROUND_UP(dst_cnt, threads);
+	memset(&data, 0, sizeof(data));
+	for (i = 0; i < threads; i++) {
+		struct rename_thread_data *p = data + i;
+		int err;
+
+		p->options = options;
+		p->dsts = dsts + offset;
+		p->nr = offset + work > dst_cnt ? dst_cnt - offset : work;
+		p->mx = mx + (size_t)offset * NUM_CANDIDATE_PER_DST;
+		p->minimum_score = minimum_score;
+		p->skip_unmodified = skip_unmodified;
+		if (progress)
+			p->progress = &pd;
+		offset += p->nr;
+
+		err = pthread_create(&p->pthread, NULL,
+				     score_renames_thread, p);
+		if (err)
+			die(_("unable to create threaded rename detection: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < threads; i++) {
+		if (pthread_join(data[i].pthread, NULL))
+			die("unable to join threaded rename detection");
+	}
+
+	if (progress)
+		pthread_mutex_destroy(&pd.mutex);
+	return 1;
+}
+#endif
+
 static int find_renames(struct diff_score *mx, int dst_cnt, int minimum_score, int copies)
 {
 	int count = 0, i;
@@ -456,7 +768,8 @@ void diffcore_rename(struct diff_options *options)
 	struct diff_queue_struct *q = &diff_queued_diff;
 	struct diff_queue_struct outq;
 	struct diff_score *mx;
-	int i, j, rename_count, skip_unmodified = 0;
+	int *dsts;
+	int i, rename_count, skip_unmodified = 0, have_broken = 0;
 	int num_create, dst_cnt;
 	struct progress *progress = NULL;
 
@@ -465,6 +778,8 @@ void diffcore_rename(struct diff_options *options)
 
 	for (i = 0; i < q->nr; i++) {
 		struct diff_filepair *p = q->queue[i];
+		if (p->broken_pair)
+			have_broken = 1;
 		if (!DIFF_FILE_VALID(p->one)) {
 			if (!DIFF_FILE_VALID(p->two))
 				continue; /* unmerged */
@@ -518,6 +833,18 @@ void diffcore_rename(struct diff_options *options)
 	if (minimum_score == MAX_SCORE)
 		goto cleanup;
 
+	/*
+	 * When looking for renames only, the sources used by exact
+	 * renames are out of the game, and we can cheaply pair up many
+	 * of the remaining files by their basename.  Broken pairs want
+	 * to see all the candidates, though.
+	 */
+	if (detect_rename != DIFF_DETECT_COPY && !have_broken) {
+		remove_used_rename_src();
+		rename_count += find_basename_matches(options, minimum_score);
+		remove_used_rename_src();
+	}
+
 	/*
 	 * Calculate how many renames are left (but all the source
 	 * files still remain as options for rename/copies!)
@@ -542,46 +869,27 @@ void diffcore_rename(struct diff_options *options)
 	if (options->show_rename_progress) {
 		progress = start_delayed_progress(
 				_("Performing inexact rename detection"),
-				(uint64_t)rename_dst_nr * (uint64_t)rename_src_nr);
+				(uint64_t)num_create * (uint64_t)rename_src_nr);
 	}
 
-	mx = xcalloc(st_mult(NUM_CANDIDATE_PER_DST, num_create), sizeof(*mx));
+	ALLOC_ARRAY(dsts, num_create);
 	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
-		struct diff_filespec *two = rename_dst[i].two;
-		struct diff_score *m;
-
 		if (rename_dst[i].pair)
 			continue; /* dealt with exact match already. */
+		dsts[dst_cnt++] = i;
+	}
 
-		m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
-		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
-			m[j].dst = -1;
-
-		for (j = 0; j < rename_src_nr; j++) {
-			struct diff_filespec *one = rename_src[j].p->one;
-			struct diff_score this_src;
-
-			if (skip_unmodified &&
-			    diff_unmodified_pair(rename_src[j].p))
-				continue;
-
-			this_src.score = estimate_similarity(options->repo,
-							     one, two,
-							     minimum_score);
-			this_src.name_score = basename_same(one, two);
-			this_src.dst = i;
-			this_src.src = j;
-			record_if_better(m, &this_src);
-			/*
-			 * Once we run estimate_similarity,
-			 * We do not need the text anymore.
-			 */
-			diff_free_filespec_blob(one);
-			diff_free_filespec_blob(two);
+	mx = xcalloc(st_mult(NUM_CANDIDATE_PER_DST, num_create), sizeof(*mx));
+	if (!score_renames_threaded(options, dsts, dst_cnt, mx, minimum_score,
+				    skip_unmodified, progress)) {
+		for (i = 0; i < dst_cnt; i++) {
+			score_rename_dst(options, dsts[i],
+					 &mx[i * NUM_CANDIDATE_PER_DST],
+					 minimum_score, skip_unmodified, 0);
+			display_progress(progress, (uint64_t)(i+1)*(uint64_t)rename_src_nr);
 		}
-		dst_cnt++;
-		display_progress(progress, (uint64_t)(i+1)*(uint64_t)rename_src_nr);
 	}
+	free(dsts);
 	stop_progress(&progress);
 
 	/* cost matrix sorted by most to least similar pair */
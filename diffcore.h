@@ -150,4 +150,20 @@ int diffcore_count_changes(struct repository *r,
 			   unsigned long *src_copied,
 			   unsigned long *literal_added);
 
+/*
+ * Compute the data diffcore_count_changes() needs for "one" (whose
+ * contents must already be populated) and store it in one->cnt_data,
+ * unless it is already there.  Once both sides have it,
+ * diffcore_count_changes() does not look at the contents, nor at
+ * anything outside of the two filespecs.
+ */
+void diffcore_populate_count(struct repository *r, struct diff_filespec *one);
+
+/*
+ * Fill one->cnt_data (and one->size) from the signatures computed
+ * earlier for the same blob, without looking at its contents.  Returns
+ * 1 if one->cnt_data is available afterwards, 0 otherwise.
+ */
+int diffcore_count_from_cache(struct repository *r, struct diff_filespec *one);
+
 #endif
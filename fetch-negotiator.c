@@ -1,5 +1,6 @@
 #include "git-compat-util.h"
 #include "fetch-negotiator.h"
+#include "negotiator/bisecting.h"
 #include "negotiator/default.h"
 #include "negotiator/skipping.h"
 
@@ -10,6 +11,9 @@ void fetch_negotiator_init(struct fetch_negotiator *negotiator,
 		if (!strcmp(algorithm, "skipping")) {
 			skipping_negotiator_init(negotiator);
 			return;
+		} else if (!strcmp(algorithm, "bisecting")) {
+			bisecting_negotiator_init(negotiator);
+			return;
 		} else if (!strcmp(algorithm, "default")) {
 			/* Fall through to default initialization */
 		} else {
@@ -46,6 +46,22 @@ struct fetch_negotiator {
 	 */
 	int (*ack)(struct fetch_negotiator *, struct commit *);
 
+	/*
+	 * Optional. Inform the negotiator that the server has answered the
+	 * first "nr" commits returned by next(), that is, that ack() has been
+	 * called for all of those the server has. "ready" is set once the
+	 * server has said that it could send a packfile already.
+	 */
+	void (*answered)(struct fetch_negotiator *, int nr, int ready);
+
+	/*
+	 * Optional. Return non-zero if next() may return more commits once
+	 * the server has answered those it already returned. The caller then
+	 * waits for these answers when next() returns NULL, and goes on after
+	 * the server said that it is ready, if the protocol allows it.
+	 */
+	int (*pending)(struct fetch_negotiator *);
+
 	void (*release)(struct fetch_negotiator *);
 
 	/* internal use */
@@ -28,6 +28,7 @@ static int fetch_unpack_limit = -1;
 static int unpack_limit = 100;
 static int prefer_ofs_delta = 1;
 static int no_done;
+static int wait_for_done;
 static int deepen_since_ok;
 static int deepen_not_ok;
 static int fetch_fsck_objects = -1;
@@ -37,6 +38,7 @@ static int server_supports_filtering;
 static struct lock_file shallow_lock;
 static const char *alternate_shallow_file;
 static char *negotiation_algorithm;
+static char *uri_protocols;
 static struct strbuf fsck_msg_types = STRBUF_INIT;
 
 /* Remember to update object flag allocation in object.h */
@@ -219,6 +221,15 @@ static int next_flush(int stateless_rpc, int count)
 	return count;
 }
 
+/*
+ * Whether the negotiator may have more "have" lines to send once the server
+ * has answered those sent so far.
+ */
+static int negotiator_pending(struct fetch_negotiator *negotiator)
+{
+	return negotiator->pending && negotiator->pending(negotiator);
+}
+
 static void mark_tips(struct fetch_negotiator *negotiator,
 		      const struct oid_array *negotiation_tips)
 {
@@ -242,6 +253,7 @@ static int find_common(struct fetch_negotiator *negotiator,
 {
 	int fetching;
 	int count = 0, flushes = 0, flush_at = INITIAL_FLUSH, retval;
+	int flushed[2] = { 0, 0 };
 	const struct object_id *oid;
 	unsigned in_vain = 0;
 	int got_continue = 0;
@@ -377,24 +389,37 @@ static int find_common(struct fetch_negotiator *negotiator,
 	retval = -1;
 	if (args->no_dependents)
 		goto done;
-	while ((oid = negotiator->next(negotiator))) {
-		packet_buf_write(&req_buf, "have %s\n", oid_to_hex(oid));
-		print_verbose(args, "have %s", oid_to_hex(oid));
-		in_vain++;
-		if (flush_at <= ++count) {
+	while ((oid = negotiator->next(negotiator)) ||
+	       ((flushes || count > flushed[0]) &&
+		negotiator_pending(negotiator))) {
+		if (oid) {
+			packet_buf_write(&req_buf, "have %s\n", oid_to_hex(oid));
+			print_verbose(args, "have %s", oid_to_hex(oid));
+			in_vain++;
+			count++;
+		}
+		/*
+		 * Without "oid", the negotiator waits for the answers to what
+		 * we sent so far: flush what is left and read them all.
+		 */
+		if (flush_at <= count || !oid) {
 			int ack;
 
-			packet_buf_flush(&req_buf);
-			send_request(args, fd[1], &req_buf);
-			strbuf_setlen(&req_buf, state_len);
-			flushes++;
-			flush_at = next_flush(args->stateless_rpc, count);
+			if (count > flushed[0]) {
+				packet_buf_flush(&req_buf);
+				send_request(args, fd[1], &req_buf);
+				strbuf_setlen(&req_buf, state_len);
+				flushes++;
+				flush_at = next_flush(args->stateless_rpc, count);
+				flushed[1] = flushed[0];
+				flushed[0] = count;
+			}
 
 			/*
 			 * We keep one window "ahead" of the other side, and
 			 * will wait for an ACK only on the next one
 			 */
-			if (!args->stateless_rpc && count == INITIAL_FLUSH)
+			if (oid && !args->stateless_rpc && count == INITIAL_FLUSH)
 				continue;
 
 			consume_shallow_list(args, fd[0]);
@@ -419,7 +444,15 @@ static int find_common(struct fetch_negotiator *negotiator,
 
 					if (!commit)
 						die(_("invalid commit %s"), oid_to_hex(result_oid));
-					was_common = negotiator->ack(negotiator, commit);
+					/*
+					 * With multi_ack_detailed, what the
+					 * server has is acked as "common", and
+					 * "ready" may name any "have" line.
+					 */
+					if (ack == ACK_ready && multi_ack == 2)
+						was_common = 0;
+					else
+						was_common = negotiator->ack(negotiator, commit);
 					if (args->stateless_rpc
 					 && ack == ACK_common
 					 && !was_common) {
@@ -448,11 +481,21 @@ static int find_common(struct fetch_negotiator *negotiator,
 				}
 			} while (ack);
 			flushes--;
+			if (negotiator->answered)
+				/* answers come in the order of the flushes */
+				negotiator->answered(negotiator, flushed[flushes],
+						     got_ready);
 			if (got_continue && MAX_IN_VAIN < in_vain) {
 				print_verbose(args, _("giving up"));
 				break; /* give up */
 			}
-			if (got_ready)
+			/*
+			 * With multi_ack_detailed, we may go on sending
+			 * "have" lines after "ready" to get a smaller pack.
+			 */
+			if (got_ready &&
+			    (multi_ack != 2 || no_done ||
+			     !negotiator_pending(negotiator)))
 				break;
 		}
 	}
@@ -1091,7 +1134,7 @@ static void add_common(struct strbuf *req_buf, struct oidset *common)
 
 static int add_haves(struct fetch_negotiator *negotiator,
 		     struct strbuf *req_buf,
-		     int *haves_to_send, int *in_vain)
+		     int *haves_to_send, int *in_vain, int *haves_sent)
 {
 	int ret = 0;
 	int haves_added = 0;
@@ -1104,6 +1147,7 @@ static int add_haves(struct fetch_negotiator *negotiator,
 	}
 
 	*in_vain += haves_added;
+	*haves_sent += haves_added;
 	if (!haves_added || *in_vain >= MAX_IN_VAIN) {
 		/* Send Done */
 		packet_buf_write(req_buf, "done\n");
@@ -1119,7 +1163,8 @@ static int add_haves(struct fetch_negotiator *negotiator,
 static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
 			      const struct fetch_pack_args *args,
 			      const struct ref *wants, struct oidset *common,
-			      int *haves_to_send, int *in_vain)
+			      int *haves_to_send, int *in_vain,
+			      int *haves_sent)
 {
 	int ret = 0;
 	struct strbuf req_buf = STRBUF_INIT;
@@ -1162,6 +1207,12 @@ static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
 		warning("filtering not recognized by server, ignoring");
 	}
 
+	if (server_supports_feature("fetch", "packfile-uris", 0) &&
+	    uri_protocols) {
+		print_verbose(args, _("Server supports packfile-uris"));
+		packet_buf_write(&req_buf, "packfile-uris %s", uri_protocols);
+	}
+
 	/* add wants */
 	add_wants(args->no_dependents, wants, &req_buf);
 
@@ -1173,7 +1224,18 @@ static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
 		add_common(&req_buf, common);
 
 		/* Add initial haves */
-		ret = add_haves(negotiator, &req_buf, haves_to_send, in_vain);
+		ret = add_haves(negotiator, &req_buf, haves_to_send, in_vain,
+				haves_sent);
+
+		/*
+		 * Keep the server from sending the packfile as soon as it is
+		 * ready if the negotiator may still make it smaller.
+		 */
+		wait_for_done = !ret &&
+			server_supports_feature("fetch", "wait-for-done", 0) &&
+			negotiator_pending(negotiator);
+		if (wait_for_done)
+			packet_buf_write(&req_buf, "wait-for-done");
 	}
 
 	/* Send request */
@@ -1316,6 +1378,90 @@ static void receive_wanted_refs(struct packet_reader *reader,
 		die(_("error processing wanted refs: %d"), reader->status);
 }
 
+static void receive_packfile_uris(struct packet_reader *reader,
+				  struct string_list *uris)
+{
+	process_section_header(reader, "packfile-uris", 0);
+	while (packet_reader_read(reader) == PACKET_READ_NORMAL) {
+		struct object_id hash;
+		const char *end;
+
+		if (parse_oid_hex(reader->line, &hash, &end) || *end++ != ' ')
+			die(_("expected '<pack-hash> <uri>', got '%s'"),
+			    reader->line);
+		string_list_append(uris, reader->line);
+	}
+
+	if (reader->status != PACKET_READ_DELIM)
+		die(_("error processing packfile uris: %d"), reader->status);
+}
+
+/*
+ * Download the pack "<pack-hash> <uri>" the server told us about, and
+ * make sure it is the pack it promised.
+ */
+static void fetch_packfile_uri(struct fetch_pack_args *args,
+			       const char *packfile_uri)
+{
+	struct child_process cmd = CHILD_PROCESS_INIT;
+	struct argv_array index_pack_args = ARGV_ARRAY_INIT;
+	const char *uri = packfile_uri + the_hash_algo->hexsz + 1;
+	const char *path, *name;
+	struct strbuf out = STRBUF_INIT;
+	int i;
+
+	if (!args->quiet && !args->no_progress)
+		argv_array_push(&index_pack_args, "-v");
+	/*
+	 * Only check the objects themselves: the pack may refer to objects
+	 * we already have or are yet to receive, and whether they are all
+	 * there is checked once the fetch is complete.
+	 */
+	if (fetch_fsck_objects >= 0
+	    ? fetch_fsck_objects
+	    : transfer_fsck_objects >= 0
+	    ? transfer_fsck_objects
+	    : 0)
+		argv_array_push(&index_pack_args, "--fsck-objects");
+	if (args->from_promisor)
+		argv_array_push(&index_pack_args, "--promisor");
+
+	if (skip_prefix(uri, "file://", &path)) {
+		cmd.in = open(path, O_RDONLY);
+		if (cmd.in < 0)
+			die_errno(_("unable to open packfile uri '%s'"), uri);
+		argv_array_pushl(&cmd.args, "index-pack", "--stdin", NULL);
+		argv_array_pushv(&cmd.args, index_pack_args.argv);
+	} else {
+		argv_array_push(&cmd.args, "http-fetch");
+		argv_array_pushf(&cmd.args, "--packfile=%.*s",
+				 (int)the_hash_algo->hexsz, packfile_uri);
+		for (i = 0; i < index_pack_args.argc; i++)
+			argv_array_pushf(&cmd.args, "--index-pack-arg=%s",
+					 index_pack_args.argv[i]);
+		argv_array_push(&cmd.args, uri);
+	}
+	cmd.git_cmd = 1;
+	cmd.out = -1;
+	if (start_command(&cmd))
+		die(_("fetch-pack: unable to fork off %s"), cmd.args.argv[0]);
+	if (strbuf_read(&out, cmd.out, 0) < 0)
+		die_errno(_("unable to read output of %s"), cmd.args.argv[0]);
+	close(cmd.out);
+	if (finish_command(&cmd))
+		die(_("unable to fetch packfile uri '%s'"), uri);
+
+	strbuf_rtrim(&out);
+	if (!skip_prefix(out.buf, "pack\t", &name) ||
+	    strncmp(name, packfile_uri, the_hash_algo->hexsz) ||
+	    name[the_hash_algo->hexsz])
+		die(_("packfile uri '%s' did not give the expected pack %.*s"),
+		    uri, (int)the_hash_algo->hexsz, packfile_uri);
+
+	strbuf_release(&out);
+	argv_array_clear(&index_pack_args);
+}
+
 enum fetch_state {
 	FETCH_CHECK_LOCAL = 0,
 	FETCH_SEND_REQUEST,
@@ -1336,6 +1482,8 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 	struct packet_reader reader;
 	int in_vain = 0;
 	int haves_to_send = INITIAL_FLUSH;
+	int haves_sent = 0;
+	int received_ready = 0;
 	struct fetch_negotiator negotiator;
 	fetch_negotiator_init(&negotiator, negotiation_algorithm);
 	packet_reader_init(&reader, fd[0], NULL, 0,
@@ -1373,7 +1521,8 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 		case FETCH_SEND_REQUEST:
 			if (send_fetch_request(&negotiator, fd[1], args, ref,
 					       &common,
-					       &haves_to_send, &in_vain))
+					       &haves_to_send, &in_vain,
+					       &haves_sent))
 				state = FETCH_GET_PACK;
 			else
 				state = FETCH_PROCESS_ACKS;
@@ -1382,8 +1531,12 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 			/* Process ACKs/NAKs */
 			switch (process_acks(&negotiator, &reader, &common)) {
 			case 2:
-				state = FETCH_GET_PACK;
-				break;
+				received_ready = 1;
+				if (!wait_for_done) {
+					state = FETCH_GET_PACK;
+					break;
+				}
+				/* fallthrough */
 			case 1:
 				in_vain = 0;
 				/* fallthrough */
@@ -1391,6 +1544,9 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 				state = FETCH_SEND_REQUEST;
 				break;
 			}
+			if (negotiator.answered)
+				negotiator.answered(&negotiator, haves_sent,
+						    received_ready);
 			break;
 		case FETCH_GET_PACK:
 			/* Check for shallow-info section */
@@ -1400,6 +1556,22 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 			if (process_section_header(&reader, "wanted-refs", 1))
 				receive_wanted_refs(&reader, sought, nr_sought);
 
+			/*
+			 * Download the packs the server sent us to first, as
+			 * the objects in the pack that follows may refer to
+			 * what they contain.
+			 */
+			if (process_section_header(&reader, "packfile-uris", 1)) {
+				struct string_list uris = STRING_LIST_INIT_DUP;
+				int i;
+
+				receive_packfile_uris(&reader, &uris);
+				for (i = 0; i < uris.nr; i++)
+					fetch_packfile_uri(args,
+							   uris.items[i].string);
+				string_list_clear(&uris, 0);
+			}
+
 			/* get the pack */
 			process_section_header(&reader, "packfile", 0);
 			if (get_pack(args, fd, pack_lockfile))
@@ -1451,6 +1623,7 @@ static void fetch_pack_config(void)
 	git_config_get_bool("transfer.fsckobjects", &transfer_fsck_objects);
 	git_config_get_string("fetch.negotiationalgorithm",
 			      &negotiation_algorithm);
+	git_config_get_string("fetch.uriprotocols", &uri_protocols);
 
 	git_config(fetch_pack_config_cb, NULL);
 }
@@ -0,0 +1,742 @@
+#include "cache.h"
+#include "config.h"
+#include "commit.h"
+#include "grep.h"
+#include "grep-index.h"
+#include "lockfile.h"
+#include "csum-file.h"
+#include "object-store.h"
+#include "oidmap.h"
+#include "repository.h"
+#include "sha1-lookup.h"
+
+#define GREP_INDEX_SIGNATURE 0x54474958 /* "TGIX" */
+#define GREP_INDEX_VERSION 1
+
+#define GREP_INDEX_HEADER_SIZE 12
+#define GREP_INDEX_FANOUT_SIZE (256 * 4)
+#define GREP_INDEX_ENTRY_SIZE 8
+
+/*
+ * Each filter has 2^log2 bits, between 2^6 (a single word) and 2^20,
+ * and every trigram sets GREP_INDEX_HASHES of them.
+ */
+#define GREP_INDEX_MIN_LOG2 6
+#define GREP_INDEX_MAX_LOG2 20
+#define GREP_INDEX_HASHES 4
+
+/* Stop adding entries once this many bytes of new filters are kept. */
+#define GREP_INDEX_MAX_NEW (128 * 1024 * 1024)
+
+/*
+ * The file consists of a 12-byte header (signature, version, hash
+ * version, two bytes of padding and the number of entries), a fanout
+ * table of 256 4-byte network byte order integers, the sorted object
+ * names, then for each of them the offset (in 64-bit words from the
+ * start of the filter data) and log2 of the size in bits of its filter,
+ * both as 4-byte network byte order integers, followed by the filter
+ * data itself and the checksum of everything before it.
+ */
+struct grep_index_file {
+	const unsigned char *data;
+	size_t data_len;
+	uint32_t nr;
+	const unsigned char *fanout;
+	const unsigned char *oids;
+	const unsigned char *entries;
+	const unsigned char *filters;
+	size_t filters_words;
+};
+
+struct grep_index_entry {
+	struct oidmap_entry entry;
+	unsigned int log2;
+	uint64_t words[FLEX_ARRAY];
+};
+
+struct grep_index_alternative {
+	uint64_t *hashes;
+	size_t nr, alloc;
+};
+
+struct grep_index_query {
+	struct grep_index_alternative *alt;
+	size_t nr, alloc;
+};
+
+static int grep_index_config = -1;
+static struct grep_index_file *grep_index_file;
+static struct oidmap grep_index_new;
+static size_t grep_index_new_size;
+
+static char *get_grep_index_filename(struct repository *r)
+{
+	return xstrfmt("%s/info/grep-index", r->objects->objectdir);
+}
+
+/* The hash version in the header is that of the object names we use. */
+static unsigned char oid_version(void)
+{
+	return the_hash_algo - hash_algos;
+}
+
+/*
+ * The fanout table has to be non-decreasing and end at "nr", or the
+ * binary search in it could go out of bounds.
+ */
+static int verify_fanout(const unsigned char *fanout, uint32_t nr)
+{
+	uint32_t prev = 0;
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		uint32_t cur = get_be32(fanout + i * 4);
+
+		if (cur < prev)
+			return -1;
+		prev = cur;
+	}
+	return prev == nr ? 0 : -1;
+}
+
+static int verify_checksum(const unsigned char *data, size_t len)
+{
+	git_hash_ctx ctx;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	size_t rawsz = the_hash_algo->rawsz;
+
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, data, len - rawsz);
+	the_hash_algo->final_fn(hash, &ctx);
+	return hasheq(hash, data + len - rawsz) ? 0 : -1;
+}
+
+static struct grep_index_file *load_grep_index(const char *path)
+{
+	struct grep_index_file *index;
+	unsigned char *data;
+	struct stat st;
+	size_t len, rawsz = the_hash_algo->rawsz;
+	uint32_t nr;
+	int fd = git_open(path);
+
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+	len = xsize_t(st.st_size);
+	if (len < GREP_INDEX_HEADER_SIZE + GREP_INDEX_FANOUT_SIZE + rawsz) {
+		close(fd);
+		warning(_("grep index %s is too small"), path);
+		return NULL;
+	}
+	data = xmmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (get_be32(data) != GREP_INDEX_SIGNATURE ||
+	    data[4] != GREP_INDEX_VERSION ||
+	    data[5] != oid_version()) {
+		warning(_("ignoring grep index %s of unknown format"), path);
+		goto cleanup_fail;
+	}
+
+	nr = get_be32(data + 8);
+	if ((len - GREP_INDEX_HEADER_SIZE - GREP_INDEX_FANOUT_SIZE - rawsz) /
+	    (rawsz + GREP_INDEX_ENTRY_SIZE) < nr ||
+	    verify_fanout(data + GREP_INDEX_HEADER_SIZE, nr) ||
+	    verify_checksum(data, len)) {
+		warning(_("grep index %s is corrupt"), path);
+		goto cleanup_fail;
+	}
+
+	index = xcalloc(1, sizeof(*index));
+	index->data = data;
+	index->data_len = len;
+	index->nr = nr;
+	index->fanout = data + GREP_INDEX_HEADER_SIZE;
+	index->oids = index->fanout + GREP_INDEX_FANOUT_SIZE;
+	index->entries = index->oids + (size_t)nr * rawsz;
+	index->filters = index->entries + (size_t)nr * GREP_INDEX_ENTRY_SIZE;
+	index->filters_words = (data + len - rawsz - index->filters) / 8;
+	return index;
+
+cleanup_fail:
+	munmap(data, len);
+	return NULL;
+}
+
+int grep_index_enabled(struct repository *r)
+{
+	if (grep_index_config < 0) {
+		char *path;
+
+		if (repo_config_get_bool(r, "grep.trigramindex",
+					 &grep_index_config))
+			grep_index_config = 0;
+		if (!grep_index_config)
+			return 0;
+
+		path = get_grep_index_filename(r);
+		grep_index_file = load_grep_index(path);
+		free(path);
+		oidmap_init(&grep_index_new, 0);
+	}
+	return grep_index_config;
+}
+
+/*
+ * The filter of the entry at "pos" in the index on disk, or NULL if it
+ * is out of bounds.
+ */
+static const unsigned char *filter_at(uint32_t pos, unsigned int *log2)
+{
+	struct grep_index_file *index = grep_index_file;
+	const unsigned char *entry;
+	uint32_t offset;
+
+	entry = index->entries + (size_t)pos * GREP_INDEX_ENTRY_SIZE;
+	offset = get_be32(entry);
+	*log2 = get_be32(entry + 4);
+	if (*log2 < GREP_INDEX_MIN_LOG2 || *log2 > GREP_INDEX_MAX_LOG2 ||
+	    offset > index->filters_words ||
+	    index->filters_words - offset < (1U << (*log2 - 6)))
+		return NULL;
+	return index->filters + (size_t)offset * 8;
+}
+
+/* Find the filter of "oid" in the index on disk. */
+static const unsigned char *lookup_filter(const struct object_id *oid,
+					  unsigned int *log2)
+{
+	struct grep_index_file *index = grep_index_file;
+	uint32_t pos;
+
+	if (!index ||
+	    !bsearch_hash(oid->hash, (const uint32_t *)index->fanout,
+			  index->oids, the_hash_algo->rawsz, &pos))
+		return NULL;
+	return filter_at(pos, log2);
+}
+
+int grep_index_contains(const struct object_id *oid)
+{
+	unsigned int log2;
+
+	return !!lookup_filter(oid, &log2);
+}
+
+static inline uint64_t trigram_hash(unsigned char a, unsigned char b,
+				    unsigned char c)
+{
+	uint64_t x = ((uint64_t)tolower(a) << 16) |
+		     ((uint64_t)tolower(b) << 8) | tolower(c);
+
+	/* the finalizer of MurmurHash3, so that every bit of "x" counts */
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static inline size_t bloom_bit(uint64_t hash, int i, unsigned int log2)
+{
+	uint32_t h1 = hash >> 32, h2 = (uint32_t)hash | 1;
+
+	return (h1 + i * h2) & ((1U << log2) - 1);
+}
+
+/*
+ * The filter words are stored in network byte order, so that the
+ * index can be shared between machines.
+ */
+static inline int filter_has(const unsigned char *filter, size_t bit)
+{
+	return (get_be64(filter + bit / 64 * 8) >> (bit % 64)) & 1;
+}
+
+static inline unsigned int popcount64(uint64_t x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (x * 0x0101010101010101ULL) >> 56;
+}
+
+struct grep_index_entry *grep_index_entry_new(const struct object_id *oid,
+					      const char *buf,
+					      unsigned long size)
+{
+	struct grep_index_entry *entry;
+	const unsigned char *p = (const unsigned char *)buf;
+	unsigned int log2 = GREP_INDEX_MIN_LOG2;
+	size_t i, nr_words;
+
+	/* start with room for every byte to be a new trigram */
+	while (log2 < GREP_INDEX_MAX_LOG2 &&
+	       size > (1UL << log2) / (GREP_INDEX_HASHES * 2))
+		log2++;
+	nr_words = (size_t)1 << (log2 - 6);
+
+	entry = xcalloc(1, st_add(sizeof(*entry),
+				  st_mult(nr_words, sizeof(uint64_t))));
+	oidcpy(&entry->entry.oid, oid);
+
+	for (i = 2; i < size; i++) {
+		uint64_t hash;
+		int j;
+
+		if (p[i] == '\n' || p[i - 1] == '\n' || p[i - 2] == '\n')
+			continue;
+		hash = trigram_hash(p[i - 2], p[i - 1], p[i]);
+		for (j = 0; j < GREP_INDEX_HASHES; j++) {
+			size_t bit = bloom_bit(hash, j, log2);
+			entry->words[bit / 64] |= (uint64_t)1 << (bit % 64);
+		}
+	}
+
+	/*
+	 * Fold the filter in halves (which keeps every trigram at the
+	 * same bit modulo the new size) as long as at most half of its
+	 * bits would be set.
+	 */
+	while (log2 > GREP_INDEX_MIN_LOG2) {
+		size_t half = nr_words / 2, folded = 0;
+
+		for (i = 0; i < half; i++)
+			folded += popcount64(entry->words[i] |
+					     entry->words[i + half]);
+		if (folded * 2 > half * 64)
+			break;
+		for (i = 0; i < half; i++)
+			entry->words[i] |= entry->words[i + half];
+		nr_words = half;
+		log2--;
+	}
+	entry->log2 = log2;
+
+	for (i = 0; i < nr_words; i++)
+		put_be64(entry->words + i, entry->words[i]);
+	return entry;
+}
+
+void grep_index_add(struct grep_index_entry *entry)
+{
+	size_t size = sizeof(uint64_t) << (entry->log2 - 6);
+
+	if (grep_index_new_size + size > GREP_INDEX_MAX_NEW ||
+	    oidmap_get(&grep_index_new, &entry->entry.oid)) {
+		free(entry);
+		return;
+	}
+	oidmap_put(&grep_index_new, entry);
+	grep_index_new_size += size;
+}
+
+static int entry_cmp(const void *a_, const void *b_)
+{
+	const struct grep_index_entry *a = *(const struct grep_index_entry **)a_;
+	const struct grep_index_entry *b = *(const struct grep_index_entry **)b_;
+
+	return oidcmp(&a->entry.oid, &b->entry.oid);
+}
+
+void grep_index_write(struct repository *r)
+{
+	struct grep_index_file *index = grep_index_file;
+	struct grep_index_entry **new_entries, *e;
+	struct oidmap_iter iter;
+	struct lock_file lk = LOCK_INIT;
+	struct hashfile *f;
+	size_t rawsz = the_hash_algo->rawsz;
+	size_t nr_new = 0, i, j, k, nr_total;
+	uint32_t nr_old = index ? index->nr : 0;
+	uint32_t fanout[256] = { 0 };
+	uint32_t *pos;
+	uint64_t offset, words;
+	char *path;
+
+	if (grep_index_config <= 0 || !hashmap_get_size(&grep_index_new.map))
+		return;
+
+	ALLOC_ARRAY(new_entries, hashmap_get_size(&grep_index_new.map));
+	oidmap_iter_init(&grep_index_new, &iter);
+	while ((e = oidmap_iter_next(&iter)))
+		new_entries[nr_new++] = e;
+	QSORT(new_entries, nr_new, entry_cmp);
+
+	/*
+	 * Merge the old and new entries, recording in "pos" for each
+	 * entry to write either the position of an old entry or ~the
+	 * position of a new one.  An old entry whose filter is out of
+	 * bounds is dropped (or replaced by a new one for the same
+	 * object).
+	 */
+	ALLOC_ARRAY(pos, st_add(nr_old, nr_new));
+	for (i = j = k = 0, words = 0; i < nr_old || j < nr_new; ) {
+		const unsigned char *old = i < nr_old ?
+			index->oids + i * rawsz : NULL;
+		unsigned int log2;
+		int cmp;
+
+		if (!old)
+			cmp = 1;
+		else if (j == nr_new)
+			cmp = -1;
+		else
+			cmp = hashcmp(old, new_entries[j]->entry.oid.hash);
+
+		if (cmp <= 0 && filter_at(i, &log2)) {
+			pos[k++] = i++;
+			if (!cmp)
+				j++;
+		} else if (cmp >= 0) {
+			log2 = new_entries[j]->log2;
+			pos[k++] = ~(uint32_t)j++;
+			if (!cmp)
+				i++;
+		} else {
+			i++;
+			continue;
+		}
+		words += (uint64_t)1 << (log2 - 6);
+	}
+	nr_total = k;
+	if (nr_total > UINT32_MAX / 2 || words > UINT32_MAX) {
+		warning(_("grep index would be too large, not updating it"));
+		goto cleanup;
+	}
+
+	path = get_grep_index_filename(r);
+	if (safe_create_leading_directories(path) ||
+	    hold_lock_file_for_update(&lk, path, 0) < 0) {
+		/* somebody else is updating it, or we cannot; try next time */
+		free(path);
+		goto cleanup;
+	}
+	free(path);
+	f = hashfd(lk.tempfile->fd, lk.tempfile->filename.buf);
+
+	hashwrite_be32(f, GREP_INDEX_SIGNATURE);
+	hashwrite_u8(f, GREP_INDEX_VERSION);
+	hashwrite_u8(f, oid_version());
+	hashwrite_u8(f, 0);
+	hashwrite_u8(f, 0);
+	hashwrite_be32(f, nr_total);
+
+	for (k = 0; k < nr_total; k++) {
+		const unsigned char *hash = pos[k] < nr_old ?
+			index->oids + pos[k] * rawsz :
+			new_entries[~pos[k]]->entry.oid.hash;
+		fanout[hash[0]]++;
+	}
+	for (i = 1; i < 256; i++)
+		fanout[i] += fanout[i - 1];
+	for (i = 0; i < 256; i++)
+		hashwrite_be32(f, fanout[i]);
+
+	for (k = 0; k < nr_total; k++)
+		hashwrite(f, pos[k] < nr_old ?
+			  index->oids + pos[k] * rawsz :
+			  new_entries[~pos[k]]->entry.oid.hash, rawsz);
+
+	for (k = 0, offset = 0; k < nr_total; k++) {
+		unsigned int log2;
+
+		if (pos[k] < nr_old)
+			filter_at(pos[k], &log2);
+		else
+			log2 = new_entries[~pos[k]]->log2;
+		hashwrite_be32(f, offset);
+		hashwrite_be32(f, log2);
+		offset += 1U << (log2 - 6);
+	}
+
+	for (k = 0; k < nr_total; k++) {
+		const void *filter;
+		unsigned int log2;
+
+		if (pos[k] < nr_old) {
+			filter = filter_at(pos[k], &log2);
+		} else {
+			filter = new_entries[~pos[k]]->words;
+			log2 = new_entries[~pos[k]]->log2;
+		}
+		hashwrite(f, filter, sizeof(uint64_t) << (log2 - 6));
+	}
+
+	finalize_hashfile(f, NULL, CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+	commit_lock_file(&lk);
+
+cleanup:
+	free(pos);
+	free(new_entries);
+}
+
+static void add_run(struct grep_index_alternative *alt,
+		    const char *run, size_t len)
+{
+	size_t i;
+
+	for (i = 2; i < len; i++) {
+		if (run[i] == '\n' || run[i - 1] == '\n' || run[i - 2] == '\n')
+			continue;
+		ALLOC_GROW(alt->hashes, alt->nr + 1, alt->alloc);
+		alt->hashes[alt->nr++] = trigram_hash(run[i - 2], run[i - 1],
+						      run[i]);
+	}
+}
+
+/*
+ * Skip over a bracket expression, with "s" just after the opening
+ * bracket. Returns NULL if it is not terminated.
+ */
+static const char *skip_bracket(const char *s, const char *end, int pcre)
+{
+	if (s < end && *s == '^')
+		s++;
+	if (s < end && *s == ']')
+		s++;
+	while (s < end && *s != ']') {
+		if (pcre && *s == '\\' && s + 1 < end) {
+			s += 2;
+		} else if (*s == '[' && s + 1 < end && strchr(":.=", s[1])) {
+			char close = s[1];
+
+			for (s += 2; s + 1 < end; s++)
+				if (s[0] == close && s[1] == ']')
+					break;
+			if (s + 1 >= end)
+				return NULL;
+			s += 2;
+		} else {
+			s++;
+		}
+	}
+	return s < end ? s + 1 : NULL;
+}
+
+/*
+ * Collect the trigrams of the literal strings any match of the regular
+ * expression "p" has to contain.  Returns -1 if we cannot tell (e.g.
+ * because of an alternation).
+ */
+static int extract_regex_trigrams(struct grep_index_alternative *alt,
+				  const struct grep_pat *p,
+				  const struct grep_opt *opt)
+{
+	struct strbuf run = STRBUF_INIT;
+	const char *s = p->pattern, *end = s + p->patternlen;
+	int pcre = opt->pcre1 || opt->pcre2;
+	int ere = pcre || opt->extended_regexp_option;
+	int depth = 0, ret = 0;
+
+	/* options like (?x) or (?i) change what the rest means */
+	if (pcre && memmem(s, p->patternlen, "(?", 2))
+		return -1;
+
+	while (s < end) {
+		enum { LITERAL, QUANTIFIER, REPEAT, OTHER } kind = OTHER;
+		char c = *s++;
+
+		if (c == '\\') {
+			if (s == end) {
+				ret = -1;
+				break;
+			}
+			c = *s++;
+			/*
+			 * Character codes (\x41, \101, \cA, \o{101},
+			 * \N{U+41}), properties, back references and
+			 * \Q...\E quoting are not worth parsing.
+			 */
+			if (pcre && c && (isdigit(c) || strchr("cgkNoPpQx", c))) {
+				ret = -1;
+				break;
+			}
+			if (isalnum(c) ||
+			    (!pcre && strchr("<>`'", c)))
+				; /* a character class or an anchor */
+			else if (!ere && c == '|') {
+				ret = -1;
+				break;
+			} else if (!ere && strchr("?{", c))
+				kind = QUANTIFIER;
+			else if (!ere && c == '(')
+				depth++;
+			else if (!ere && c == ')')
+				depth--;
+			else if (!ere && c == '+')
+				kind = REPEAT;
+			else if (ere || c != '}')
+				kind = LITERAL;
+		} else if (c == '[') {
+			s = skip_bracket(s, end, pcre);
+			if (!s) {
+				ret = -1;
+				break;
+			}
+		} else if (c == '*') {
+			kind = QUANTIFIER;
+		} else if (ere && (c == '?' || c == '{')) {
+			kind = QUANTIFIER;
+		} else if (ere && c == '|') {
+			ret = -1;
+			break;
+		} else if (ere && c == '(') {
+			depth++;
+		} else if (ere && c == ')') {
+			depth--;
+		} else if (ere && c == '+') {
+			kind = REPEAT;
+		} else if (!strchr(".^$", c) && !(ere && c == '}')) {
+			kind = LITERAL;
+		}
+
+		if (kind == QUANTIFIER && c == '{') {
+			/* skip the bounds, up to "}" (or "\}" in a BRE) */
+			const char *close = ere ? memchr(s, '}', end - s) :
+				memmem(s, end - s, "\\}", 2);
+
+			if (!close) {
+				ret = -1;
+				break;
+			}
+			s = close + (ere ? 1 : 2);
+		}
+		if (kind == LITERAL && !depth) {
+			strbuf_addch(&run, c);
+			continue;
+		}
+		/* the repeated atom starts the next run, too */
+		if (kind == REPEAT && run.len &&
+		    !(run.buf[run.len - 1] & 0x80)) {
+			char last = run.buf[run.len - 1];
+
+			add_run(alt, run.buf, run.len);
+			strbuf_reset(&run);
+			strbuf_addch(&run, last);
+			continue;
+		}
+		/*
+		 * The quantified atom need not be there at all; it may be
+		 * a multi-byte character, so drop all of that.
+		 */
+		if (kind == QUANTIFIER && run.len) {
+			if (!(run.buf[run.len - 1] & 0x80))
+				strbuf_setlen(&run, run.len - 1);
+			else
+				while (run.len && (run.buf[run.len - 1] & 0x80))
+					strbuf_setlen(&run, run.len - 1);
+		}
+		add_run(alt, run.buf, run.len);
+		strbuf_reset(&run);
+	}
+	add_run(alt, run.buf, run.len);
+	strbuf_release(&run);
+	return ret;
+}
+
+static int has_regex_special(const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (is_regex_special(s[i]))
+			return 1;
+	return 0;
+}
+
+struct grep_index_query *grep_index_query_new(const struct grep_opt *opt)
+{
+	struct grep_index_query *query;
+	struct grep_pat *p;
+
+	/*
+	 * These ask about the blobs that do not match, or about what
+	 * textconv makes of them, neither of which the index knows.
+	 */
+	if (opt->invert || opt->unmatch_name_only || opt->allow_textconv ||
+	    opt->header_list)
+		return NULL;
+
+	query = xcalloc(1, sizeof(*query));
+	for (p = opt->pattern_list; p; p = p->next) {
+		struct grep_index_alternative *alt;
+		int literal, ret = 0;
+
+		if (p->token != GREP_PATTERN)
+			goto give_up;
+
+		ALLOC_GROW(query->alt, query->nr + 1, query->alloc);
+		alt = &query->alt[query->nr++];
+		memset(alt, 0, sizeof(*alt));
+
+		/*
+		 * A pattern without special characters is looked for
+		 * literally, and with ASCII case folding only (like we do)
+		 * for --ignore-case; a regex may fold case differently.
+		 */
+		literal = opt->fixed || memchr(p->pattern, 0, p->patternlen) ||
+			  !has_regex_special(p->pattern, p->patternlen);
+		if (opt->ignore_case &&
+		    (!literal || has_non_ascii(p->pattern)))
+			goto give_up;
+		if (literal)
+			add_run(alt, p->pattern, p->patternlen);
+		else
+			ret = extract_regex_trigrams(alt, p, opt);
+		if (ret < 0 || !alt->nr)
+			goto give_up;
+	}
+	if (!query->nr)
+		goto give_up;
+	return query;
+
+give_up:
+	grep_index_query_free(query);
+	return NULL;
+}
+
+void grep_index_query_free(struct grep_index_query *query)
+{
+	size_t i;
+
+	if (!query)
+		return;
+	for (i = 0; i < query->nr; i++)
+		free(query->alt[i].hashes);
+	free(query->alt);
+	free(query);
+}
+
+int grep_index_may_match(const struct grep_index_query *query,
+			 const struct object_id *oid)
+{
+	const unsigned char *filter;
+	unsigned int log2;
+	size_t i, j;
+	int k;
+
+	if (!query || !(filter = lookup_filter(oid, &log2)))
+		return 1;
+
+	for (i = 0; i < query->nr; i++) {
+		const struct grep_index_alternative *alt = &query->alt[i];
+
+		for (j = 0; j < alt->nr; j++) {
+			for (k = 0; k < GREP_INDEX_HASHES; k++)
+				if (!filter_has(filter,
+						bloom_bit(alt->hashes[j], k, log2)))
+					break;
+			if (k < GREP_INDEX_HASHES)
+				break;
+		}
+		if (j == alt->nr)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef GREP_INDEX_H
+#define GREP_INDEX_H
+
+struct repository;
+struct grep_opt;
+struct object_id;
+
+/*
+ * An optional index of the trigrams (sequences of three bytes within a
+ * line, ignoring ASCII case) found in blobs, kept by object name in
+ * $GIT_OBJECT_DIRECTORY/info/grep-index when grep.trigramIndex is set.
+ * For each blob it records a small Bloom filter of its trigrams, which
+ * lets "git grep" skip blobs that cannot contain a match without
+ * reading them.  Blobs that grep had to read are added to the index,
+ * so that it grows with use.
+ */
+
+/* Whether grep.trigramIndex is enabled for "r"; loads the index. */
+int grep_index_enabled(struct repository *r);
+
+/*
+ * The trigrams that any line matched by the patterns of "opt" must
+ * contain.  Returns NULL if the patterns cannot be narrowed down that
+ * way (e.g. with --invert-match or alternations in a regex).
+ */
+struct grep_index_query *grep_index_query_new(const struct grep_opt *opt);
+void grep_index_query_free(struct grep_index_query *query);
+
+/*
+ * Returns 0 if the blob "oid" is in the index and cannot match
+ * "query", 1 otherwise.
+ */
+int grep_index_may_match(const struct grep_index_query *query,
+			 const struct object_id *oid);
+
+/*
+ * Returns 1 if the blob "oid" is already in the index as it was read
+ * from disk (blobs added by this process do not count).
+ */
+int grep_index_contains(const struct object_id *oid);
+
+/*
+ * Compute the index entry of the blob "oid" from its contents, and add
+ * it to the index.  Computing an entry can be done in parallel, but
+ * adding it must be serialized by the caller.
+ */
+struct grep_index_entry *grep_index_entry_new(const struct object_id *oid,
+					      const char *buf,
+					      unsigned long size);
+void grep_index_add(struct grep_index_entry *entry);
+
+/* Write the index back to disk if blobs were added. */
+void grep_index_write(struct repository *r);
+
+#endif
@@ -1101,6 +1101,19 @@ static void output_color(struct grep_opt *opt, const void *data, size_t size,
 		opt->output(opt, data, size);
 }
 
+void grep_output_name(struct grep_opt *opt, const char *name)
+{
+	output_color(opt, name, strlen(name), opt->colors[GREP_COLOR_FILENAME]);
+}
+
+static void output_name(struct grep_opt *opt, const char *name)
+{
+	if (opt->output_name)
+		opt->output_name(opt, name);
+	else
+		grep_output_name(opt, name);
+}
+
 static void output_sep(struct grep_opt *opt, char sign)
 {
 	if (opt->null_following_name)
@@ -1111,7 +1124,7 @@ static void output_sep(struct grep_opt *opt, char sign)
 
 static void show_name(struct grep_opt *opt, const char *name)
 {
-	output_color(opt, name, strlen(name), opt->colors[GREP_COLOR_FILENAME]);
+	output_name(opt, name);
 	opt->output(opt, opt->null_following_name ? "\0" : "\n", 1);
 }
 
@@ -1413,13 +1426,13 @@ static void show_line_header(struct grep_opt *opt, const char *name,
 			     unsigned lno, ssize_t cno, char sign)
 {
 	if (opt->heading && opt->last_shown == 0) {
-		output_color(opt, name, strlen(name), opt->colors[GREP_COLOR_FILENAME]);
+		output_name(opt, name);
 		opt->output(opt, "\n", 1);
 	}
 	opt->last_shown = lno;
 
 	if (!opt->heading && opt->pathname) {
-		output_color(opt, name, strlen(name), opt->colors[GREP_COLOR_FILENAME]);
+		output_name(opt, name);
 		output_sep(opt, sign);
 	}
 	if (opt->linenum) {
@@ -1534,11 +1547,6 @@ static inline void grep_attr_unlock(void)
 		pthread_mutex_unlock(&grep_attr_mutex);
 }
 
-/*
- * Same as git_attr_mutex, but protecting the thread-unsafe object db access.
- */
-pthread_mutex_t grep_read_mutex;
-
 #else
 #define grep_attr_lock()
 #define grep_attr_unlock()
@@ -1744,9 +1752,9 @@ static int fill_textconv_grep(struct repository *r,
 	 * behind the scenes, and it modifies the global diff tempfile
 	 * structure.
 	 */
-	grep_read_lock();
+	obj_read_lock();
 	size = fill_textconv(r, driver, df, &buf);
-	grep_read_unlock();
+	obj_read_unlock();
 	free_filespec(df);
 
 	/*
@@ -1903,8 +1911,7 @@ static int grep_source_1(struct grep_opt *opt, struct grep_source *gs, int colle
 				goto next_line;
 			if (binary_match_only) {
 				opt->output(opt, "Binary file ", 12);
-				output_color(opt, gs->name, strlen(gs->name),
-					     opt->colors[GREP_COLOR_FILENAME]);
+				output_name(opt, gs->name);
 				opt->output(opt, " matches\n", 9);
 				return 1;
 			}
@@ -1988,8 +1995,7 @@ static int grep_source_1(struct grep_opt *opt, struct grep_source *gs, int colle
 	if (opt->count && count) {
 		char buf[32];
 		if (opt->pathname) {
-			output_color(opt, gs->name, strlen(gs->name),
-				     opt->colors[GREP_COLOR_FILENAME]);
+			output_name(opt, gs->name);
 			output_sep(opt, ':');
 		}
 		xsnprintf(buf, sizeof(buf), "%u\n", count);
@@ -2111,9 +2117,7 @@ static int grep_source_load_oid(struct grep_source *gs)
 {
 	enum object_type type;
 
-	grep_read_lock();
 	gs->buf = read_object_file(gs->identifier, &type, &gs->size);
-	grep_read_unlock();
 
 	if (!gs->buf)
 		return error(_("'%s': unable to read %s"),
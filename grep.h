@@ -183,6 +183,11 @@ struct grep_opt {
 	void *priv;
 
 	void (*output)(struct grep_opt *opt, const void *data, size_t size);
+	/*
+	 * If set, called instead of grep_output_name() wherever the name
+	 * of a source is shown.
+	 */
+	void (*output_name)(struct grep_opt *opt, const char *name);
 	void *output_priv;
 };
 
@@ -226,6 +231,9 @@ void grep_source_load_driver(struct grep_source *gs,
 
 int grep_source(struct grep_opt *opt, struct grep_source *gs);
 
+/* Show the name of a source, as in the output of grep_source(). */
+void grep_output_name(struct grep_opt *opt, const char *name);
+
 extern struct grep_opt *grep_opt_dup(const struct grep_opt *opt);
 extern int grep_threads_ok(const struct grep_opt *opt);
 
@@ -236,23 +244,6 @@ extern int grep_threads_ok(const struct grep_opt *opt);
  */
 extern int grep_use_locks;
 extern pthread_mutex_t grep_attr_mutex;
-extern pthread_mutex_t grep_read_mutex;
-
-static inline void grep_read_lock(void)
-{
-	if (grep_use_locks)
-		pthread_mutex_lock(&grep_read_mutex);
-}
-
-static inline void grep_read_unlock(void)
-{
-	if (grep_use_locks)
-		pthread_mutex_unlock(&grep_read_mutex);
-}
-
-#else
-#define grep_read_lock()
-#define grep_read_unlock()
 #endif
 
 #endif
@@ -3,9 +3,44 @@
 #include "exec-cmd.h"
 #include "http.h"
 #include "walker.h"
+#include "argv-array.h"
+#include "run-command.h"
 
 static const char http_fetch_usage[] = "git http-fetch "
-"[-c] [-t] [-a] [-v] [--recover] [-w ref] [--stdin] commit-id url";
+"[-c] [-t] [-a] [-v] [--recover] [-w ref] [--stdin] commit-id url\n"
+"   or: git http-fetch --packfile=<hash> [--index-pack-arg=<arg>...] url\n"
+"   or: git http-fetch --output=<file> url";
+
+/*
+ * Download the pack "hash" from "url" into the object directory, and
+ * have index-pack index it (its output, "pack\t<hash>", is ours).
+ */
+static int fetch_packfile(const char *hash, const char *url,
+			  const struct argv_array *index_pack_args)
+{
+	struct child_process cmd = CHILD_PROCESS_INIT;
+	struct strbuf tmp = STRBUF_INIT;
+	int ret;
+
+	strbuf_addf(&tmp, "%s/pack/tmp_uri_pack_%s", get_object_directory(),
+		    hash);
+	if (http_get_file(url, tmp.buf, NULL) != HTTP_OK) {
+		strbuf_release(&tmp);
+		return error("unable to download %s", url);
+	}
+
+	cmd.in = open(tmp.buf, O_RDONLY);
+	if (cmd.in < 0)
+		die_errno("unable to open '%s'", tmp.buf);
+	argv_array_pushl(&cmd.args, "index-pack", "--stdin", NULL);
+	argv_array_pushv(&cmd.args, index_pack_args->argv);
+	cmd.git_cmd = 1;
+	ret = run_command(&cmd);
+
+	unlink_or_warn(tmp.buf);
+	strbuf_release(&tmp);
+	return ret;
+}
 
 int cmd_main(int argc, const char **argv)
 {
@@ -19,6 +54,9 @@ int cmd_main(int argc, const char **argv)
 	int rc = 0;
 	int get_verbosely = 0;
 	int get_recover = 0;
+	const char *packfile = NULL, *output = NULL;
+	struct argv_array index_pack_args = ARGV_ARRAY_INIT;
+	const char *p;
 
 	while (arg < argc && argv[arg][0] == '-') {
 		if (argv[arg][1] == 't') {
@@ -35,9 +73,49 @@ int cmd_main(int argc, const char **argv)
 			get_recover = 1;
 		} else if (!strcmp(argv[arg], "--stdin")) {
 			commits_on_stdin = 1;
+		} else if (skip_prefix(argv[arg], "--packfile=", &p)) {
+			packfile = p;
+		} else if (skip_prefix(argv[arg], "--index-pack-arg=", &p)) {
+			argv_array_push(&index_pack_args, p);
+		} else if (skip_prefix(argv[arg], "--output=", &p)) {
+			output = p;
 		}
 		arg++;
 	}
+	if (output) {
+		if (argc != arg + 1 || commits_on_stdin || packfile)
+			usage(http_fetch_usage);
+		setup_git_directory_gently(NULL);
+		git_config(git_default_config, NULL);
+		http_init(NULL, argv[arg], 0);
+		if (http_get_file(argv[arg], output, NULL) != HTTP_OK) {
+			struct strbuf partial = STRBUF_INIT;
+
+			/* do not leave a partial download behind */
+			strbuf_addf(&partial, "%s.temp", output);
+			unlink(partial.buf);
+			strbuf_release(&partial);
+			rc = error("unable to download %s", argv[arg]);
+		}
+		http_cleanup();
+		return !!rc;
+	}
+	if (packfile) {
+		struct object_id hash;
+
+		if (argc != arg + 1 || commits_on_stdin)
+			usage(http_fetch_usage);
+		setup_git_directory();
+		if (get_oid_hex(packfile, &hash) ||
+		    packfile[the_hash_algo->hexsz])
+			die("not a pack hash: '%s'", packfile);
+		git_config(git_default_config, NULL);
+		http_init(NULL, argv[arg], 0);
+		rc = fetch_packfile(packfile, argv[arg], &index_pack_args);
+		http_cleanup();
+		argv_array_clear(&index_pack_args);
+		return rc;
+	}
 	if (argc != arg + 2 - commits_on_stdin)
 		usage(http_fetch_usage);
 	if (commits_on_stdin) {
@@ -19,7 +19,8 @@ enum object_request_state {
 	WAITING,
 	ABORTED,
 	ACTIVE,
-	COMPLETE
+	COMPLETE,
+	PACKED
 };
 
 struct object_request {
@@ -48,6 +49,13 @@ struct walker_data {
 
 static LIST_HEAD(object_queue_head);
 
+/*
+ * Requests for blobs, which are only started when no request in
+ * object_queue_head is waiting: the objects the others refer to can then
+ * be requested sooner.
+ */
+static LIST_HEAD(blob_queue_head);
+
 static void fetch_alternates(struct walker *walker, const char *base);
 
 static void process_object_response(void *callback_data);
@@ -83,8 +91,10 @@ static void finish_object_request(struct object_request *obj_req)
 	if (finish_http_object_request(obj_req->req))
 		return;
 
-	if (obj_req->req->rename == 0)
+	if (obj_req->req->rename == 0) {
 		walker_say(obj_req->walker, "got %s\n", oid_to_hex(&obj_req->oid));
+		walker_object_arrived(obj_req->walker, &obj_req->oid);
+	}
 }
 
 static void process_object_response(void *callback_data)
@@ -122,17 +132,34 @@ static void release_object_request(struct object_request *obj_req)
 	free(obj_req);
 }
 
+/*
+ * Whether the object is in a pack whose index we already got, in which case
+ * there is no point in asking for it as a loose object.
+ */
+static int in_known_pack(struct walker *walker, const unsigned char *sha1)
+{
+	struct walker_data *data = walker->data;
+	struct alt_base *alt;
+
+	for (alt = data->alt; alt; alt = alt->next)
+		if (alt->got_indices && find_sha1_pack(sha1, alt->packs))
+			return 1;
+	return 0;
+}
+
 #ifdef USE_CURL_MULTI
-static int fill_active_slot(struct walker *walker)
+static int fill_from_queue(struct walker *walker, struct list_head *head)
 {
 	struct object_request *obj_req;
-	struct list_head *pos, *tmp, *head = &object_queue_head;
+	struct list_head *pos, *tmp;
 
 	list_for_each_safe(pos, tmp, head) {
 		obj_req = list_entry(pos, struct object_request, node);
 		if (obj_req->state == WAITING) {
 			if (has_sha1_file(obj_req->oid.hash))
 				obj_req->state = COMPLETE;
+			else if (in_known_pack(walker, obj_req->oid.hash))
+				obj_req->state = PACKED;
 			else {
 				start_object_request(walker, obj_req);
 				return 1;
@@ -141,9 +168,15 @@ static int fill_active_slot(struct walker *walker)
 	}
 	return 0;
 }
+
+static int fill_active_slot(struct walker *walker)
+{
+	return fill_from_queue(walker, &object_queue_head) ||
+	       fill_from_queue(walker, &blob_queue_head);
+}
 #endif
 
-static void prefetch(struct walker *walker, unsigned char *sha1)
+static void prefetch(struct walker *walker, unsigned char *sha1, int leaf)
 {
 	struct object_request *newreq;
 	struct walker_data *data = walker->data;
@@ -156,7 +189,8 @@ static void prefetch(struct walker *walker, unsigned char *sha1)
 	newreq->req = NULL;
 
 	http_is_verbose = walker->get_verbosely;
-	list_add_tail(&newreq->node, &object_queue_head);
+	list_add_tail(&newreq->node,
+		      leaf ? &blob_queue_head : &object_queue_head);
 
 #ifdef USE_CURL_MULTI
 	fill_active_slots();
@@ -473,19 +507,30 @@ static void abort_object_request(struct object_request *obj_req)
 	release_object_request(obj_req);
 }
 
+static struct object_request *find_object_request(struct list_head *head,
+						  const unsigned char *sha1)
+{
+	struct list_head *pos;
+
+	list_for_each(pos, head) {
+		struct object_request *obj_req =
+			list_entry(pos, struct object_request, node);
+		if (hasheq(obj_req->oid.hash, sha1))
+			return obj_req;
+	}
+	return NULL;
+}
+
 static int fetch_object(struct walker *walker, unsigned char *sha1)
 {
 	char *hex = sha1_to_hex(sha1);
 	int ret = 0;
-	struct object_request *obj_req = NULL;
+	struct object_request *obj_req;
 	struct http_object_request *req;
-	struct list_head *pos, *head = &object_queue_head;
 
-	list_for_each(pos, head) {
-		obj_req = list_entry(pos, struct object_request, node);
-		if (hasheq(obj_req->oid.hash, sha1))
-			break;
-	}
+	obj_req = find_object_request(&object_queue_head, sha1);
+	if (!obj_req)
+		obj_req = find_object_request(&blob_queue_head, sha1);
 	if (obj_req == NULL)
 		return error("Couldn't find request for %s in the queue", hex);
 
@@ -496,6 +541,13 @@ static int fetch_object(struct walker *walker, unsigned char *sha1)
 		return 0;
 	}
 
+	/* let fetch() get the pack instead */
+	if (obj_req->state == PACKED ||
+	    (obj_req->state == WAITING && in_known_pack(walker, sha1))) {
+		abort_object_request(obj_req);
+		return -1;
+	}
+
 #ifdef USE_CURL_MULTI
 	while (obj_req->state == WAITING)
 		step_active_slots();
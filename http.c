@@ -1983,8 +1983,8 @@ int http_get_strbuf(const char *url,
  * If a previous interrupted download is detected (i.e. a previous temporary
  * file is still around) the download is resumed.
  */
-static int http_get_file(const char *url, const char *filename,
-			 struct http_get_options *options)
+int http_get_file(const char *url, const char *filename,
+		  struct http_get_options *options)
 {
 	int ret;
 	struct strbuf tmpfile = STRBUF_INIT;
@@ -2058,6 +2058,35 @@ static char *fetch_pack_index(unsigned char *sha1, const char *base_url)
 	return tmp;
 }
 
+/*
+ * Check the pack index downloaded to "tmp_idx", move it into place and
+ * add the pack to "packs_head".
+ */
+static int setup_pack_index(struct packed_git **packs_head,
+			    unsigned char *sha1, const char *tmp_idx)
+{
+	struct packed_git *new_pack;
+	int ret;
+
+	new_pack = parse_pack_index(sha1, tmp_idx);
+	if (!new_pack) {
+		unlink(tmp_idx);
+		return -1; /* parse_pack_index() already issued error message */
+	}
+
+	ret = verify_pack_index(new_pack);
+	if (!ret) {
+		close_pack_index(new_pack);
+		ret = finalize_object_file(tmp_idx, sha1_pack_index_name(sha1));
+	}
+	if (ret)
+		return -1;
+
+	new_pack->next = *packs_head;
+	*packs_head = new_pack;
+	return 0;
+}
+
 static int fetch_and_setup_pack_index(struct packed_git **packs_head,
 	unsigned char *sha1, const char *base_url)
 {
@@ -2076,22 +2105,9 @@ static int fetch_and_setup_pack_index(struct packed_git **packs_head,
 	if (!tmp_idx)
 		return -1;
 
-	new_pack = parse_pack_index(sha1, tmp_idx);
-	if (!new_pack) {
-		unlink(tmp_idx);
-		free(tmp_idx);
-
-		return -1; /* parse_pack_index() already issued error message */
-	}
-
-	ret = verify_pack_index(new_pack);
-	if (!ret) {
-		close_pack_index(new_pack);
-		ret = finalize_object_file(tmp_idx, sha1_pack_index_name(sha1));
-	}
+	ret = setup_pack_index(packs_head, sha1, tmp_idx);
 	free(tmp_idx);
-	if (ret)
-		return -1;
+	return ret;
 
 add_pack:
 	new_pack->next = *packs_head;
@@ -2099,10 +2115,118 @@ static int fetch_and_setup_pack_index(struct packed_git **packs_head,
 	return 0;
 }
 
+#ifdef USE_CURL_MULTI
+/*
+ * A pack index being downloaded while others are, see
+ * http_get_info_packs().
+ */
+struct pack_index_request {
+	unsigned char sha1[GIT_MAX_RAWSZ];
+	char *url;
+	struct strbuf tmpfile;
+	FILE *file;
+	struct active_request_slot *slot;
+	struct slot_results results;
+	int active;
+};
+
+static void process_pack_index_response(void *callback_data)
+{
+	struct pack_index_request *ireq = callback_data;
+
+	ireq->active = 0;
+}
+
+static struct pack_index_request *new_pack_index_request(
+	unsigned char *sha1, const char *base_url)
+{
+	struct pack_index_request *ireq = xcalloc(1, sizeof(*ireq));
+	struct strbuf buf = STRBUF_INIT;
+	off_t prev_posn;
+
+	if (http_is_verbose)
+		fprintf(stderr, "Getting index for pack %s\n", sha1_to_hex(sha1));
+
+	hashcpy(ireq->sha1, sha1);
+	end_url_with_slash(&buf, base_url);
+	strbuf_addf(&buf, "objects/pack/pack-%s.idx", sha1_to_hex(sha1));
+	ireq->url = strbuf_detach(&buf, NULL);
+
+	strbuf_init(&ireq->tmpfile, 0);
+	strbuf_addf(&ireq->tmpfile, "%s.temp", sha1_pack_index_name(sha1));
+	ireq->file = fopen(ireq->tmpfile.buf, "a");
+	if (!ireq->file) {
+		error("Unable to open local file %s", ireq->tmpfile.buf);
+		goto abort;
+	}
+
+	ireq->slot = get_active_slot();
+	ireq->slot->results = &ireq->results;
+	ireq->slot->callback_func = process_pack_index_response;
+	ireq->slot->callback_data = ireq;
+	curl_easy_setopt(ireq->slot->curl, CURLOPT_FILE, ireq->file);
+	curl_easy_setopt(ireq->slot->curl, CURLOPT_WRITEFUNCTION, fwrite);
+	curl_easy_setopt(ireq->slot->curl, CURLOPT_URL, ireq->url);
+	curl_easy_setopt(ireq->slot->curl, CURLOPT_HTTPHEADER,
+			 no_pragma_header);
+	prev_posn = ftello(ireq->file);
+	if (prev_posn > 0)
+		http_opt_request_remainder(ireq->slot->curl, prev_posn);
+
+	ireq->active = 1;
+	if (!start_active_slot(ireq->slot)) {
+		fclose(ireq->file);
+		goto abort;
+	}
+	return ireq;
+
+abort:
+	strbuf_release(&ireq->tmpfile);
+	free(ireq->url);
+	free(ireq);
+	return NULL;
+}
+
+static int finish_pack_index_request(struct packed_git **packs_head,
+				     struct pack_index_request *ireq,
+				     const char *base_url)
+{
+	int ret;
+
+	while (ireq->active)
+		run_active_slot(ireq->slot);
+	fclose(ireq->file);
+
+	if (ireq->results.curl_result == CURLE_OK)
+		ret = setup_pack_index(packs_head, ireq->sha1,
+				       ireq->tmpfile.buf);
+	else if (ireq->results.http_code == 401)
+		/* let http_request() ask for credentials */
+		ret = fetch_and_setup_pack_index(packs_head, ireq->sha1,
+						 base_url);
+	else
+		ret = error("Unable to get pack index %s", ireq->url);
+
+	strbuf_release(&ireq->tmpfile);
+	free(ireq->url);
+	free(ireq);
+	return ret;
+}
+#endif
+
+/*
+ * Get the list of packs of the repository at "base_url" and add them to
+ * "packs_head", downloading the indices we do not have yet. With the curl
+ * multi interface, up to http.maxRequests of them are downloaded at once.
+ */
 int http_get_info_packs(const char *base_url, struct packed_git **packs_head)
 {
 	struct http_get_options options = {0};
 	int ret = 0, i = 0;
+#ifdef USE_CURL_MULTI
+	struct pack_index_request **ireqs = NULL;
+	int ireqs_nr = 0, ireqs_alloc = 0;
+#endif
 	char *url, *data;
 	struct strbuf buf = STRBUF_INIT;
 	unsigned char hash[GIT_MAX_RAWSZ];
@@ -2126,9 +2250,23 @@ int http_get_info_packs(const char *base_url, struct packed_git **packs_head)
 			    starts_with(data + i, " pack-") &&
 			    starts_with(data + i + hexsz + 6, ".pack\n")) {
 				get_sha1_hex(data + i + 6, hash);
+				i += hexsz + 11;
+#ifdef USE_CURL_MULTI
+				if (!has_pack_index(hash)) {
+					struct pack_index_request *ireq;
+
+					ireq = new_pack_index_request(hash,
+								      base_url);
+					if (ireq) {
+						ALLOC_GROW(ireqs, ireqs_nr + 1,
+							   ireqs_alloc);
+						ireqs[ireqs_nr++] = ireq;
+						break;
+					}
+				}
+#endif
 				fetch_and_setup_pack_index(packs_head, hash,
 						      base_url);
-				i += hexsz + 11;
 				break;
 			}
 		default:
@@ -2138,6 +2276,12 @@ int http_get_info_packs(const char *base_url, struct packed_git **packs_head)
 		i++;
 	}
 
+#ifdef USE_CURL_MULTI
+	for (i = 0; i < ireqs_nr; i++)
+		finish_pack_index_request(packs_head, ireqs[i], base_url);
+	free(ireqs);
+#endif
+
 cleanup:
 	free(url);
 	return ret;
@@ -196,6 +196,13 @@ struct http_get_options {
  */
 int http_get_strbuf(const char *url, struct strbuf *result, struct http_get_options *options);
 
+/*
+ * Downloads "url" to "filename", resuming a previous interrupted
+ * download if its temporary file is still around.
+ */
+int http_get_file(const char *url, const char *filename,
+		  struct http_get_options *options);
+
 extern int http_fetch_ref(const char *base, struct ref *ref);
 
 /* Helpers for fetching packs */
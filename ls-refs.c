@@ -1,4 +1,5 @@
 #include "cache.h"
+#include "config.h"
 #include "repository.h"
 #include "refs.h"
 #include "remote.h"
@@ -42,6 +43,8 @@ static int send_ref(const char *refname, const struct object_id *oid,
 
 	if (!ref_match(&data->prefixes, refname))
 		return 0;
+	if (ref_is_hidden(refname_nons, refname))
+		return 0;
 
 	strbuf_addf(&refline, "%s %s", oid_to_hex(oid), refname_nons);
 	if (data->symrefs && flag & REF_ISSYMREF) {
@@ -69,13 +72,26 @@ static int send_ref(const char *refname, const struct object_id *oid,
 	return 0;
 }
 
+static int ls_refs_config(const char *var, const char *value, void *data)
+{
+	const char *section = data;
+	return parse_hide_refs_config(var, value, section);
+}
+
 int ls_refs(struct repository *r, struct argv_array *keys,
-	    struct packet_reader *request)
+	    struct packet_reader *request, const char *hide_refs_section)
 {
+	static int config_loaded;
 	struct ls_refs_data data;
 
 	memset(&data, 0, sizeof(data));
 
+	/* hidden refs are appended to a global list; read them only once */
+	if (!config_loaded) {
+		git_config(ls_refs_config, (void *)hide_refs_section);
+		config_loaded = 1;
+	}
+
 	while (packet_reader_read(request) != PACKET_READ_FLUSH) {
 		const char *arg = request->line;
 		const char *out;
@@ -4,7 +4,14 @@
 struct repository;
 struct argv_array;
 struct packet_reader;
+
+/*
+ * Serve the "ls-refs" command, leaving out the refs hidden by the
+ * "<hide_refs_section>.hideRefs" (and "transfer.hideRefs")
+ * configuration.
+ */
 extern int ls_refs(struct repository *r, struct argv_array *keys,
-		   struct packet_reader *request);
+		   struct packet_reader *request,
+		   const char *hide_refs_section);
 
 #endif /* LS_REFS_H */
@@ -0,0 +1,687 @@
+/*
+ * Three-way merge of trees, done in memory.
+ *
+ * The three trees are walked together to list every path with its
+ * version in the merge base, ours and theirs.  Subtrees that are the
+ * same on both sides, or unchanged on one side, are resolved as a
+ * whole without being looked into.  Renames found by diffcore are then
+ * used to bring the versions of a renamed file together under its new
+ * name, each path is resolved on its own, merging file contents with
+ * ll_merge() where both sides changed them, and the result is written
+ * out as new tree objects.  Neither the index nor the working tree is
+ * involved.
+ */
+#include "cache.h"
+#include "object-store.h"
+#include "repository.h"
+#include "blob.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "xdiff-interface.h"
+#include "ll-merge.h"
+#include "merge-recursive.h"
+#include "merge-in-memory.h"
+
+/* indices into "struct merge_path.side" */
+#define BASE 0
+#define OURS 1
+#define THEIRS 2
+
+struct merge_path {
+	struct merge_conflict_stage side[3];
+	struct merge_conflict_stage result;
+	/* type of conflict, if any (set early for some renames) */
+	const char *conflict;
+	/* if this is the destination of a rename, its source and side */
+	const char *renamed_from;
+	int renamed_by;
+	/* "result" is already known (e.g. for a whole subtree) */
+	unsigned resolved : 1;
+};
+
+struct merge_ctx {
+	struct merge_options *o;
+	/*
+	 * All paths of the three trees, except those in subtrees that
+	 * were resolved as a whole; "util" is a "struct merge_path".
+	 */
+	struct string_list paths;
+	/* the old and new names of all renamed files, sorted */
+	struct string_list rename_srcs, rename_dsts;
+	struct merge_in_memory_result *result;
+};
+
+struct result_entry {
+	const char *path;
+	unsigned mode;
+	const struct object_id *oid;
+};
+
+static int same_entry(const struct name_entry *a, const struct name_entry *b)
+{
+	return a->mode == b->mode && (!a->mode || oideq(a->oid, b->oid));
+}
+
+static int has_path_below(struct string_list *list, const char *dir)
+{
+	int i = string_list_find_insert_index(list, dir, 0);
+
+	if (i < 0)
+		i = -1 - i;
+	return i < list->nr && starts_with(list->items[i].string, dir);
+}
+
+/*
+ * A directory that is the same on both sides, or unchanged on one side,
+ * can be taken as a whole from the right side without descending into
+ * it.  That is what keeps the cost of a merge proportional to the size
+ * of the changes rather than that of the trees.
+ *
+ * We still have to look inside if a rename brings a file into it, as
+ * the contents of that file may need to be merged with changes made
+ * to its old name on the other side.  When the directory is the same
+ * on both sides, renames out of it also matter, as they may have been
+ * done differently on the two sides.
+ */
+static int resolve_directory(struct merge_ctx *ctx, struct name_entry *names,
+			     struct traverse_info *info, const struct name_entry *p)
+{
+	struct merge_path *mp;
+	struct strbuf dir = STRBUF_INIT;
+	int side, check_srcs = 0;
+
+	if (same_entry(names + OURS, names + THEIRS)) {
+		side = OURS;
+		check_srcs = 1;
+	} else if (same_entry(names + BASE, names + OURS)) {
+		side = THEIRS;
+	} else if (same_entry(names + BASE, names + THEIRS)) {
+		side = OURS;
+	} else {
+		return 0;
+	}
+
+	strbuf_grow(&dir, traverse_path_len(info, p) + 1);
+	make_traverse_path(dir.buf, info, p);
+	strbuf_setlen(&dir, traverse_path_len(info, p));
+	strbuf_addch(&dir, '/');
+	if (has_path_below(&ctx->rename_dsts, dir.buf) ||
+	    (check_srcs && has_path_below(&ctx->rename_srcs, dir.buf))) {
+		strbuf_release(&dir);
+		return 0;
+	}
+
+	if (names[side].mode) {
+		mp = xcalloc(1, sizeof(*mp));
+		mp->result.mode = names[side].mode;
+		oidcpy(&mp->result.oid, names[side].oid);
+		mp->resolved = 1;
+		strbuf_setlen(&dir, dir.len - 1);
+		string_list_append_nodup(&ctx->paths,
+					 strbuf_detach(&dir, NULL))->util = mp;
+	}
+	strbuf_release(&dir);
+	return 1;
+}
+
+static int collect_paths(int n, unsigned long mask, unsigned long dirmask,
+			 struct name_entry *names, struct traverse_info *info)
+{
+	struct merge_ctx *ctx = info->data;
+	unsigned long filemask = mask & ~dirmask;
+	const struct name_entry *p = names;
+	int i;
+
+	while (!p->mode)
+		p++;
+
+	if (!filemask && resolve_directory(ctx, names, info, p))
+		return mask;
+
+	if (filemask) {
+		struct merge_path *mp = xcalloc(1, sizeof(*mp));
+		char *path = xmallocz(traverse_path_len(info, p));
+
+		make_traverse_path(path, info, p);
+		for (i = 0; i < n; i++) {
+			if (!(filemask & (1ul << i)))
+				continue;
+			oidcpy(&mp->side[i].oid, names[i].oid);
+			mp->side[i].mode = names[i].mode;
+		}
+		string_list_append_nodup(&ctx->paths, path)->util = mp;
+	}
+
+	if (dirmask) {
+		struct tree_desc t[3];
+		void *buf[3];
+		struct traverse_info newinfo;
+		int ret;
+
+		newinfo = *info;
+		newinfo.prev = info;
+		newinfo.name = *p;
+		newinfo.pathlen += tree_entry_len(p) + 1;
+
+		for (i = 0; i < n; i++) {
+			const struct object_id *oid = NULL;
+
+			if (dirmask & (1ul << i))
+				oid = names[i].oid;
+			buf[i] = fill_tree_descriptor(t + i, oid);
+		}
+		ret = traverse_trees(n, t, &newinfo);
+		for (i = 0; i < n; i++)
+			free(buf[i]);
+		if (ret < 0)
+			return -1;
+	}
+	return mask;
+}
+
+static int collect_all_paths(struct merge_ctx *ctx, struct tree **trees)
+{
+	struct tree_desc t[3];
+	struct traverse_info info;
+	int i;
+
+	for (i = 0; i < 3; i++)
+		init_tree_desc(t + i, trees[i]->buffer, trees[i]->size);
+	setup_traverse_info(&info, "");
+	info.fn = collect_paths;
+	info.data = ctx;
+	if (traverse_trees(3, t, &info) < 0)
+		return -1;
+
+	/*
+	 * The walk gives us the paths in tree order, which differs
+	 * from the plain string order when a file and a directory have
+	 * the same name.
+	 */
+	string_list_sort(&ctx->paths);
+	return 0;
+}
+
+static struct merge_path *lookup_path(struct merge_ctx *ctx, const char *path)
+{
+	struct string_list_item *item = string_list_lookup(&ctx->paths, path);
+	return item ? item->util : NULL;
+}
+
+/*
+ * Fill "renames" with the files renamed between "common" and "side",
+ * mapping the old name to the new one.
+ */
+static void get_renames(struct merge_ctx *ctx, struct tree *common,
+			struct tree *side, struct string_list *renames)
+{
+	struct merge_options *o = ctx->o;
+	struct diff_options opts;
+	int i;
+
+	repo_diff_setup(the_repository, &opts);
+	opts.flags.recursive = 1;
+	opts.flags.rename_empty = 0;
+	opts.detect_rename = DIFF_DETECT_RENAME;
+	opts.rename_limit = o->merge_rename_limit >= 0 ? o->merge_rename_limit :
+			    o->diff_rename_limit >= 0 ? o->diff_rename_limit :
+			    1000;
+	opts.rename_score = o->rename_score;
+	opts.show_rename_progress = o->show_rename_progress;
+	opts.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&opts);
+	diff_tree_oid(&common->object.oid, &side->object.oid, "", &opts);
+	diffcore_std(&opts);
+	if (opts.needed_rename_limit > o->needed_rename_limit)
+		o->needed_rename_limit = opts.needed_rename_limit;
+
+	for (i = 0; i < diff_queued_diff.nr; i++) {
+		struct diff_filepair *p = diff_queued_diff.queue[i];
+
+		if (p->status != 'R')
+			continue;
+		string_list_append(renames, p->one->path)->util =
+			xstrdup(p->two->path);
+		string_list_insert(&ctx->rename_srcs, p->one->path);
+		string_list_insert(&ctx->rename_dsts, p->two->path);
+	}
+	string_list_sort(renames);
+	diff_flush(&opts);
+}
+
+/*
+ * Move the versions of the renamed files to their new name, so that
+ * they are merged there.
+ */
+static void apply_renames(struct merge_ctx *ctx, struct string_list *renames,
+			  int side)
+{
+	int other = OURS + THEIRS - side;
+	int i;
+
+	for (i = 0; i < renames[side].nr; i++) {
+		struct string_list_item *item = &renames[side].items[i];
+		struct string_list_item *other_item;
+		struct merge_path *src, *dst;
+
+		if (!item->util)
+			continue; /* already handled from the other side */
+		src = lookup_path(ctx, item->string);
+		dst = lookup_path(ctx, item->util);
+		if (!src || !dst ||
+		    !src->side[BASE].mode || src->side[side].mode ||
+		    dst->side[BASE].mode || !dst->side[side].mode)
+			continue;
+
+		other_item = string_list_lookup(&renames[other], item->string);
+		if (other_item && other_item->util) {
+			struct merge_path *dst2 = lookup_path(ctx, other_item->util);
+
+			if (!dst2 || dst2->side[BASE].mode)
+				continue;
+			dst->side[BASE] = src->side[BASE];
+			if (dst != dst2) {
+				/* renamed differently on both sides */
+				dst2->side[BASE] = src->side[BASE];
+				dst->conflict = "rename/rename";
+				dst2->conflict = "rename/rename";
+			}
+			src->side[BASE].mode = 0;
+			FREE_AND_NULL(other_item->util);
+			continue;
+		}
+
+		if (dst->side[other].mode)
+			continue; /* added there by the other side */
+
+		dst->side[BASE] = src->side[BASE];
+		if (!src->side[other].mode) {
+			dst->conflict = "rename/delete";
+		} else {
+			dst->side[other] = src->side[other];
+			dst->renamed_from = item->string;
+			dst->renamed_by = side;
+		}
+		memset(src->side, 0, sizeof(src->side));
+	}
+}
+
+static int same_version(const struct merge_conflict_stage *a,
+			const struct merge_conflict_stage *b)
+{
+	return a->mode == b->mode && (!a->mode || oideq(&a->oid, &b->oid));
+}
+
+static char *merge_label(const char *label, const char *path)
+{
+	if (!label)
+		return NULL;
+	if (!path)
+		return xstrdup(label);
+	return xstrfmt("%s:%s", label, path);
+}
+
+/*
+ * Merge the contents of the three versions of a regular file, storing
+ * the resulting blob in "oid".  Returns 1 if there were conflicts, 0
+ * if not, and -1 on errors.
+ */
+static int merge_contents(struct merge_ctx *ctx, const char *path,
+			  struct merge_path *mp, struct object_id *oid)
+{
+	struct merge_options *o = ctx->o;
+	struct ll_merge_options ll_opts = { 0 };
+	mmfile_t orig, src1, src2;
+	mmbuffer_t buf;
+	char *base_label, *our_label, *their_label;
+	int status, ret = 0;
+
+	ll_opts.renormalize = o->renormalize;
+	ll_opts.xdl_opts = o->xdl_opts;
+	if (o->call_depth) {
+		ll_opts.virtual_ancestor = 1;
+	} else if (o->recursive_variant == MERGE_RECURSIVE_OURS) {
+		ll_opts.variant = XDL_MERGE_FAVOR_OURS;
+	} else if (o->recursive_variant == MERGE_RECURSIVE_THEIRS) {
+		ll_opts.variant = XDL_MERGE_FAVOR_THEIRS;
+	}
+
+	if (mp->renamed_from) {
+		const char *old = mp->renamed_from;
+
+		base_label = merge_label(o->ancestor, old);
+		our_label = merge_label(o->branch1,
+					mp->renamed_by == OURS ? path : old);
+		their_label = merge_label(o->branch2,
+					  mp->renamed_by == THEIRS ? path : old);
+	} else {
+		base_label = merge_label(o->ancestor, NULL);
+		our_label = merge_label(o->branch1, NULL);
+		their_label = merge_label(o->branch2, NULL);
+	}
+
+	read_mmblob(&orig, S_ISREG(mp->side[BASE].mode) ?
+		    &mp->side[BASE].oid : &null_oid);
+	read_mmblob(&src1, &mp->side[OURS].oid);
+	read_mmblob(&src2, &mp->side[THEIRS].oid);
+
+	status = ll_merge(&buf, path, &orig, base_label,
+			  &src1, our_label, &src2, their_label,
+			  &the_index, &ll_opts);
+	if (status < 0)
+		ret = error(_("failed to execute internal merge for '%s'"),
+			    path);
+	else if (write_object_file(buf.ptr, buf.size, blob_type, oid))
+		ret = error(_("unable to add %s to database"), path);
+	else
+		ret = !!status;
+
+	if (status >= 0)
+		free(buf.ptr);
+	free(orig.ptr);
+	free(src1.ptr);
+	free(src2.ptr);
+	free(base_label);
+	free(our_label);
+	free(their_label);
+	return ret;
+}
+
+static void add_conflict(struct merge_ctx *ctx, const char *path,
+			 struct merge_path *mp, const char *type)
+{
+	struct merge_conflict *c = xcalloc(1, sizeof(*c));
+
+	c->type = type;
+	memcpy(c->stages, mp->side, sizeof(c->stages));
+	string_list_append(&ctx->result->conflicts, path)->util = c;
+	ctx->result->clean = 0;
+}
+
+static int resolve_path(struct merge_ctx *ctx, const char *path,
+			struct merge_path *mp)
+{
+	struct merge_conflict_stage *base = &mp->side[BASE];
+	struct merge_conflict_stage *ours = &mp->side[OURS];
+	struct merge_conflict_stage *theirs = &mp->side[THEIRS];
+	const char *conflict = mp->conflict;
+
+	if (conflict) {
+		mp->result = ours->mode ? *ours : *theirs;
+	} else if (same_version(ours, theirs) || same_version(base, theirs)) {
+		mp->result = *ours;
+	} else if (same_version(base, ours)) {
+		mp->result = *theirs;
+	} else if (!ours->mode || !theirs->mode) {
+		mp->result = ours->mode ? *ours : *theirs;
+		conflict = "modify/delete";
+	} else if ((ours->mode & S_IFMT) != (theirs->mode & S_IFMT)) {
+		mp->result = *ours;
+		conflict = "distinct types";
+	} else if (!S_ISREG(ours->mode)) {
+		/* symbolic links and submodules */
+		mp->result = *ours;
+		conflict = base->mode ? "content" : "add/add";
+	} else {
+		if (base->mode == ours->mode) {
+			mp->result.mode = theirs->mode;
+		} else {
+			mp->result.mode = ours->mode;
+			if (base->mode != theirs->mode &&
+			    ours->mode != theirs->mode)
+				conflict = "mode";
+		}
+
+		if (oideq(&ours->oid, &theirs->oid) ||
+		    (base->mode && oideq(&base->oid, &theirs->oid))) {
+			oidcpy(&mp->result.oid, &ours->oid);
+		} else if (base->mode && oideq(&base->oid, &ours->oid)) {
+			oidcpy(&mp->result.oid, &theirs->oid);
+		} else {
+			int ret = merge_contents(ctx, path, mp,
+						 &mp->result.oid);
+			if (ret < 0)
+				return -1;
+			if (ret)
+				conflict = base->mode ? "content" : "add/add";
+		}
+	}
+
+	mp->conflict = conflict;
+	return 0;
+}
+
+/*
+ * Is "path" a directory in the merged tree?  We only need to look at
+ * the paths sorted right after it.
+ */
+static int is_result_directory(struct merge_ctx *ctx, const char *path)
+{
+	struct strbuf dir = STRBUF_INIT;
+	int i, ret = 0;
+
+	strbuf_addf(&dir, "%s/", path);
+	i = string_list_find_insert_index(&ctx->paths, dir.buf, 0);
+	if (i < 0)
+		i = -1 - i;
+	for (; i < ctx->paths.nr; i++) {
+		struct string_list_item *item = &ctx->paths.items[i];
+		struct merge_path *mp = item->util;
+
+		if (!starts_with(item->string, dir.buf))
+			break;
+		if (mp->result.mode) {
+			ret = 1;
+			break;
+		}
+	}
+	strbuf_release(&dir);
+	return ret;
+}
+
+/*
+ * Find a name for a file that is in the way of a directory, the same
+ * way merge-recursive does.
+ */
+static char *unique_path(struct merge_ctx *ctx, struct string_list *moved,
+			 const char *path, const char *branch)
+{
+	struct strbuf newpath = STRBUF_INIT;
+	int suffix = 0;
+	size_t base_len;
+
+	strbuf_addf(&newpath, "%s~", path);
+	for (; branch && *branch; branch++)
+		strbuf_addch(&newpath, *branch == '/' ? '_' : *branch);
+
+	base_len = newpath.len;
+	while (string_list_has_string(&ctx->paths, newpath.buf) ||
+	       unsorted_string_list_has_string(moved, newpath.buf)) {
+		strbuf_setlen(&newpath, base_len);
+		strbuf_addf(&newpath, "_%d", suffix++);
+	}
+	return strbuf_detach(&newpath, NULL);
+}
+
+/*
+ * Sort in the order of tree entries: a directory compares as if its
+ * name ended with a slash.
+ */
+static int result_entry_cmp(const void *a_, const void *b_)
+{
+	const struct result_entry *a = a_, *b = b_;
+	return base_name_compare(a->path, strlen(a->path), a->mode,
+				 b->path, strlen(b->path), b->mode);
+}
+
+/*
+ * Write the tree for the "nr" entries that all live below the same
+ * directory, whose name is "baselen" bytes long including the slash.
+ */
+static int write_result_tree(struct result_entry *entries, int nr,
+			     int baselen, struct object_id *oid)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int i = 0, ret = 0;
+
+	while (i < nr) {
+		const char *name = entries[i].path + baselen;
+		const char *slash = strchr(name, '/');
+		struct object_id subtree;
+		int len, j;
+
+		if (!slash) {
+			strbuf_addf(&buf, "%o %s%c", entries[i].mode, name, '\0');
+			strbuf_add(&buf, entries[i].oid->hash,
+				   the_hash_algo->rawsz);
+			i++;
+			continue;
+		}
+
+		len = slash - name;
+		for (j = i + 1; j < nr; j++)
+			if (strncmp(entries[j].path + baselen, name, len + 1))
+				break;
+		ret = write_result_tree(entries + i, j - i,
+					baselen + len + 1, &subtree);
+		if (ret)
+			goto out;
+		strbuf_addf(&buf, "%o %.*s%c", S_IFDIR, len, name, '\0');
+		strbuf_add(&buf, subtree.hash, the_hash_algo->rawsz);
+		i = j;
+	}
+
+	if (write_object_file(buf.buf, buf.len, tree_type, oid))
+		ret = error(_("unable to write tree object"));
+out:
+	strbuf_release(&buf);
+	return ret;
+}
+
+static int write_result(struct merge_ctx *ctx)
+{
+	struct result_entry *entries;
+	struct string_list moved = STRING_LIST_INIT_DUP;
+	int i, nr = 0, ret;
+
+	ALLOC_ARRAY(entries, ctx->paths.nr);
+	for (i = 0; i < ctx->paths.nr; i++) {
+		const char *path = ctx->paths.items[i].string;
+		struct merge_path *mp = ctx->paths.items[i].util;
+
+		if (!mp->result.mode)
+			continue;
+		if (!S_ISDIR(mp->result.mode) &&
+		    is_result_directory(ctx, path)) {
+			/* move the file out of the way of the directory */
+			const char *branch =
+				same_version(&mp->result, &mp->side[OURS]) ?
+				ctx->o->branch1 : ctx->o->branch2;
+			char *newpath = unique_path(ctx, &moved, path,
+						    branch);
+
+			path = string_list_append_nodup(&moved, newpath)->string;
+			if (!mp->conflict)
+				mp->conflict = "directory/file";
+		}
+		if (mp->conflict)
+			add_conflict(ctx, path, mp, mp->conflict);
+		entries[nr].path = path;
+		entries[nr].mode = mp->result.mode;
+		entries[nr].oid = &mp->result.oid;
+		nr++;
+	}
+
+	QSORT(entries, nr, result_entry_cmp);
+	ret = write_result_tree(entries, nr, 0, &ctx->result->tree);
+
+	free(entries);
+	string_list_clear(&moved, 0);
+	return ret;
+}
+
+int merge_trees_in_memory(struct merge_options *o,
+			  struct tree *head,
+			  struct tree *merge,
+			  struct tree *common,
+			  struct merge_in_memory_result *result)
+{
+	struct string_list renames[3] = {
+		STRING_LIST_INIT_NODUP,
+		STRING_LIST_INIT_DUP,
+		STRING_LIST_INIT_DUP
+	};
+	struct tree *trees[3];
+	struct merge_ctx ctx;
+	int i, ret = -1;
+
+	result->clean = 1;
+	if (parse_tree(head) || parse_tree(merge) || parse_tree(common))
+		return error(_("unable to read tree"));
+
+	if (oideq(&common->object.oid, &merge->object.oid) ||
+	    oideq(&head->object.oid, &merge->object.oid)) {
+		oidcpy(&result->tree, &head->object.oid);
+		return 1;
+	}
+	if (oideq(&common->object.oid, &head->object.oid)) {
+		oidcpy(&result->tree, &merge->object.oid);
+		return 1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.o = o;
+	ctx.result = result;
+	string_list_init(&ctx.paths, 1);
+	string_list_init(&ctx.rename_srcs, 1);
+	string_list_init(&ctx.rename_dsts, 1);
+
+	/*
+	 * Renames are found first, as they tell us which directories
+	 * we cannot resolve without looking into them.  The diffs
+	 * themselves do not descend into identical subtrees.
+	 */
+	if (merge_detect_rename(o)) {
+		get_renames(&ctx, common, head, &renames[OURS]);
+		get_renames(&ctx, common, merge, &renames[THEIRS]);
+	}
+
+	trees[BASE] = common;
+	trees[OURS] = head;
+	trees[THEIRS] = merge;
+	if (collect_all_paths(&ctx, trees))
+		goto out;
+
+	apply_renames(&ctx, renames, OURS);
+	apply_renames(&ctx, renames, THEIRS);
+
+	for (i = 0; i < ctx.paths.nr; i++) {
+		struct merge_path *mp = ctx.paths.items[i].util;
+
+		if (!mp->resolved &&
+		    resolve_path(&ctx, ctx.paths.items[i].string, mp))
+			goto out;
+	}
+
+	if (write_result(&ctx))
+		goto out;
+	string_list_sort(&result->conflicts);
+	ret = result->clean;
+
+out:
+	string_list_clear(&ctx.paths, 1);
+	string_list_clear(&ctx.rename_srcs, 0);
+	string_list_clear(&ctx.rename_dsts, 0);
+	string_list_clear(&renames[OURS], 1);
+	string_list_clear(&renames[THEIRS], 1);
+	if (ret < 0)
+		string_list_clear(&result->conflicts, 1);
+	return ret;
+}
+
+void merge_in_memory_result_release(struct merge_in_memory_result *result)
+{
+	string_list_clear(&result->conflicts, 1);
+}
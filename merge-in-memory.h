@@ -0,0 +1,59 @@
+#ifndef MERGE_IN_MEMORY_H
+#define MERGE_IN_MEMORY_H
+
+#include "string-list.h"
+
+struct merge_options;
+struct tree;
+
+/*
+ * A three-way merge of trees that is done entirely in memory: unlike
+ * merge_trees(), it does not read or write the index and never looks
+ * at the working tree.  The result is a tree object (in which files
+ * with conflicting changes carry conflict markers) and the list of
+ * conflicts; callers decide if and how to update the index and the
+ * working tree from it.
+ */
+
+struct merge_conflict_stage {
+	struct object_id oid;
+	unsigned mode; /* 0 if the path does not exist on that side */
+};
+
+struct merge_conflict {
+	/* "content", "add/add", "modify/delete", "rename/delete", ... */
+	const char *type;
+	/* the versions in the merge base, ours and theirs */
+	struct merge_conflict_stage stages[3];
+};
+
+struct merge_in_memory_result {
+	/* the merged tree */
+	struct object_id tree;
+	/*
+	 * The paths of the merged tree that have conflicts, with a
+	 * "struct merge_conflict" in their "util" field.
+	 */
+	struct string_list conflicts;
+	int clean;
+};
+
+#define MERGE_IN_MEMORY_RESULT_INIT { { { 0 } }, STRING_LIST_INIT_DUP, 1 }
+
+/*
+ * Merge "head" and "merge" using "common" as their merge base, with
+ * the labels, rename detection and content merge settings of "o".
+ *
+ * Returns 1 if the merge is clean, 0 if there were conflicts and -1
+ * on errors.  In the first two cases, "result" is filled in and must
+ * be released with merge_in_memory_result_release().
+ */
+int merge_trees_in_memory(struct merge_options *o,
+			  struct tree *head,
+			  struct tree *merge,
+			  struct tree *common,
+			  struct merge_in_memory_result *result);
+
+void merge_in_memory_result_release(struct merge_in_memory_result *result);
+
+#endif
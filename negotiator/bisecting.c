@@ -0,0 +1,430 @@
+#include "cache.h"
+#include "bisecting.h"
+#include "../commit.h"
+#include "../commit-slab.h"
+#include "../fetch-negotiator.h"
+#include "../prio-queue.h"
+#include "../refs.h"
+#include "../tag.h"
+
+/*
+ * This negotiator walks all tips at once, newest generation first, and
+ * sends commits that are further and further apart along each path (1, 2,
+ * 4, 8... commits are skipped between two "have" lines), so that a common
+ * ancestor is reached in a few rounds even when it is far away.
+ *
+ * When the server acknowledges a commit, its ancestors need not be sent any
+ * more. The commits skipped on the way from the last "have" line the server
+ * did not acknowledge down to the acknowledged one are then bisected, one
+ * "have" line per round, to find the newest ones the server has, so that
+ * it does not need to send them again.
+ */
+
+/* Remember to update object flag allocation in object.h */
+/*
+ * Both us and the server know that both parties have this object.
+ */
+#define COMMON		(1U << 2)
+/*
+ * The server has told us that it has this object. We still need to tell the
+ * server that we have this object (or one of its descendants), but since we are
+ * going to do that, we do not need to tell the server about its ancestors.
+ */
+#define ADVERTISED	(1U << 3)
+/*
+ * This commit has entered the priority queue.
+ */
+#define SEEN		(1U << 4)
+/*
+ * This commit has left the priority queue.
+ */
+#define POPPED		(1U << 5)
+
+/*
+ * The walk never skips more commits than this in a row.
+ */
+#define MAX_SKIP 1024
+
+static int marked;
+
+/*
+ * An entry in the priority queue.
+ */
+struct entry {
+	struct commit *commit;
+
+	/*
+	 * Used only if commit is not COMMON.
+	 */
+	uint16_t original_ttl;
+	uint16_t ttl;
+};
+
+struct bisect_info {
+	/*
+	 * The entry of this commit while it is in the priority queue.
+	 */
+	struct entry *entry;
+
+	/*
+	 * The commit whose parent this one was first queued as.
+	 */
+	struct commit *child;
+
+	/*
+	 * The number of "have" lines sent up to and including this commit,
+	 * or 0 if it has not been sent.
+	 */
+	int sent;
+
+	/*
+	 * If this commit has been acknowledged, the "sent" value of the
+	 * commit last sent to bisect the commits between it and its closest
+	 * descendant that was sent, or 0.
+	 */
+	int probe;
+};
+
+define_commit_slab(bisect_info_slab, struct bisect_info);
+
+struct data {
+	struct prio_queue rev_list;
+	struct bisect_info_slab info;
+
+	/*
+	 * The number of non-COMMON commits in rev_list.
+	 */
+	int non_common_revs;
+
+	/*
+	 * The number of "have" lines sent, and how many of them the server
+	 * has answered.
+	 */
+	int nr_sent;
+	int nr_answered;
+
+	/*
+	 * The "sent" value of the last commit the walk sent after skipping
+	 * some of its descendants.
+	 */
+	int last_skip;
+
+	/*
+	 * The server could send a packfile already: only bisect what has
+	 * been acknowledged, and do not walk any further.
+	 */
+	int ready;
+
+	/*
+	 * Acknowledged commits, the descendants of which still need to be
+	 * bisected.
+	 */
+	struct commit **acked;
+	int acked_nr, acked_alloc;
+};
+
+static int compare(const void *a_, const void *b_, void *unused)
+{
+	const struct entry *a = a_;
+	const struct entry *b = b_;
+	return compare_commits_by_gen_then_commit_date(a->commit, b->commit, NULL);
+}
+
+static struct entry *rev_list_push(struct data *data, struct commit *commit, int mark)
+{
+	struct entry *entry;
+	commit->object.flags |= mark | SEEN;
+
+	entry = xcalloc(1, sizeof(*entry));
+	entry->commit = commit;
+	prio_queue_put(&data->rev_list, entry);
+	bisect_info_slab_at(&data->info, commit)->entry = entry;
+
+	if (!(mark & COMMON))
+		data->non_common_revs++;
+	return entry;
+}
+
+static int clear_marks(const char *refname, const struct object_id *oid,
+		       int flag, void *cb_data)
+{
+	struct object *o = deref_tag(the_repository, parse_object(the_repository, oid), refname, 0);
+
+	if (o && o->type == OBJ_COMMIT)
+		clear_commit_marks((struct commit *)o,
+				   COMMON | ADVERTISED | SEEN | POPPED);
+	return 0;
+}
+
+/*
+ * Mark this SEEN commit and all its SEEN ancestors as COMMON.
+ */
+static void mark_common(struct data *data, struct commit *c)
+{
+	struct commit_list *p;
+
+	if (c->object.flags & COMMON)
+		return;
+	c->object.flags |= COMMON;
+	if (!(c->object.flags & POPPED))
+		data->non_common_revs--;
+
+	if (!c->object.parsed)
+		return;
+	for (p = c->parents; p; p = p->next) {
+		if (p->item->object.flags & SEEN)
+			mark_common(data, p->item);
+	}
+}
+
+/*
+ * Ensure that the priority queue has an entry for to_push, and ensure that the
+ * entry has the correct flags and ttl.
+ *
+ * This function returns 1 if an entry was found or created, and 0 otherwise
+ * (because the entry for this commit had already been popped).
+ */
+static int push_parent(struct data *data, struct entry *entry,
+		       struct commit *to_push)
+{
+	struct entry *parent_entry;
+	struct bisect_info *info;
+
+	if (to_push->object.flags & SEEN) {
+		if (to_push->object.flags & POPPED)
+			/*
+			 * The entry for this commit has already been popped,
+			 * because it is not in the commit-graph and its date
+			 * is skewed. Pretend that this parent does not exist.
+			 */
+			return 0;
+		info = bisect_info_slab_at(&data->info, to_push);
+		parent_entry = info->entry;
+	} else {
+		parent_entry = rev_list_push(data, to_push, 0);
+		info = bisect_info_slab_at(&data->info, to_push);
+	}
+	/* tips have no child until one of their descendants is popped */
+	if (!info->child)
+		info->child = entry->commit;
+
+	if (entry->commit->object.flags & (COMMON | ADVERTISED)) {
+		mark_common(data, to_push);
+	} else {
+		uint16_t new_original_ttl, new_ttl;
+
+		if (entry->ttl)
+			new_original_ttl = entry->original_ttl;
+		else if (!entry->original_ttl)
+			new_original_ttl = 1;
+		else if (entry->original_ttl < MAX_SKIP / 2)
+			new_original_ttl = entry->original_ttl * 2;
+		else
+			new_original_ttl = MAX_SKIP;
+		new_ttl = entry->ttl ? entry->ttl - 1 : new_original_ttl;
+		if (parent_entry->original_ttl < new_original_ttl) {
+			parent_entry->original_ttl = new_original_ttl;
+			parent_entry->ttl = new_ttl;
+		}
+	}
+
+	return 1;
+}
+
+static struct commit *get_rev(struct data *data)
+{
+	struct commit *to_send = NULL;
+
+	while (to_send == NULL) {
+		struct entry *entry;
+		struct commit *commit;
+		struct commit_list *p;
+		int parent_pushed = 0;
+
+		if (data->rev_list.nr == 0 || data->non_common_revs == 0 ||
+		    data->ready)
+			return NULL;
+
+		entry = prio_queue_get(&data->rev_list);
+		commit = entry->commit;
+		commit->object.flags |= POPPED;
+		bisect_info_slab_at(&data->info, commit)->entry = NULL;
+		if (!(commit->object.flags & COMMON))
+			data->non_common_revs--;
+
+		if (!(commit->object.flags & COMMON) && !entry->ttl)
+			to_send = commit;
+
+		parse_commit(commit);
+		for (p = commit->parents; p; p = p->next)
+			parent_pushed |= push_parent(data, entry, p->item);
+
+		if (!(commit->object.flags & COMMON) && !parent_pushed)
+			/*
+			 * This commit has no parents, or all of its parents
+			 * have already been popped, so send it anyway.
+			 */
+			to_send = commit;
+
+		if (to_send && entry->ttl < entry->original_ttl)
+			data->last_skip = data->nr_sent + 1;
+		free(entry);
+	}
+
+	return to_send;
+}
+
+/*
+ * Return the commit in the middle of those between the acknowledged commit
+ * "c" and its closest descendant (on the path the walk took) that has been
+ * sent, or NULL if there is nothing left to bisect there: either there are
+ * no such commits, or the descendant turned out to be common too.
+ */
+static struct commit *bisect_probe(struct data *data, struct commit *c)
+{
+	struct commit **chain = NULL;
+	int nr = 0, alloc = 0;
+	struct commit *p = bisect_info_slab_at(&data->info, c)->child;
+	struct commit *probe = NULL;
+
+	while (p && !(p->object.flags & COMMON)) {
+		struct bisect_info *info = bisect_info_slab_at(&data->info, p);
+		if (info->sent)
+			break;
+		ALLOC_GROW(chain, nr + 1, alloc);
+		chain[nr++] = p;
+		p = info->child;
+	}
+	if (p && !(p->object.flags & COMMON) && nr)
+		probe = chain[nr / 2];
+	free(chain);
+	return probe;
+}
+
+/*
+ * Return the next commit to send to bisect the descendants of acknowledged
+ * commits, if one is not waiting for the server to answer already.
+ */
+static struct commit *next_probe(struct data *data)
+{
+	int i = 0;
+
+	while (i < data->acked_nr) {
+		struct commit *c = data->acked[i];
+		struct bisect_info *info = bisect_info_slab_at(&data->info, c);
+		struct commit *probe;
+
+		if (info->probe > data->nr_answered) {
+			i++;
+			continue;
+		}
+		probe = bisect_probe(data, c);
+		if (!probe) {
+			data->acked[i] = data->acked[--data->acked_nr];
+			continue;
+		}
+		info->probe = data->nr_sent + 1;
+		return probe;
+	}
+	return NULL;
+}
+
+static void known_common(struct fetch_negotiator *n, struct commit *c)
+{
+	if (c->object.flags & SEEN)
+		return;
+	rev_list_push(n->data, c, ADVERTISED);
+}
+
+static void add_tip(struct fetch_negotiator *n, struct commit *c)
+{
+	n->known_common = NULL;
+	if (c->object.flags & SEEN)
+		return;
+	rev_list_push(n->data, c, 0);
+}
+
+static const struct object_id *next(struct fetch_negotiator *n)
+{
+	struct data *data = n->data;
+	struct commit *c;
+
+	n->known_common = NULL;
+	n->add_tip = NULL;
+
+	c = next_probe(data);
+	if (!c)
+		c = get_rev(data);
+	if (!c)
+		return NULL;
+	bisect_info_slab_at(&data->info, c)->sent = ++data->nr_sent;
+	return &c->object.oid;
+}
+
+static int ack(struct fetch_negotiator *n, struct commit *c)
+{
+	struct data *data = n->data;
+	int known_to_be_common = !!(c->object.flags & COMMON);
+	if (!(c->object.flags & SEEN))
+		die("received ack for commit %s not sent as 'have'\n",
+		    oid_to_hex(&c->object.oid));
+	mark_common(data, c);
+	if (!known_to_be_common) {
+		ALLOC_GROW(data->acked, data->acked_nr + 1, data->acked_alloc);
+		data->acked[data->acked_nr++] = c;
+	}
+	return known_to_be_common;
+}
+
+static void answered(struct fetch_negotiator *n, int nr, int ready)
+{
+	struct data *data = n->data;
+	if (data->nr_answered < nr)
+		data->nr_answered = nr;
+	if (ready)
+		data->ready = 1;
+}
+
+static int pending(struct fetch_negotiator *n)
+{
+	struct data *data = n->data;
+
+	/*
+	 * next() only leaves commits in "acked" if it waits for the answer
+	 * to the last probe sent for them, and if the server acknowledges a
+	 * commit sent after a skip, there is something to bisect.
+	 */
+	return data->acked_nr || data->last_skip > data->nr_answered;
+}
+
+static void release(struct fetch_negotiator *n)
+{
+	struct data *data = n->data;
+	int i;
+
+	for (i = 0; i < data->rev_list.nr; i++)
+		free(data->rev_list.array[i].data);
+	clear_prio_queue(&data->rev_list);
+	clear_bisect_info_slab(&data->info);
+	free(data->acked);
+	FREE_AND_NULL(n->data);
+}
+
+void bisecting_negotiator_init(struct fetch_negotiator *negotiator)
+{
+	struct data *data;
+	negotiator->known_common = known_common;
+	negotiator->add_tip = add_tip;
+	negotiator->next = next;
+	negotiator->ack = ack;
+	negotiator->answered = answered;
+	negotiator->pending = pending;
+	negotiator->release = release;
+	negotiator->data = data = xcalloc(1, sizeof(*data));
+	data->rev_list.compare = compare;
+	init_bisect_info_slab(&data->info);
+
+	if (marked)
+		for_each_ref(clear_marks, NULL);
+	marked = 1;
+}
@@ -0,0 +1,8 @@
+#ifndef NEGOTIATOR_BISECTING_H
+#define NEGOTIATOR_BISECTING_H
+
+struct fetch_negotiator;
+
+void bisecting_negotiator_init(struct fetch_negotiator *negotiator);
+
+#endif
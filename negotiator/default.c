@@ -166,6 +166,8 @@ void default_negotiator_init(struct fetch_negotiator *negotiator)
 	negotiator->add_tip = add_tip;
 	negotiator->next = next;
 	negotiator->ack = ack;
+	negotiator->answered = NULL;
+	negotiator->pending = NULL;
 	negotiator->release = release;
 	negotiator->data = ns = xcalloc(1, sizeof(*ns));
 	ns->rev_list.compare = compare_commits_by_commit_date;
@@ -240,6 +240,8 @@ void skipping_negotiator_init(struct fetch_negotiator *negotiator)
 	negotiator->add_tip = add_tip;
 	negotiator->next = next;
 	negotiator->ack = ack;
+	negotiator->answered = NULL;
+	negotiator->pending = NULL;
 	negotiator->release = release;
 	negotiator->data = data = xcalloc(1, sizeof(*data));
 	data->rev_list.compare = compare;
@@ -6,6 +6,7 @@
 #include "list.h"
 #include "sha1-array.h"
 #include "strbuf.h"
+#include "thread-utils.h"
 
 struct alternate_object_database {
 	struct alternate_object_database *next;
@@ -278,6 +279,43 @@ int oid_object_info_extended(struct repository *r,
 			     const struct object_id *,
 			     struct object_info *, unsigned flags);
 
+/*
+ * Enabling the object read lock allows multiple threads to safely call
+ * read_object_file(), read_object_file_extended(),
+ * read_object_with_reference(), oid_object_info() and
+ * oid_object_info_extended() in parallel.  The object store's internal
+ * state (the pack list, pack windows and the delta base cache) is only
+ * touched while the lock is held, but the lock is dropped around zlib
+ * inflation, which is where most of the time is spent.
+ *
+ * obj_read_lock() and obj_read_unlock() may also be used to protect
+ * other sections that cannot run in parallel with object reading.  The
+ * lock is a recursive mutex, so such sections may call the object reading
+ * functions themselves, at the cost of inflating serially.
+ */
+void enable_obj_read_lock(void);
+void disable_obj_read_lock(void);
+
+#ifndef NO_PTHREADS
+extern int obj_read_use_lock;
+extern pthread_mutex_t obj_read_mutex;
+
+static inline void obj_read_lock(void)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_lock(&obj_read_mutex);
+}
+
+static inline void obj_read_unlock(void)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_unlock(&obj_read_mutex);
+}
+#else
+#define obj_read_lock()
+#define obj_read_unlock()
+#endif
+
 /*
  * Iterate over the files in the loose-object parts of the object
  * directory "path", triggering the following callbacks:
@@ -11,13 +11,17 @@
 #include "packfile.h"
 #include "commit-graph.h"
 
+static void finish_obj_hash_migration(struct parsed_object_pool *o);
+
 unsigned int get_max_object_index(void)
 {
+	finish_obj_hash_migration(the_repository->parsed_objects);
 	return the_repository->parsed_objects->obj_hash_size;
 }
 
 struct object *get_indexed_object(unsigned int idx)
 {
+	finish_obj_hash_migration(the_repository->parsed_objects);
 	return the_repository->parsed_objects->obj_hash[idx];
 }
 
@@ -65,96 +69,165 @@ static unsigned int hash_obj(const unsigned char *sha1, unsigned int n)
 }
 
 /*
- * Insert obj into the hash table hash, which has length size (which
- * must be a power of 2).  On collisions, simply overflow to the next
- * empty bucket.
+ * Return the fragment of sha1 that is stored in obj_hash_tag.  It is
+ * taken from bytes that hash_obj() does not look at, and is never 0,
+ * which marks an empty slot.
+ */
+static unsigned char hash_obj_tag(const unsigned char *sha1)
+{
+	return sha1[4] ? sha1[4] : 1;
+}
+
+/*
+ * Insert obj into the hash table hash (with tags in tag), which has
+ * length size (which must be a power of 2).  On collisions, simply
+ * overflow to the next empty bucket.
  */
-static void insert_obj_hash(struct object *obj, struct object **hash, unsigned int size)
+static void insert_obj_hash(struct object *obj, struct object **hash,
+			    unsigned char *tag, unsigned int size)
 {
 	unsigned int j = hash_obj(obj->oid.hash, size);
 
-	while (hash[j]) {
-		j++;
-		if (j >= size)
-			j = 0;
-	}
+	while (tag[j])
+		j = (j + 1) & (size - 1);
 	hash[j] = obj;
+	tag[j] = hash_obj_tag(obj->oid.hash);
+}
+
+/*
+ * Find sha1 in the given hash table, only dereferencing entries whose
+ * tag matches.  Return the bucket it was found in, or -1.
+ */
+static int find_obj_hash(const unsigned char *sha1, struct object **hash,
+			 const unsigned char *tag, unsigned int size)
+{
+	unsigned int i = hash_obj(sha1, size);
+	unsigned char want = hash_obj_tag(sha1);
+
+	while (tag[i]) {
+		if (tag[i] == want && hasheq(sha1, hash[i]->oid.hash))
+			return i;
+		i = (i + 1) & (size - 1);
+	}
+	return -1;
 }
 
 /*
  * Look up the record for the given sha1 in the hash map stored in
- * obj_hash.  Return NULL if it was not found.
+ * obj_hash (or in the table it is still being migrated from).  Return
+ * NULL if it was not found.
  */
 struct object *lookup_object(struct repository *r, const unsigned char *sha1)
 {
-	unsigned int i, first;
-	struct object *obj;
+	struct parsed_object_pool *o = r->parsed_objects;
+	int i, first;
 
-	if (!r->parsed_objects->obj_hash)
+	if (!o->obj_hash)
 		return NULL;
 
-	first = i = hash_obj(sha1, r->parsed_objects->obj_hash_size);
-	while ((obj = r->parsed_objects->obj_hash[i]) != NULL) {
-		if (hasheq(sha1, obj->oid.hash))
-			break;
-		i++;
-		if (i == r->parsed_objects->obj_hash_size)
-			i = 0;
+	i = find_obj_hash(sha1, o->obj_hash, o->obj_hash_tag, o->obj_hash_size);
+	if (i < 0) {
+		/*
+		 * Not yet migrated entries are left in place; the old table
+		 * is never modified, so its probe sequences stay intact.
+		 */
+		if (!o->old_obj_hash)
+			return NULL;
+		i = find_obj_hash(sha1, o->old_obj_hash, o->old_obj_hash_tag,
+				  o->old_obj_hash_size);
+		return i < 0 ? NULL : o->old_obj_hash[i];
 	}
-	if (obj && i != first) {
+
+	first = hash_obj(sha1, o->obj_hash_size);
+	if (i != first) {
 		/*
 		 * Move object to where we started to look for it so
 		 * that we do not need to walk the hash table the next
 		 * time we look for it.
 		 */
-		SWAP(r->parsed_objects->obj_hash[i],
-		     r->parsed_objects->obj_hash[first]);
+		SWAP(o->obj_hash[i], o->obj_hash[first]);
+		SWAP(o->obj_hash_tag[i], o->obj_hash_tag[first]);
 	}
-	return obj;
+	return o->obj_hash[first];
+}
+
+/*
+ * Number of buckets of the old table moved over per created object.
+ * The new table is twice as large and is grown again once it is half
+ * full, i.e. after half as many insertions as the old table has
+ * buckets, so anything above 2 finishes the migration in time.
+ */
+#define OBJ_HASH_MIGRATE_STEP 8
+
+static void migrate_obj_hash(struct parsed_object_pool *o, int nr)
+{
+	while (o->old_obj_hash_pos < o->old_obj_hash_size && nr--) {
+		int i = o->old_obj_hash_pos++;
+
+		if (o->old_obj_hash_tag[i])
+			insert_obj_hash(o->old_obj_hash[i], o->obj_hash,
+					o->obj_hash_tag, o->obj_hash_size);
+	}
+	if (o->old_obj_hash_pos < o->old_obj_hash_size)
+		return;
+
+	FREE_AND_NULL(o->old_obj_hash);
+	FREE_AND_NULL(o->old_obj_hash_tag);
+	o->old_obj_hash_size = 0;
+	o->old_obj_hash_pos = 0;
+}
+
+/*
+ * Callers that index obj_hash directly must see every object in it.
+ */
+static void finish_obj_hash_migration(struct parsed_object_pool *o)
+{
+	if (o->old_obj_hash)
+		migrate_obj_hash(o, o->old_obj_hash_size);
 }
 
 /*
  * Increase the size of the hash map stored in obj_hash to the next
- * power of 2 (but at least 32).  Copy the existing values to the new
- * hash map.
+ * power of 2 (but at least 32).  The existing values are moved over
+ * incrementally by create_object().
  */
 static void grow_object_hash(struct repository *r)
 {
-	int i;
+	struct parsed_object_pool *o = r->parsed_objects;
 	/*
 	 * Note that this size must always be power-of-2 to match hash_obj
 	 * above.
 	 */
-	int new_hash_size = r->parsed_objects->obj_hash_size < 32 ? 32 : 2 * r->parsed_objects->obj_hash_size;
-	struct object **new_hash;
+	int new_hash_size = o->obj_hash_size < 32 ? 32 : 2 * o->obj_hash_size;
 
-	new_hash = xcalloc(new_hash_size, sizeof(struct object *));
-	for (i = 0; i < r->parsed_objects->obj_hash_size; i++) {
-		struct object *obj = r->parsed_objects->obj_hash[i];
+	finish_obj_hash_migration(o);
+	o->old_obj_hash = o->obj_hash;
+	o->old_obj_hash_tag = o->obj_hash_tag;
+	o->old_obj_hash_size = o->obj_hash_size;
+	o->old_obj_hash_pos = 0;
 
-		if (!obj)
-			continue;
-		insert_obj_hash(obj, new_hash, new_hash_size);
-	}
-	free(r->parsed_objects->obj_hash);
-	r->parsed_objects->obj_hash = new_hash;
-	r->parsed_objects->obj_hash_size = new_hash_size;
+	o->obj_hash = xcalloc(new_hash_size, sizeof(struct object *));
+	o->obj_hash_tag = xcalloc(new_hash_size, 1);
+	o->obj_hash_size = new_hash_size;
 }
 
 void *create_object(struct repository *r, const unsigned char *sha1, void *o)
 {
+	struct parsed_object_pool *pool = r->parsed_objects;
 	struct object *obj = o;
 
 	obj->parsed = 0;
 	obj->flags = 0;
 	hashcpy(obj->oid.hash, sha1);
 
-	if (r->parsed_objects->obj_hash_size - 1 <= r->parsed_objects->nr_objs * 2)
+	if (pool->obj_hash_size - 1 <= pool->nr_objs * 2)
 		grow_object_hash(r);
+	else if (pool->old_obj_hash)
+		migrate_obj_hash(pool, OBJ_HASH_MIGRATE_STEP);
 
-	insert_obj_hash(obj, r->parsed_objects->obj_hash,
-			r->parsed_objects->obj_hash_size);
-	r->parsed_objects->nr_objs++;
+	insert_obj_hash(obj, pool->obj_hash, pool->obj_hash_tag,
+			pool->obj_hash_size);
+	pool->nr_objs++;
 	return obj;
 }
 
@@ -436,6 +509,8 @@ void clear_object_flags(unsigned flags)
 {
 	int i;
 
+	finish_obj_hash_migration(the_repository->parsed_objects);
+
 	for (i=0; i < the_repository->parsed_objects->obj_hash_size; i++) {
 		struct object *obj = the_repository->parsed_objects->obj_hash[i];
 		if (obj)
@@ -447,6 +522,8 @@ void clear_commit_marks_all(unsigned int flags)
 {
 	int i;
 
+	finish_obj_hash_migration(the_repository->parsed_objects);
+
 	for (i = 0; i < the_repository->parsed_objects->obj_hash_size; i++) {
 		struct object *obj = the_repository->parsed_objects->obj_hash[i];
 		if (obj && obj->type == OBJ_COMMIT)
@@ -531,6 +608,7 @@ void parsed_object_pool_clear(struct parsed_object_pool *o)
 	 */
 	unsigned i;
 
+	finish_obj_hash_migration(o);
 	for (i = 0; i < o->obj_hash_size; i++) {
 		struct object *obj = o->obj_hash[i];
 
@@ -546,6 +624,7 @@ void parsed_object_pool_clear(struct parsed_object_pool *o)
 	}
 
 	FREE_AND_NULL(o->obj_hash);
+	FREE_AND_NULL(o->obj_hash_tag);
 	o->obj_hash_size = 0;
 
 	free_commit_buffer_slab(o->buffer_slab);
@@ -6,9 +6,25 @@
 struct buffer_slab;
 
 struct parsed_object_pool {
+	/*
+	 * Open-addressed hash of all parsed objects.  obj_hash_tag[i]
+	 * holds a one-byte fragment of the object name stored in
+	 * obj_hash[i] (or 0 for an empty slot), so probing rarely needs
+	 * to dereference the object itself.
+	 */
 	struct object **obj_hash;
+	unsigned char *obj_hash_tag;
 	int nr_objs, obj_hash_size;
 
+	/*
+	 * When obj_hash grows, the previous table is kept here and its
+	 * entries are moved over a few buckets at a time by
+	 * create_object(), instead of rehashing everything at once.
+	 */
+	struct object **old_obj_hash;
+	unsigned char *old_obj_hash_tag;
+	int old_obj_hash_size, old_obj_hash_pos;
+
 	/* TODO: migrate alloc_states to mem-pool? */
 	struct alloc_state *blob_state;
 	struct alloc_state *tree_state;
@@ -62,7 +78,9 @@ struct object_array {
  * revision.h:               0---------10                              2526
  * fetch-pack.c:             01
  * negotiator/default.c:       2--5
- * walker.c:                 0-2
+ * negotiator/skipping.c:      2--5
+ * negotiator/bisecting.c:     2--5
+ * walker.c:                 0--3
  * upload-pack.c:                4       11-----14  16-----19
  * builtin/blame.c:                        12-13
  * bisect.c:                                        16
@@ -75,6 +93,7 @@ struct object_array {
  * builtin/index-pack.c:                                     2021
  * builtin/pack-objects.c:                                   20
  * builtin/reflog.c:                   10--12
+ * builtin/receive-pack.c:                                       2223
  * builtin/show-branch.c:    0-------------------------------------------26
  * builtin/unpack-objects.c:                                 2021
  */
@@ -354,6 +354,19 @@ struct bitmap_index *prepare_bitmap_git(void)
 	return NULL;
 }
 
+static struct bitmap_index *preloaded_bitmap_git;
+static int no_bitmap_to_preload;
+
+struct bitmap_index *preload_bitmap_index(void)
+{
+	if (!preloaded_bitmap_git && !no_bitmap_to_preload) {
+		preloaded_bitmap_git = prepare_bitmap_git();
+		if (!preloaded_bitmap_git)
+			no_bitmap_to_preload = 1;
+	}
+	return preloaded_bitmap_git;
+}
+
 struct include_data {
 	struct bitmap_index *bitmap_git;
 	struct bitmap *base;
@@ -687,11 +700,19 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs)
 	struct bitmap *wants_bitmap = NULL;
 	struct bitmap *haves_bitmap = NULL;
 
-	struct bitmap_index *bitmap_git = xcalloc(1, sizeof(*bitmap_git));
-	/* try to open a bitmapped pack, but don't parse it yet
-	 * because we may not need to use it */
-	if (open_pack_bitmap(bitmap_git) < 0)
-		goto cleanup;
+	struct bitmap_index *bitmap_git;
+
+	if (preloaded_bitmap_git) {
+		/* the walk consumes it; see preload_bitmap_index() */
+		bitmap_git = preloaded_bitmap_git;
+		preloaded_bitmap_git = NULL;
+	} else {
+		bitmap_git = xcalloc(1, sizeof(*bitmap_git));
+		/* try to open a bitmapped pack, but don't parse it yet
+		 * because we may not need to use it */
+		if (open_pack_bitmap(bitmap_git) < 0)
+			goto cleanup;
+	}
 
 	for (i = 0; i < revs->pending.nr; ++i) {
 		struct object *object = revs->pending.objects[i].item;
@@ -735,7 +756,7 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs)
 	 * from disk. this is the point of no return; after this the rev_list
 	 * becomes invalidated and we must perform the revwalk through bitmaps
 	 */
-	if (load_pack_bitmap(bitmap_git) < 0)
+	if (!bitmap_git->bitmaps && load_pack_bitmap(bitmap_git) < 0)
 		goto cleanup;
 
 	object_array_clear(&revs->pending);
@@ -1115,6 +1136,87 @@ void free_bitmap_index(struct bitmap_index *b)
 	free(b);
 }
 
+int bitmap_filter_reachable(struct bitmap_index *bitmap_git,
+			    struct commit **tips, int nr_tips,
+			    struct commit **commits, int nr)
+{
+	struct bitmap *reachable = NULL;
+	int i, left = 0;
+
+	for (i = 0; i < nr_tips; i++) {
+		khiter_t pos = kh_get_sha1(bitmap_git->bitmaps,
+					   tips[i]->object.oid.hash);
+		struct ewah_bitmap *or_with;
+
+		if (pos >= kh_end(bitmap_git->bitmaps))
+			continue;
+		or_with = lookup_stored_bitmap(kh_value(bitmap_git->bitmaps, pos));
+		if (!reachable)
+			reachable = ewah_to_bitmap(or_with);
+		else
+			bitmap_or_ewah(reachable, or_with);
+	}
+	if (!reachable)
+		return nr;
+
+	for (i = 0; i < nr; i++) {
+		int pos = bitmap_position_packfile(bitmap_git,
+						   commits[i]->object.oid.hash);
+		if (pos < 0 || !bitmap_get(reachable, pos))
+			commits[left++] = commits[i];
+	}
+	bitmap_free(reachable);
+	return left;
+}
+
+int bitmap_commit_reaches_any(struct bitmap_index *bitmap_git,
+			      struct commit *commit,
+			      const struct object_array *objs,
+			      struct bitmap_reach *reach)
+{
+	unsigned int i;
+
+	if (reach->found)
+		return 1;
+	if (reach->no_bitmap)
+		return -1;
+	if (!reach->reachable) {
+		khiter_t hash_pos = kh_get_sha1(bitmap_git->bitmaps,
+						commit->object.oid.hash);
+
+		if (hash_pos >= kh_end(bitmap_git->bitmaps)) {
+			reach->no_bitmap = 1;
+			return -1;
+		}
+		reach->reachable = ewah_to_bitmap(lookup_stored_bitmap(
+					kh_value(bitmap_git->bitmaps, hash_pos)));
+	}
+
+	for (i = reach->nr_checked; i < objs->nr; i++) {
+		int pos = bitmap_position_packfile(bitmap_git,
+					objs->objects[i].item->oid.hash);
+		if (pos < 0)
+			reach->unknown = 1;
+		else if (bitmap_get(reach->reachable, pos)) {
+			reach->found = 1;
+			break;
+		}
+	}
+	reach->nr_checked = i;
+
+	if (reach->found) {
+		bitmap_reach_release(reach);
+		return 1;
+	}
+	return reach->unknown ? -1 : 0;
+}
+
+void bitmap_reach_release(struct bitmap_reach *reach)
+{
+	bitmap_free(reach->reachable);
+	reach->reachable = NULL;
+}
+
 int bitmap_has_sha1_in_uninteresting(struct bitmap_index *bitmap_git,
 				     const unsigned char *sha1)
 {
@@ -46,6 +46,20 @@ void traverse_bitmap_commit_list(struct bitmap_index *,
 				 show_reachable_fn show_reachable);
 void test_bitmap_walk(struct rev_info *revs);
 struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs);
+
+/*
+ * Open and load the bitmap index ahead of time, for the next call to
+ * prepare_bitmap_walk() to use (and consume).  A process that forks a
+ * child for every walk, like upload-pack with
+ * uploadpack.packObjectsInProcess, calls this once so that each child
+ * finds the index already loaded.  Returns NULL if there is no usable
+ * bitmap index.
+ *
+ * Until it is consumed, the returned index can also be used for
+ * lookups that do not walk, like bitmap_filter_reachable() and
+ * bitmap_commit_reaches_any(); it must not be freed.
+ */
+struct bitmap_index *preload_bitmap_index(void);
 int reuse_partial_packfile_from_bitmap(struct bitmap_index *,
 				       struct packed_git **packfile,
 				       uint32_t *entries, off_t *up_to);
@@ -60,6 +74,47 @@ void free_bitmap_index(struct bitmap_index *);
  */
 int bitmap_has_sha1_in_uninteresting(struct bitmap_index *, const unsigned char *sha1);
 
+/*
+ * Remove from the "nr" commits in "commits" those that the bitmaps of
+ * the "tips" show to be reachable from one of them, and return how many
+ * are left.  Only the tips that have a bitmap of their own count, so
+ * the commits that are left may still be reachable.
+ */
+int bitmap_filter_reachable(struct bitmap_index *,
+			    struct commit **tips, int nr_tips,
+			    struct commit **commits, int nr);
+
+/*
+ * What bitmap_commit_reaches_any() learned about a commit so far.  The
+ * bitmap of the commit is inflated on the first call and kept, and
+ * later calls only look at the objects added to "objs" since.  Start
+ * from a zeroed struct.
+ */
+struct bitmap_reach {
+	struct bitmap *reachable;
+	unsigned int nr_checked;
+	unsigned found : 1,
+		 unknown : 1,
+		 no_bitmap : 1;
+};
+
+/*
+ * Returns 1 if "commit" can reach one of the objects in "objs"
+ * according to its bitmap, 0 if it cannot, and -1 if that cannot be
+ * told: "commit" has no bitmap of its own, or some of "objs" are not
+ * in the bitmapped pack.  "objs" may only grow between the calls made
+ * with the same "reach".
+ */
+int bitmap_commit_reaches_any(struct bitmap_index *, struct commit *commit,
+			      const struct object_array *objs,
+			      struct bitmap_reach *reach);
+
+/*
+ * Free the bitmap kept in "reach"; the next call for it inflates the
+ * bitmap again, but still skips the objects it already looked at.
+ */
+void bitmap_reach_release(struct bitmap_reach *reach);
+
 void bitmap_writer_show_progress(int show);
 void bitmap_writer_set_checksum(unsigned char *sha1);
 void bitmap_writer_build_type_index(struct packing_data *to_pack,
@@ -555,12 +555,21 @@ struct ref_transaction *ref_transaction_begin(struct strbuf *err);
  */
 #define REF_FORCE_CREATE_REFLOG (1 << 1)
 
+/*
+ * Store the new value of the reference in the `packed-refs` file
+ * rather than as a loose reference, if the reference store has one.
+ * All such updates of a transaction are written with a single rewrite
+ * of `packed-refs`, which is cheaper than writing many loose refs in
+ * one go. Symbolic refs are still updated as loose refs.
+ */
+#define REF_WRITE_PACKED (1 << 10)
+
 /*
  * Bitmask of all of the flags that are allowed to be passed in to
  * ref_transaction_update() and friends:
  */
 #define REF_TRANSACTION_UPDATE_ALLOWED_FLAGS \
-	(REF_NO_DEREF | REF_FORCE_CREATE_REFLOG)
+	(REF_NO_DEREF | REF_FORCE_CREATE_REFLOG | REF_WRITE_PACKED)
 
 /*
  * Add a reference update to transaction. `new_oid` is the value that
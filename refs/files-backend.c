@@ -14,9 +14,9 @@
 /*
  * This backend uses the following flags in `ref_update::flags` for
  * internal bookkeeping purposes. Their numerical values must not
- * conflict with REF_NO_DEREF, REF_FORCE_CREATE_REFLOG, REF_HAVE_NEW,
- * REF_HAVE_OLD, or REF_IS_PRUNING, which are also stored in
- * `ref_update::flags`.
+ * conflict with REF_NO_DEREF, REF_FORCE_CREATE_REFLOG, REF_WRITE_PACKED,
+ * REF_HAVE_NEW, REF_HAVE_OLD, or REF_IS_PRUNING, which are also stored
+ * in `ref_update::flags`.
  */
 
 /*
@@ -56,6 +56,14 @@
  */
 #define REF_DELETED_LOOSE (1 << 9)
 
+/*
+ * Used as a flag in ref_update::flags when the new value of the
+ * reference is written to `packed-refs` (see REF_WRITE_PACKED): the
+ * loose reference is only locked, and deleted once `packed-refs` has
+ * been written.
+ */
+#define REF_NEEDS_PACKING (1 << 11)
+
 struct ref_lock {
 	char *ref_name;
 	struct lock_file lk;
@@ -2448,6 +2456,13 @@ static int lock_ref_for_update(struct files_ref_store *refs,
 			 * The reference already has the desired
 			 * value, so we don't need to write it.
 			 */
+		} else if ((update->flags & REF_WRITE_PACKED) &&
+			   !(update->type & REF_ISSYMREF)) {
+			/*
+			 * files_transaction_prepare() adds the new
+			 * value to the packed-refs transaction.
+			 */
+			update->flags |= REF_NEEDS_PACKING;
 		} else if (write_ref_to_lockfile(lock, &update->new_oid,
 						 err)) {
 			char *write_err = strbuf_detach(err, NULL);
@@ -2606,6 +2621,22 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 		FREE_AND_NULL(head_ref);
 	}
 
+	/*
+	 * If new values are to be written to packed-refs, lock it
+	 * first: as long as we hold its lock, reading references does
+	 * not need to stat() it again for each of them.
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		if (!(transaction->updates[i]->flags & REF_WRITE_PACKED))
+			continue;
+		if (packed_refs_lock(refs->packed_ref_store, 0, err)) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto cleanup;
+		}
+		backend_data->packed_refs_locked = 1;
+		break;
+	}
+
 	/*
 	 * Acquire all locks, verify old values if provided, check
 	 * that new values are valid, and write new values to the
@@ -2622,12 +2653,13 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 		if (ret)
 			goto cleanup;
 
-		if (update->flags & REF_DELETING &&
-		    !(update->flags & REF_LOG_ONLY) &&
-		    !(update->flags & REF_IS_PRUNING)) {
+		if ((update->flags & REF_NEEDS_PACKING) ||
+		    (update->flags & REF_DELETING &&
+		     !(update->flags & REF_LOG_ONLY) &&
+		     !(update->flags & REF_IS_PRUNING))) {
 			/*
-			 * This reference has to be deleted from
-			 * packed-refs if it exists there.
+			 * This reference has to be written to, or
+			 * deleted from packed-refs if it exists there.
 			 */
 			if (!packed_transaction) {
 				packed_transaction = ref_store_transaction_begin(
@@ -2650,7 +2682,8 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 	}
 
 	if (packed_transaction) {
-		if (packed_refs_lock(refs->packed_ref_store, 0, err)) {
+		if (!backend_data->packed_refs_locked &&
+		    packed_refs_lock(refs->packed_ref_store, 0, err)) {
 			ret = TRANSACTION_GENERIC_ERROR;
 			goto cleanup;
 		}
@@ -2715,6 +2748,7 @@ static int files_transaction_finish(struct ref_store *ref_store,
 		struct ref_lock *lock = update->backend_data;
 
 		if (update->flags & REF_NEEDS_COMMIT ||
+		    update->flags & REF_NEEDS_PACKING ||
 		    update->flags & REF_LOG_ONLY) {
 			if (files_log_ref_write(refs,
 						lock->ref_name,
@@ -2770,7 +2804,8 @@ static int files_transaction_finish(struct ref_store *ref_store,
 	 * Perform deletes now that updates are safely completed.
 	 *
 	 * First delete any packed versions of the references, while
-	 * retaining the packed-refs lock:
+	 * retaining the packed-refs lock (this also writes the new
+	 * values of the REF_NEEDS_PACKING updates):
 	 */
 	if (packed_transaction) {
 		ret = ref_transaction_commit(packed_transaction, err);
@@ -2781,13 +2816,25 @@ static int files_transaction_finish(struct ref_store *ref_store,
 			goto cleanup;
 	}
 
-	/* Now delete the loose versions of the references: */
+	/*
+	 * Now delete the loose versions of the references, including
+	 * those of the references that now live in packed-refs:
+	 */
 	for (i = 0; i < transaction->nr; i++) {
 		struct ref_update *update = transaction->updates[i];
 		struct ref_lock *lock = update->backend_data;
 
-		if (update->flags & REF_DELETING &&
-		    !(update->flags & REF_LOG_ONLY)) {
+		if ((update->flags & REF_NEEDS_PACKING) &&
+		    is_null_oid(&lock->old_oid)) {
+			/*
+			 * There was no loose reference, but taking
+			 * its lock may have created empty parent
+			 * directories, which are removed below.
+			 */
+			update->flags |= REF_DELETED_LOOSE;
+		} else if ((update->flags & REF_NEEDS_PACKING) ||
+			   (update->flags & REF_DELETING &&
+			    !(update->flags & REF_LOG_ONLY))) {
 			if (!(update->type & REF_ISPACKED) ||
 			    update->type & REF_ISSYMREF) {
 				/* It is a loose reference. */
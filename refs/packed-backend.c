@@ -1306,7 +1306,9 @@ int is_packed_transaction_needed(struct ref_store *ref_store,
 	 * Neither of these cases will come up in the current code,
 	 * because the only caller of this function passes to it a
 	 * transaction that only includes `delete` updates with no
-	 * `old_id`. Even if that ever changes, false positives only
+	 * `old_id`, and updates setting the new value of references
+	 * written with REF_WRITE_PACKED, which differs from their old
+	 * value. Even if that ever changes, false positives only
 	 * cause an optimization to be missed; they do not affect
 	 * correctness.
 	 */
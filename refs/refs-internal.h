@@ -15,9 +15,9 @@ struct ref_transaction;
 
 /*
  * The following flags can appear in `ref_update::flags`. Their
- * numerical values must not conflict with those of REF_NO_DEREF and
- * REF_FORCE_CREATE_REFLOG, which are also stored in
- * `ref_update::flags`.
+ * numerical values must not conflict with those of REF_NO_DEREF,
+ * REF_FORCE_CREATE_REFLOG and REF_WRITE_PACKED, which are also stored
+ * in `ref_update::flags`.
  */
 
 /*
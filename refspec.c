@@ -209,7 +209,7 @@ void refspec_ref_prefixes(const struct refspec *rs,
 		const struct refspec_item *item = &rs->items[i];
 		const char *prefix = NULL;
 
-		if (item->exact_sha1)
+		if (item->exact_sha1 && rs->fetch == REFSPEC_FETCH)
 			continue;
 		if (rs->fetch == REFSPEC_FETCH)
 			prefix = item->src;
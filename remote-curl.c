@@ -363,7 +363,7 @@ static struct discovery *discover_refs(const char *service, int for_push)
 	/*
 	 * NEEDSWORK: If we are trying to use protocol v2 and we are planning
 	 * to perform a push, then fallback to v0 since the client doesn't know
-	 * how to push yet using v2.
+	 * how to push using v2 over HTTP yet.
 	 */
 	if (version == protocol_v2 && !strcmp("git-receive-pack", service))
 		version = protocol_v0;
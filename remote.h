@@ -150,6 +150,11 @@ extern struct ref **get_remote_refs(int fd_out, struct packet_reader *reader,
 				    const struct argv_array *ref_prefixes,
 				    const struct string_list *server_options);
 
+/* Used for protocol v2 in order to retrieve the bundle URIs of a remote */
+extern void get_remote_bundle_uris(int fd_out, struct packet_reader *reader,
+				   struct string_list *uris,
+				   const struct string_list *server_options);
+
 int resolve_remote_symref(struct ref *ref, struct ref *list);
 
 /*
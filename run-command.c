@@ -959,6 +959,80 @@ int start_command(struct child_process *cmd)
 	return 0;
 }
 
+#ifdef NO_PTHREADS
+static void git_atexit_clear(void);
+#endif
+
+int start_command_in_fork(struct child_process *cmd,
+			  int (*fn)(int, const char **, const char *))
+{
+#ifdef GIT_WINDOWS_NATIVE
+	cmd->git_cmd = 1;
+	return start_command(cmd);
+#else
+	int fdin[2], fdout[2], fderr[2];
+	int argc;
+
+	if (!cmd->argv)
+		cmd->argv = cmd->args.argv;
+	if (cmd->in >= 0 || cmd->out >= 0 || cmd->err >= 0 ||
+	    cmd->env || cmd->env_array.argc || cmd->dir)
+		BUG("start_command_in_fork only supports piped stdio");
+
+	if (pipe(fdin) < 0)
+		return error_errno("cannot create pipe for %s", cmd->argv[0]);
+	if (pipe(fdout) < 0) {
+		close_pair(fdin);
+		return error_errno("cannot create pipe for %s", cmd->argv[0]);
+	}
+	if (pipe(fderr) < 0) {
+		close_pair(fdin);
+		close_pair(fdout);
+		return error_errno("cannot create pipe for %s", cmd->argv[0]);
+	}
+
+	trace_run_command(cmd);
+
+	/* Flush stdio before fork() to avoid cloning buffers */
+	fflush(NULL);
+
+	cmd->pid = fork();
+	if (cmd->pid < 0) {
+		int saved_errno = errno;
+		close_pair(fdin);
+		close_pair(fdout);
+		close_pair(fderr);
+		errno = saved_errno;
+		return error_errno("fork failed for %s", cmd->argv[0]);
+	}
+	if (!cmd->pid) {
+		dup2(fdin[0], 0);
+		dup2(fdout[1], 1);
+		dup2(fderr[1], 2);
+		close_pair(fdin);
+		close_pair(fdout);
+		close_pair(fderr);
+
+		/* The children of our parent are not ours to clean up. */
+		children_to_clean = NULL;
+#ifdef NO_PTHREADS
+		git_atexit_clear();
+#endif
+		for (argc = 0; cmd->argv[argc]; argc++)
+			; /* count */
+		exit(fn(argc, cmd->argv, NULL));
+	}
+
+	close(fdin[0]);
+	close(fdout[1]);
+	close(fderr[1]);
+	cmd->in = fdin[1];
+	cmd->out = fdout[0];
+	cmd->err = fderr[0];
+	return 0;
+#endif
+}
+
 int finish_command(struct child_process *cmd)
 {
 	int ret = wait_or_whine(cmd->pid, cmd->argv[0], 0);
@@ -54,6 +54,19 @@ void child_process_clear(struct child_process *);
 extern int is_executable(const char *name);
 
 int start_command(struct child_process *);
+
+/*
+ * Run the git builtin "fn" with the arguments in "cmd" in a forked
+ * copy of this process instead of exec'ing "git", so that it starts
+ * with everything this process has already loaded (opened packs,
+ * parsed objects, configuration).  Only piped stdio is supported:
+ * in, out and err must be -1 and are set like start_command() does.
+ * Where fork() is not available, this runs "git" like start_command().
+ * Wait for the child with finish_command().
+ */
+int start_command_in_fork(struct child_process *,
+			  int (*fn)(int, const char **, const char *));
+
 int finish_command(struct child_process *);
 int finish_command_in_signal(struct child_process *);
 int run_command(struct child_process *);
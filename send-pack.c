@@ -226,6 +226,18 @@ static void advertise_shallow_grafts_buf(struct strbuf *sb)
 	for_each_commit_graft(advertise_shallow_grafts_cb, sb);
 }
 
+/*
+ * Whether the server supports this feature of push. Protocol v2
+ * advertises them as the value of the "push" capability.
+ */
+static int server_supports_push(const char *feature,
+				enum protocol_version version)
+{
+	if (version == protocol_v2)
+		return server_supports_feature("push", feature, 0);
+	return server_supports(feature);
+}
+
 #define CHECK_REF_NO_PUSH -1
 #define CHECK_REF_STATUS_REJECTED -2
 #define CHECK_REF_UPTODATE -3
@@ -367,10 +379,63 @@ static void reject_invalid_nonce(const char *nonce, int len)
 	}
 }
 
+/*
+ * Write the protocol v2 "push" request for the updates to send, using
+ * the features in "cap_string", to "req_buf". Return whether there are
+ * any updates.
+ */
+static int push_request_v2(struct strbuf *req_buf,
+			   const struct ref *remote_refs,
+			   struct send_pack_args *args,
+			   const char *cap_string)
+{
+	const struct ref *ref;
+	struct strbuf updates = STRBUF_INIT;
+	int cmds_sent = 0;
+
+	for (ref = remote_refs; ref; ref = ref->next) {
+		if (check_to_send_update(ref, args) < 0)
+			continue;
+		packet_buf_write(&updates, "update %s %s %s\n",
+				 oid_to_hex(&ref->old_oid),
+				 oid_to_hex(&ref->new_oid),
+				 ref->name);
+		cmds_sent = 1;
+	}
+	if (!cmds_sent)
+		goto out;
+
+	packet_buf_write(req_buf, "command=push\n");
+	if (server_supports_v2("agent", 0))
+		packet_buf_write(req_buf, "agent=%s",
+				 git_user_agent_sanitized());
+	packet_buf_delim(req_buf);
+	if (parse_feature_request(cap_string, "report-status"))
+		packet_buf_write(req_buf, "report-status\n");
+	if (parse_feature_request(cap_string, "quiet"))
+		packet_buf_write(req_buf, "quiet\n");
+	if (parse_feature_request(cap_string, "atomic"))
+		packet_buf_write(req_buf, "atomic\n");
+	if (parse_feature_request(cap_string, "push-options")) {
+		struct string_list_item *item;
+
+		for_each_string_list_item(item, args->push_options)
+			packet_buf_write(req_buf, "push-option %s\n",
+					 item->string);
+	}
+	advertise_shallow_grafts_buf(req_buf);
+	strbuf_addbuf(req_buf, &updates);
+	packet_buf_flush(req_buf);
+out:
+	strbuf_release(&updates);
+	return cmds_sent;
+}
+
 int send_pack(struct send_pack_args *args,
 	      int fd[], struct child_process *conn,
 	      struct ref *remote_refs,
-	      struct oid_array *extra_have)
+	      struct oid_array *extra_have,
+	      enum protocol_version version)
 {
 	int in = fd[0];
 	int out = fd[1];
@@ -393,28 +458,30 @@ int send_pack(struct send_pack_args *args,
 	const char *push_cert_nonce = NULL;
 
 	/* Does the other end support the reporting? */
-	if (server_supports("report-status"))
+	if (server_supports_push("report-status", version))
 		status_report = 1;
-	if (server_supports("delete-refs"))
+	if (server_supports_push("delete-refs", version))
 		allow_deleting_refs = 1;
-	if (server_supports("ofs-delta"))
+	if (server_supports_push("ofs-delta", version))
 		args->use_ofs_delta = 1;
-	if (server_supports("side-band-64k"))
+	if (version == protocol_v2 || server_supports("side-band-64k"))
 		use_sideband = 1;
-	if (server_supports("quiet"))
+	if (server_supports_push("quiet", version))
 		quiet_supported = 1;
 	if (server_supports("agent"))
 		agent_supported = 1;
-	if (server_supports("no-thin"))
+	if (server_supports_push("no-thin", version))
 		args->use_thin_pack = 0;
-	if (server_supports("atomic"))
+	if (server_supports_push("atomic", version))
 		atomic_supported = 1;
-	if (server_supports("push-options"))
+	if (server_supports_push("push-options", version))
 		push_options_supported = 1;
 
 	if (args->push_cert != SEND_PACK_PUSH_CERT_NEVER) {
 		int len;
-		push_cert_nonce = server_feature_value("push-cert", &len);
+		/* there are no signed pushes in protocol v2 (yet) */
+		if (version != protocol_v2)
+			push_cert_nonce = server_feature_value("push-cert", &len);
 		if (push_cert_nonce) {
 			reject_invalid_nonce(push_cert_nonce, len);
 			push_cert_nonce = xmemdupz(push_cert_nonce, len);
@@ -464,7 +531,7 @@ int send_pack(struct send_pack_args *args,
 		if (ref->deletion && !allow_deleting_refs)
 			ref->status = REF_STATUS_REJECT_NODELETE;
 
-	if (!args->dry_run)
+	if (!args->dry_run && version != protocol_v2)
 		advertise_shallow_grafts_buf(&req_buf);
 
 	if (!args->dry_run && push_cert_nonce)
@@ -506,10 +573,14 @@ int send_pack(struct send_pack_args *args,
 	/*
 	 * Finally, tell the other end!
 	 */
+	if (version == protocol_v2 && !args->dry_run)
+		cmds_sent = push_request_v2(&req_buf, remote_refs, args,
+					    cap_buf.buf);
 	for (ref = remote_refs; ref; ref = ref->next) {
 		char *old_hex, *new_hex;
 
-		if (args->dry_run || push_cert_nonce)
+		if (args->dry_run || push_cert_nonce ||
+		    version == protocol_v2)
 			continue;
 
 		if (check_to_send_update(ref, args) < 0)
@@ -529,7 +600,7 @@ int send_pack(struct send_pack_args *args,
 		}
 	}
 
-	if (use_push_options) {
+	if (use_push_options && version != protocol_v2) {
 		struct string_list_item *item;
 
 		packet_buf_flush(&req_buf);
@@ -544,7 +615,9 @@ int send_pack(struct send_pack_args *args,
 		}
 	} else {
 		write_or_die(out, req_buf.buf, req_buf.len);
-		packet_flush(out);
+		/* a protocol v2 request ends with its own flush */
+		if (version != protocol_v2)
+			packet_flush(out);
 	}
 	strbuf_release(&req_buf);
 	strbuf_release(&cap_buf);
@@ -2,6 +2,7 @@
 #define SEND_PACK_H
 
 #include "string-list.h"
+#include "protocol.h"
 
 struct child_process;
 struct oid_array;
@@ -36,6 +37,7 @@ int option_parse_push_signed(const struct option *opt,
 
 int send_pack(struct send_pack_args *args,
 	      int fd[], struct child_process *conn,
-	      struct ref *remote_refs, struct oid_array *extra_have);
+	      struct ref *remote_refs, struct oid_array *extra_have,
+	      enum protocol_version version);
 
 #endif
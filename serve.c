@@ -4,6 +4,7 @@
 #include "pkt-line.h"
 #include "version.h"
 #include "argv-array.h"
+#include "bundle-uri.h"
 #include "ls-refs.h"
 #include "serve.h"
 #include "upload-pack.h"
@@ -50,15 +51,52 @@ struct protocol_capability {
 	int (*command)(struct repository *r,
 		       struct argv_array *keys,
 		       struct packet_reader *request);
+
+	/*
+	 * Whether upload-pack (SERVE_FETCH), receive-pack (SERVE_PUSH) or
+	 * both offer this capability.
+	 */
+	unsigned services;
 };
 
+#define SERVE_FETCH	(1u << 0)
+#define SERVE_PUSH	(1u << 1)
+
+static const struct serve_options *serving;
+
+static int push_advertise(struct repository *r, struct strbuf *value)
+{
+	return serving->push_advertise(r, value);
+}
+
+static int push(struct repository *r, struct argv_array *keys,
+		struct packet_reader *request)
+{
+	return serving->push(r, keys, request);
+}
+
+/* Hide the refs that the service we are serving for hides. */
+static int serve_ls_refs(struct repository *r, struct argv_array *keys,
+			 struct packet_reader *request)
+{
+	return ls_refs(r, keys, request,
+		       serving->push ? "receive" : "uploadpack");
+}
+
 static struct protocol_capability capabilities[] = {
-	{ "agent", agent_advertise, NULL },
-	{ "ls-refs", always_advertise, ls_refs },
-	{ "fetch", upload_pack_advertise, upload_pack_v2 },
-	{ "server-option", always_advertise, NULL },
+	{ "agent", agent_advertise, NULL, SERVE_FETCH | SERVE_PUSH },
+	{ "ls-refs", always_advertise, serve_ls_refs, SERVE_FETCH | SERVE_PUSH },
+	{ "fetch", upload_pack_advertise, upload_pack_v2, SERVE_FETCH },
+	{ "push", push_advertise, push, SERVE_PUSH },
+	{ "server-option", always_advertise, NULL, SERVE_FETCH | SERVE_PUSH },
+	{ "bundle-uri", bundle_uri_advertise, bundle_uri_command, SERVE_FETCH },
 };
 
+static int is_offered(const struct protocol_capability *c)
+{
+	return c->services & (serving->push ? SERVE_PUSH : SERVE_FETCH);
+}
+
 static void advertise_capabilities(void)
 {
 	struct strbuf capability = STRBUF_INIT;
@@ -68,7 +106,7 @@ static void advertise_capabilities(void)
 	for (i = 0; i < ARRAY_SIZE(capabilities); i++) {
 		struct protocol_capability *c = &capabilities[i];
 
-		if (c->advertise(the_repository, &value)) {
+		if (is_offered(c) && c->advertise(the_repository, &value)) {
 			strbuf_addstr(&capability, c->name);
 
 			if (value.len) {
@@ -99,7 +137,8 @@ static struct protocol_capability *get_capability(const char *key)
 	for (i = 0; i < ARRAY_SIZE(capabilities); i++) {
 		struct protocol_capability *c = &capabilities[i];
 		const char *out;
-		if (skip_prefix(key, c->name, &out) && (!*out || *out == '='))
+		if (is_offered(c) && skip_prefix(key, c->name, &out) &&
+		    (!*out || *out == '='))
 			return c;
 	}
 
@@ -231,6 +270,8 @@ static int process_request(void)
 /* Main serve loop for protocol version 2 */
 void serve(struct serve_options *options)
 {
+	serving = options;
+
 	if (options->advertise_capabilities || !options->stateless_rpc) {
 		/* serve by default supports v2 */
 		packet_write_fmt(1, "version 2\n");
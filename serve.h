@@ -2,12 +2,24 @@
 #define SERVE_H
 
 struct argv_array;
+struct packet_reader;
+struct repository;
+struct strbuf;
 extern int has_capability(const struct argv_array *keys, const char *capability,
 			  const char **value);
 
 struct serve_options {
 	unsigned advertise_capabilities;
 	unsigned stateless_rpc;
+
+	/*
+	 * If set, serve the "push" command with these functions instead of
+	 * the commands fetching from the repository. They are called as
+	 * the "advertise" and "command" functions of a capability are.
+	 */
+	int (*push_advertise)(struct repository *r, struct strbuf *value);
+	int (*push)(struct repository *r, struct argv_array *keys,
+		    struct packet_reader *request);
 };
 #define SERVE_OPTIONS_INIT { 0 }
 extern void serve(struct serve_options *options);
@@ -0,0 +1,52 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "tree.h"
+#include "merge-recursive.h"
+#include "merge-in-memory.h"
+
+/*
+ * Usage: test-tool merge-in-memory <base> <ours> <theirs>
+ *
+ * Prints the merged tree, followed by the type and path of each
+ * conflict.  Exits with 1 if there were conflicts.
+ */
+int cmd__merge_in_memory(int argc, const char **argv)
+{
+	struct merge_options o;
+	struct merge_in_memory_result result = MERGE_IN_MEMORY_RESULT_INIT;
+	struct string_list_item *item;
+	struct tree *trees[3];
+	int i, ret;
+
+	if (argc != 4)
+		die("usage: test-tool merge-in-memory <base> <ours> <theirs>");
+
+	setup_git_directory();
+
+	for (i = 0; i < 3; i++) {
+		struct object_id oid;
+
+		if (get_oid(argv[i + 1], &oid))
+			die("cannot parse %s as an object name", argv[i + 1]);
+		trees[i] = parse_tree_indirect(&oid);
+		if (!trees[i])
+			die("not a tree-ish %s", argv[i + 1]);
+	}
+
+	init_merge_options(&o);
+	o.ancestor = argv[1];
+	o.branch1 = argv[2];
+	o.branch2 = argv[3];
+
+	ret = merge_trees_in_memory(&o, trees[1], trees[2], trees[0], &result);
+	if (ret < 0)
+		return 128;
+
+	printf("%s\n", oid_to_hex(&result.tree));
+	for_each_string_list_item(item, &result.conflicts) {
+		struct merge_conflict *c = item->util;
+		printf("%s %s\n", c->type, item->string);
+	}
+	merge_in_memory_result_release(&result);
+	return !ret;
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+test_description='Test operations that stress the parsed object hash.
+
+Every object seen by a traversal is looked up in (and usually inserted
+into) the in-core object hash, so these numbers mostly depend on the
+number of objects in the test repository.  Use a large repository to
+see the effect of the hash growing many times during a single walk.
+'
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_perf 'rev-list --all --objects' '
+	git rev-list --all --objects >/dev/null
+'
+
+# every object is looked up again from its pack index, most of them
+# already being present in the hash
+test_perf 'rev-list --all --objects --use-bitmap-index' '
+	git rev-list --all --objects --use-bitmap-index >/dev/null
+'
+
+test_perf 'fsck --connectivity-only' '
+	git fsck --connectivity-only
+'
+
+test_done
@@ -0,0 +1,74 @@
+#!/bin/sh
+
+test_description='Tests rebase performance with in-memory merges
+
+This replays the same series as p3400-rebase.sh, once with "git rebase"
+and once by merging trees in memory, checking out the result only at
+the end.'
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+# Replay the commits in "$1..HEAD" on top of "$2" with in-memory merges,
+# then move the current branch (and the working tree) to the result.
+replay_in_memory () {
+	onto=$(git rev-parse "$2") &&
+	git rev-list --reverse "$1..HEAD" >commits &&
+	while read commit
+	do
+		tree=$(test-tool merge-in-memory $commit^ $onto $commit) &&
+		onto=$(git commit-tree -p $onto -m "$commit" $tree) ||
+		return 1
+	done <commits &&
+	git reset -q --keep $onto
+}
+
+test_expect_success 'setup rebasing on top of a lot of changes' '
+	git checkout -f -b base &&
+	git checkout -b to-rebase &&
+	git checkout -b upstream &&
+	for i in $(seq 100)
+	do
+		# simulate huge diffs
+		echo change$i >unrelated-file$i &&
+		seq 1000 >>unrelated-file$i &&
+		git add unrelated-file$i &&
+		test_tick &&
+		git commit -m commit$i unrelated-file$i &&
+		echo change$i >unrelated-file$i &&
+		seq 1000 | tac >>unrelated-file$i &&
+		git add unrelated-file$i &&
+		test_tick &&
+		git commit -m commit$i-reverse unrelated-file$i ||
+		break
+	done &&
+	git checkout to-rebase &&
+	test_commit our-patch interesting-file
+'
+
+test_perf 'rebase on top of a lot of unrelated changes' '
+	git rebase --onto upstream HEAD^ &&
+	git rebase --onto base HEAD^
+'
+
+test_perf 'in-memory rebase on top of a lot of unrelated changes' '
+	replay_in_memory HEAD^ upstream &&
+	replay_in_memory HEAD^ base
+'
+
+test_expect_success 'setup rebasing many changes' '
+	git checkout -b upstream2 to-rebase &&
+	git checkout -b to-rebase2 upstream
+'
+
+test_perf 'rebase a lot of unrelated changes' '
+	git rebase --onto upstream2 base &&
+	git rebase --onto base upstream2
+'
+
+test_perf 'in-memory rebase a lot of unrelated changes' '
+	replay_in_memory base upstream2 &&
+	replay_in_memory upstream2 base
+'
+
+test_done
@@ -26,4 +26,24 @@ test_perf 'log -p -3000 --patience' '
 	git log -p -3000 --patience >/dev/null
 '
 
+test_expect_success 'setup large generated files' '
+	test_seq 500000 |
+	sed "s/.*/generated_value_& = {\"key\": &, \"name\": \"item&\"},/" \
+		>generated.old &&
+	sed "250000s/key/changed/" <generated.old >generated.new
+'
+
+for algo in myers histogram patience
+do
+	test_perf "diff --no-index large generated files ($algo)" "
+		test_expect_code 1 git diff --no-index --diff-algorithm=$algo \
+			generated.old generated.new >/dev/null
+	"
+done
+
+test_perf 'diff --no-index -w large generated files' '
+	test_expect_code 1 git diff --no-index -w \
+		generated.old generated.new >/dev/null
+'
+
 test_done
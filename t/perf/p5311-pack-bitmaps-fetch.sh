@@ -40,6 +40,30 @@ for days in 1 2 4 8 16 32 64 128; do
 	test_perf "client $title" '
 		git index-pack --stdin --fix-thin <tmp.pack
 	'
+
+	# The same fetch as a stateless request to upload-pack, which pays
+	# for starting pack-objects (and loading the packs and bitmaps
+	# anew) on top of the packing itself, for each request.
+	test_expect_success "setup request from $days days ago" '
+		{
+			echo "want $(git rev-parse HEAD) side-band-64k ofs-delta thin-pack no-progress" &&
+			echo 0000 &&
+			echo "have $tip" &&
+			echo done
+		} | test-tool pkt-line pack >request
+	'
+
+	for in_process in false true
+	do
+		test_perf "upload-pack (in-process=$in_process) $title" "
+			for i in 1 2 3 4 5 6 7 8 9 10
+			do
+				git -c uploadpack.packObjectsInProcess=$in_process \
+					upload-pack --stateless-rpc . <request >/dev/null ||
+				return 1
+			done
+		"
+	done
 done
 
 test_done
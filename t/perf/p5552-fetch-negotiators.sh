@@ -0,0 +1,98 @@
+#!/bin/sh
+
+test_description='rounds and bytes of fetch negotiation with many local branches
+
+The client has many branches, each with a few commits of its own on top of
+a different point of a long history, none of which the server advertises.
+We fetch a new commit on top of that history from the server and report how
+many rounds of negotiation it took, how many "have" lines the client sent
+and how large the received pack is, for each negotiation algorithm.
+'
+. ./perf-lib.sh
+
+# create_history <main> <branches> <distance> <local>
+#
+# Make a branch "main" of <main> commits, and <branches> branches "b<n>"
+# forking off every <distance> commits from the tip of "main", each with
+# <local> commits of its own.
+create_history () {
+	perl -le '
+		my ($main, $branches, $distance, $local) = @ARGV;
+		my $date = 1000000000;
+		sub commit {
+			my ($ref, $file, $n, $mark) = @_;
+			print "commit refs/heads/$ref";
+			print "mark :$mark" if $mark;
+			print "committer C O Mitter <committer\@example.com> ",
+			      $date++, " +0000";
+			print "data <<EOF\n$ref $n\nEOF";
+			print "M 100644 inline $file";
+			print "data <<EOF\n$n\nEOF\n";
+		}
+		commit("main", "main", $_, $_) for (1..$main);
+		for my $b (1..$branches) {
+			print "reset refs/heads/b$b";
+			print "from :", $main - $b * $distance, "\n";
+			commit("b$b", "b$b", $_) for (1..$local);
+		}
+	' "$@" |
+	git -C history.git fast-import --quiet
+}
+
+test_expect_success 'setup history' '
+	git init --bare history.git &&
+	create_history 5000 40 100 20
+'
+
+test_expect_success 'setup server' '
+	git init --bare server.git &&
+	git -C server.git fetch ../history.git main:refs/heads/main &&
+	new=$(git -C server.git commit-tree -p main -m new main^{tree}) &&
+	git -C server.git update-ref refs/heads/main $new
+'
+
+test_expect_success 'setup client' '
+	git init --bare client.git &&
+	git -C client.git fetch ../history.git "refs/heads/b*:refs/heads/b*" &&
+	git -C client.git config core.commitGraph true &&
+	git -C client.git commit-graph write --reachable
+'
+
+for protocol in 0 2
+do
+	for algorithm in default skipping bisecting
+	do
+		title="$algorithm, protocol v$protocol"
+
+		test_perf "fetch ($title)" "
+			rm -rf tmp.git trace negotiation &&
+			cp -R client.git tmp.git &&
+			GIT_TRACE_PACKET=\"\$PWD/trace\" \
+			GIT_TRACE_NEGOTIATION=\"\$PWD/negotiation\" \
+			git -C tmp.git \
+				-c protocol.version=$protocol \
+				-c fetch.negotiationAlgorithm=$algorithm \
+				-c fetch.unpackLimit=1 \
+				fetch ../server.git main
+		"
+
+		test_size "rounds ($title)" '
+			sed -n "s/.*upload-pack: \([0-9]*\) negotiation round.*/\1/p" \
+				negotiation | tail -n 1
+		'
+
+		test_size "haves  ($title)" '
+			grep -c "fetch> have" trace
+		'
+
+		test_size "pack   ($title)" '
+			for pack in tmp.git/objects/pack/*.pack
+			do
+				test -f client.git/objects/pack/${pack##*/} ||
+				wc -c <$pack
+			done
+		'
+	done
+done
+
+test_done
@@ -0,0 +1,88 @@
+#!/bin/sh
+
+test_description='cloning over dumb HTTP
+
+We clone a history of commits each touching many files from a repository
+storing all of its objects loose, then from one storing them in one pack
+per commit, both served as static files over HTTP.
+'
+. ./perf-lib.sh
+
+LIB_HTTPD_PORT=${LIB_HTTPD_PORT-5553}
+. "$TEST_DIRECTORY"/lib-httpd.sh
+start_httpd
+
+# create_history <commits> <files>
+#
+# Make a branch "main" of <commits> commits, each changing <files> files
+# spread over a few directories.
+create_history () {
+	perl -le '
+		my ($commits, $files) = @ARGV;
+		my $date = 1000000000;
+		for my $n (1..$commits) {
+			print "commit refs/heads/main";
+			print "committer C O Mitter <committer\@example.com> ",
+			      $date++, " +0000";
+			print "data <<EOF\ncommit $n\nEOF";
+			for my $f (1..$files) {
+				print "M 100644 inline d", $f % 10, "/f$f";
+				print "data <<EOF\n$n $f\nEOF";
+			}
+			print "";
+		}
+	' "$@" |
+	git -C history.git fast-import --quiet
+}
+
+test_expect_success 'setup history' '
+	git init --bare history.git &&
+	create_history 100 100
+'
+
+test_expect_success 'setup repository with loose objects' '
+	repo="$HTTPD_DOCUMENT_ROOT_PATH/loose.git" &&
+	git init --bare "$repo" &&
+	git -C history.git pack-objects --revs --all --stdout </dev/null |
+	git -C "$repo" unpack-objects -q &&
+	git -C "$repo" update-ref refs/heads/main \
+		$(git -C history.git rev-parse main) &&
+	git -C "$repo" symbolic-ref HEAD refs/heads/main &&
+	git -C "$repo" update-server-info
+'
+
+test_expect_success 'setup repository with a pack per commit' '
+	repo="$HTTPD_DOCUMENT_ROOT_PATH/packs.git" &&
+	git init --bare "$repo" &&
+	prev= &&
+	for commit in $(git -C history.git rev-list --reverse main)
+	do
+		{
+			echo $commit &&
+			if test -n "$prev"
+			then
+				echo ^$prev
+			fi
+		} |
+		git -C history.git pack-objects --revs \
+			"$repo/objects/pack/pack" >/dev/null &&
+		prev=$commit || return 1
+	done &&
+	git -C "$repo" update-ref refs/heads/main $prev &&
+	git -C "$repo" symbolic-ref HEAD refs/heads/main &&
+	git -C "$repo" update-server-info
+'
+
+for repo in loose packs
+do
+	for requests in 5 32
+	do
+		test_perf "clone $repo.git ($requests requests)" "
+			rm -rf clone.git &&
+			git -c http.maxRequests=$requests \
+				clone --bare -q $HTTPD_URL/dumb/$repo.git clone.git
+		"
+	done
+done
+
+test_done
@@ -19,5 +19,24 @@ test_perf 'grep --cached, cheap regex' '
 test_perf 'grep --cached, expensive regex' '
 	git grep --cached "^.* *some_nonexistent_string$" || :
 '
+test_perf 'grep 20 revisions, cheap regex' '
+	git grep some_nonexistent_string $(git rev-list -n 20 HEAD) || :
+'
+
+test_expect_success 'build the trigram index' '
+	git -c grep.trigramIndex=true grep --cached some_nonexistent_string || :
+'
+test_perf 'grep worktree, cheap regex, trigram index' '
+	git -c grep.trigramIndex=true grep some_nonexistent_string || :
+'
+test_perf 'grep --cached, cheap regex, trigram index' '
+	git -c grep.trigramIndex=true grep --cached some_nonexistent_string || :
+'
+test_perf 'grep HEAD, cheap regex' '
+	git grep some_nonexistent_string HEAD || :
+'
+test_perf 'grep HEAD, cheap regex, trigram index' '
+	git -c grep.trigramIndex=true grep some_nonexistent_string HEAD || :
+'
 
 test_done
@@ -262,4 +262,86 @@ test_expect_success 'diff-tree -l0 defaults to a big rename limit, not zero' '
 	grep "myotherfile.*myfile" actual
 '
 
+test_expect_success 'files keeping their basename are paired beyond the rename limit' '
+	mkdir from &&
+	for i in 1 2 3
+	do
+		test_seq 20 | sed "s/^/line $i:/" >from/file$i.txt || return 1
+	done &&
+	git add from &&
+	git commit -m "add from/" &&
+
+	mkdir to &&
+	for i in 1 2 3
+	do
+		git mv from/file$i.txt to/ &&
+		echo changed >>to/file$i.txt ||
+		return 1
+	done &&
+	git add to &&
+	git commit -m "move from/ to to/" &&
+
+	git diff-tree -M -l1 -r --name-status HEAD^ HEAD >actual &&
+	cat >expect <<-\EOF &&
+	R095	from/file1.txt	to/file1.txt
+	R095	from/file2.txt	to/file2.txt
+	R095	from/file3.txt	to/file3.txt
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'threaded inexact rename detection' '
+	mkdir one two &&
+	for i in 1 2 3 4
+	do
+		test_write_lines "$i" a b c d e f g h i >one/same &&
+		mkdir one/$i &&
+		test_write_lines "$i" 1 2 3 4 5 6 7 8 9 >one/$i/same ||
+		return 1
+	done &&
+	git add one &&
+	git commit -m "add one/" &&
+
+	git rm -r -q one &&
+	for i in 1 2 3 4
+	do
+		mkdir -p two/$i &&
+		test_write_lines "$i" a b c d e f g x y >two/$i/same &&
+		test_write_lines "$i" 1 2 3 4 5 6 7 x y >two/$i/other ||
+		return 1
+	done &&
+	git add two &&
+	git commit -m "one/ to two/" &&
+
+	git diff-tree -M -r --name-status HEAD^ HEAD >expect &&
+	GIT_TEST_RENAME_THREADS=1 \
+		git diff-tree -M -r --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	grep "^R" actual >renames &&
+	test_line_count = 5 renames
+'
+
+test_expect_success 'diff.renameCache stores signatures on disk' '
+	git diff-tree -M -r --name-status HEAD^ HEAD >expect &&
+	git -c diff.renameCache=true \
+		diff-tree -M -r --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	test_path_is_file .git/objects/info/rename-cache &&
+	git -c diff.renameCache=true \
+		diff-tree -M -r --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'corrupt rename cache is ignored' '
+	echo garbage >.git/objects/info/rename-cache &&
+	git -c diff.renameCache=true \
+		diff-tree -M -r --name-status HEAD^ HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_i18ngrep "ignoring corrupt rename cache" err &&
+	git -c diff.renameCache=true \
+		diff-tree -M -r --name-status HEAD^ HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_must_be_empty err
+'
+
 test_done
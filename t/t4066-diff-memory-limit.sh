@@ -0,0 +1,49 @@
+#!/bin/sh
+
+test_description='diff of large files and diff.memoryLimit'
+
+. ./test-lib.sh
+
+test_expect_success 'setup large files' '
+	test_seq 50000 >old &&
+	sed -e "/^100$/d" -e "s/^25000$/changed/" -e "/^49000$/a\\
+added" <old >new &&
+	sed -e "/^30000$/{h;d;}" -e "/^30001$/G" <new >swapped
+'
+
+test_expect_success 'large files are matched up on their unique lines' '
+	test_expect_code 1 git diff --no-index --minimal old new >expect &&
+	test_expect_code 1 git diff --no-index old new >actual &&
+	test_cmp expect actual &&
+	test_expect_code 1 git -c diff.memoryLimit=1g diff --no-index \
+		old new >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'diff.memoryLimit does not affect isolated changes' '
+	test_expect_code 1 git -c diff.memoryLimit=1m diff --no-index \
+		old new >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'files are shown as a whole if anchoring needs too much' '
+	test_expect_code 1 git -c diff.memoryLimit=1m diff --no-index \
+		old swapped >actual &&
+	test $(grep -c "^-[0-9]" actual) = 3 &&
+	test_expect_code 1 git -c diff.memoryLimit=100k diff --no-index \
+		old swapped >actual &&
+	test $(grep -c "^-[0-9]" actual) -gt 10000
+'
+
+test_expect_success 'regions above diff.memoryLimit are shown as a whole' '
+	test_write_lines first r s r last >pre &&
+	test_write_lines first s r s last >post &&
+	test_expect_code 1 git diff --no-index pre post >full &&
+	test_expect_code 1 git -c diff.memoryLimit=1 diff --no-index \
+		pre post >limited &&
+	grep "^ [rs]$" full &&
+	! grep "^ [rs]$" limited &&
+	test $(grep -c "^[-+][rs]$" limited) = 6
+'
+
+test_done
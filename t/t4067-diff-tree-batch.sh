@@ -0,0 +1,119 @@
+#!/bin/sh
+
+test_description='git diff-tree --batch'
+
+. ./test-lib.sh
+
+# Print the answer "git diff-tree --batch" gives for the diff of "$1"
+# and "$2", with the output of "git diff-tree" given the rest of the
+# arguments as its contents.
+batch_answer () {
+	one=$(git rev-parse "$1^{tree}") &&
+	two=$(git rev-parse "$2^{tree}") &&
+	shift 2 &&
+	git diff-tree $one $two "$@" >contents &&
+	echo "$one $two" $(wc -c <contents) &&
+	cat contents &&
+	echo
+}
+
+test_expect_success 'setup' '
+	mkdir dir &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 >dir/file &&
+	echo other >other &&
+	git add . &&
+	test_tick &&
+	git commit -q -m one &&
+	git tag one &&
+	test_write_lines 1 2 3 4 five 6 7 8 9 >dir/file &&
+	git mv other moved &&
+	test_tick &&
+	git commit -q -a -m two &&
+	git tag two &&
+	echo new >new &&
+	git add new &&
+	test_tick &&
+	git commit -q -m three &&
+	git tag three
+'
+
+test_expect_success 'answers several requests' '
+	{
+		batch_answer one two -r &&
+		batch_answer two three -r
+	} >expect &&
+	printf "one two\ntwo three\n" | git diff-tree -r --batch >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'options of a request replace the output format' '
+	{
+		batch_answer one two -r -p &&
+		batch_answer one three -r --stat -M &&
+		batch_answer one two -r
+	} >expect &&
+	git diff-tree -r --batch >actual <<-\EOF &&
+	one two -p
+	one three --stat -M
+	one two
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'requests can limit the paths' '
+	{
+		batch_answer one three -r --name-only -- dir new &&
+		batch_answer one three -r -- "moved"
+	} >expect &&
+	git diff-tree -r --batch >actual <<-\EOF &&
+	one three --name-only -- dir new
+	one three -- "moved"
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'options of a request do not leak into the next one' '
+	{
+		batch_answer one two -r -p --anchored=5 --patience &&
+		batch_answer one two -r -p --anchored=5 --anchored=7 &&
+		batch_answer one two -r -p --anchored=5 &&
+		batch_answer one three -r -- new &&
+		batch_answer one three -r -- dir
+	} >expect &&
+	{
+		git diff-tree -r -p --anchored=5 --batch <<-\EOF &&
+		one two --patience
+		one two --anchored=7
+		one two
+		EOF
+		git diff-tree -r --batch -- dir <<-\EOF
+		one three -- new
+		one three
+		EOF
+	} >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'bad requests are answered with an error' '
+	{
+		echo "one no-such-rev error" &&
+		echo "one two --no-such-option error" &&
+		echo "one error" &&
+		batch_answer one two -r
+	} >expect &&
+	git diff-tree -r --batch >actual 2>err <<-\EOF &&
+	one no-such-rev
+	one two --no-such-option
+	one
+	one two
+	EOF
+	test_cmp expect actual &&
+	test_i18ngrep "not a tree object: no-such-rev" err
+'
+
+test_expect_success '--batch does not take trees or --stdin' '
+	test_must_fail git diff-tree --batch one two </dev/null &&
+	test_must_fail git diff-tree --batch --stdin </dev/null
+'
+
+test_done
@@ -0,0 +1,139 @@
+#!/bin/sh
+
+test_description='git merge-tree --write-tree'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_write_lines 1 2 3 4 5 6 7 8 9 >numbers &&
+	test_write_lines a b c d e f g h i >letters &&
+	git add . &&
+	test_tick &&
+	git commit -q -m base &&
+	git branch base &&
+
+	git checkout -b side1 &&
+	test_write_lines 1 2 three 4 5 6 7 8 9 >numbers &&
+	git mv letters alphabet &&
+	git add . &&
+	test_tick &&
+	git commit -q -m side1 &&
+
+	git checkout -b side2 base &&
+	test_write_lines 1 2 3 4 5 6 7 eight 9 >numbers &&
+	test_write_lines a b c d e f g h india >letters &&
+	git add . &&
+	test_tick &&
+	git commit -q -m side2 &&
+
+	git checkout -b side3 base &&
+	test_write_lines 1 2 tres 4 5 6 7 8 9 >numbers &&
+	git add . &&
+	test_tick &&
+	git commit -q -m side3 &&
+
+	git checkout master
+'
+
+test_expect_success 'clean merge' '
+	git merge-tree --write-tree side1 side2 >out &&
+	git checkout -q --detach side1 &&
+	git merge -q --no-edit side2 &&
+	git rev-parse HEAD^{tree} >expect &&
+	git checkout -q master &&
+	test_cmp expect out
+'
+
+test_expect_success '--write-tree is the default with two commits' '
+	git merge-tree side1 side2 >actual &&
+	test_cmp out actual
+'
+
+test_expect_success 'content conflict' '
+	test_expect_code 1 git merge-tree --write-tree side1 side3 >out &&
+	tree=$(head -n 1 out) &&
+	cat >expect <<-EOF &&
+	$(git rev-parse base:numbers | sed "s/^/100644 /") 1	numbers
+	$(git rev-parse side1:numbers | sed "s/^/100644 /") 2	numbers
+	$(git rev-parse side3:numbers | sed "s/^/100644 /") 3	numbers
+
+	CONFLICT (content): numbers
+	EOF
+	tail -n +2 out >actual &&
+	test_cmp expect actual &&
+	git cat-file blob $tree:numbers >merged &&
+	grep "^<<<<<<< side1" merged &&
+	grep "^>>>>>>> side3" merged
+'
+
+test_expect_success '--name-only and --no-messages' '
+	test_expect_code 1 \
+		git merge-tree --name-only --no-messages side1 side3 >out &&
+	echo numbers >expect &&
+	tail -n +2 out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'works in a bare repository' '
+	test_expect_code 1 git merge-tree side1 side3 >expect &&
+	git clone -q --bare . bare.git &&
+	test_expect_code 1 git -C bare.git merge-tree side1 side3 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'does not touch the index nor the working tree' '
+	git checkout -q side1 &&
+	git status --porcelain=2 >expect &&
+	git ls-files -s >>expect &&
+	test_expect_code 1 git merge-tree side1 side3 &&
+	git status --porcelain=2 >actual &&
+	git ls-files -s >>actual &&
+	test_cmp expect actual &&
+	git checkout -q master
+'
+
+test_expect_success 'unrelated histories are refused' '
+	git checkout -q --orphan unrelated &&
+	git rm -q -rf . &&
+	test_commit unrelated &&
+	git checkout -q master &&
+	test_must_fail git merge-tree side1 unrelated 2>err &&
+	test_i18ngrep "unrelated histories" err
+'
+
+test_expect_success '--stdin performs several merges' '
+	clean=$(git merge-tree side1 side2) &&
+	test_expect_code 1 git merge-tree side1 side3 >conflicted &&
+	printf "side1 side2\nside1 side3\n" |
+		git merge-tree --stdin >out &&
+	{
+		printf "1\n%s\n\0" "$clean" &&
+		printf "0\n" &&
+		cat conflicted &&
+		printf "\0"
+	} >expect &&
+	test_cmp expect out
+'
+
+test_expect_success '--stdin reports failed merges and goes on' '
+	clean=$(git merge-tree side1 side2) &&
+	printf "side1 unrelated\nside1 no-such-ref\nbogus\nside1 side2\n" |
+		git merge-tree --stdin >out &&
+	tr "\000" Q <out >actual &&
+	{
+		printf "%s\n" -1 "refusing to merge unrelated histories" &&
+		printf "Q-1\n%s\n" "could not resolve ref '\''no-such-ref'\''" &&
+		printf "Q-1\n%s\n" "malformed input line: '\''bogus'\''" &&
+		printf "Q1\n%s\nQ" "$clean"
+	} >expect &&
+	test_i18ncmp expect actual
+'
+
+test_expect_success 'trivial merge with three trees still works' '
+	git merge-tree base side1 side2 >actual &&
+	git merge-tree --trivial-merge base side1 side2 >expect &&
+	test_cmp expect actual &&
+	grep "^changed in both" actual
+'
+
+test_done
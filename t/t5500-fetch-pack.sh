@@ -903,6 +903,37 @@ test_expect_success 'fetch with --filter=blob:limit=0' '
 	fetch_filter_blob_limit_zero server server
 '
 
+negotiate_with_bitmaps () {
+	rm -rf server client trace &&
+	test_create_repo server &&
+	for i in $(test_seq 1 10)
+	do
+		test_commit -C server shared-$i || return 1
+	done &&
+	git clone server client &&
+	for i in $(test_seq 1 20)
+	do
+		test_commit -C client local-$i || return 1
+	done &&
+	test_commit -C server new &&
+	git -C server repack -adb &&
+	GIT_TRACE_NEGOTIATION="$(pwd)/trace" \
+		git -C client -c protocol.version=$1 fetch origin &&
+	git -C server rev-parse new >expect &&
+	git -C client rev-parse origin/master >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'negotiation with bitmaps counts the rounds' '
+	negotiate_with_bitmaps 0 &&
+	grep "upload-pack: 2 negotiation round(s), 2 have(s) in common" trace
+'
+
+test_expect_success 'protocol v2 negotiation with bitmaps sends ready' '
+	negotiate_with_bitmaps 2 &&
+	grep "upload-pack: 2 negotiation round(s), [0-9]* have(s) in common, sent ready" trace
+'
+
 . "$TEST_DIRECTORY"/lib-httpd.sh
 start_httpd
 
@@ -180,4 +180,41 @@ test_expect_success 'git fetch --all --tags' '
 	test_cmp expect test8/output
 '
 
+
+test_expect_success 'parallel' '
+	git init parallel &&
+	git -C parallel remote add one ../one &&
+	git -C parallel remote add two ../two &&
+	git -C parallel remote add three ../three &&
+	git -C parallel remote add bad ../non-existing &&
+
+	test_must_fail git -C parallel fetch --all --jobs=2 2>err &&
+	grep "could not fetch .bad. (exit code: 128)" err &&
+	cat >expect <<-\EOF &&
+	  one/master
+	  one/side
+	  three/another
+	  three/master
+	  three/side
+	  two/another
+	  two/master
+	  two/side
+	EOF
+	git -C parallel branch -r >output &&
+	test_cmp expect output &&
+
+	# each remote appended its lines of FETCH_HEAD in one go
+	sed -e "s/.* of //" parallel/.git/FETCH_HEAD |
+	uniq >remotes &&
+	sort remotes >sorted &&
+	test_write_lines ../one ../three ../two >expect &&
+	test_cmp expect sorted &&
+
+	git -C parallel remote remove bad &&
+	git -C parallel -c fetch.parallel=0 fetch --all 2>err &&
+	grep "^Fetching one" err &&
+	grep "^Fetching three" err &&
+	grep "^Fetching two" err
+'
+
 test_done
@@ -1245,6 +1245,34 @@ do
 	'
 done
 
+for extra in "commit-graph write --reachable" "repack -adb"
+do
+	test_expect_success "fetch reachable SHA1 after $extra" '
+		mk_empty testrepo &&
+		(
+			cd testrepo &&
+			git config uploadpack.allowreachablesha1inwant true &&
+			git commit --allow-empty -m foo &&
+			git commit --allow-empty -m bar &&
+			git commit --allow-empty -m xyz &&
+			git reset --hard HEAD^ &&
+			git $extra
+		) &&
+		reachable=$(git --git-dir=testrepo/.git rev-parse HEAD^) &&
+		unreachable=$(git --git-dir=testrepo/.git rev-parse HEAD@{1}) &&
+		mk_empty shallow &&
+		(
+			cd shallow &&
+			GIT_TRACE="$(pwd)/trace" \
+				git fetch ../testrepo/.git $reachable &&
+			git cat-file commit $reachable &&
+			! grep "git rev-list --stdin$" trace &&
+			test_must_fail ok=sigpipe \
+				git fetch ../testrepo/.git $unreachable
+		)
+	'
+done
+
 test_expect_success 'fetch follows tags by default' '
 	mk_test testrepo heads/master &&
 	rm -fr src dst &&
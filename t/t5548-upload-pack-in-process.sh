@@ -0,0 +1,78 @@
+#!/bin/sh
+
+test_description='upload-pack with uploadpack.packObjectsInProcess'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	git repack -adb &&
+	test_commit three &&
+	git tag -a -m annotated four &&
+	git config uploadpack.packObjectsInProcess true
+'
+
+test_expect_success 'clone generates the pack in-process' '
+	GIT_TRACE="$PWD/trace" git clone --no-local --bare . dst.git &&
+	grep "run_command: .*pack-objects" trace &&
+	! grep "built-in: git pack-objects" trace &&
+	git -C dst.git fsck &&
+	git for-each-ref >expect &&
+	git -C dst.git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'in-process packs match the ones of pack-objects' '
+	git clone --no-local --bare . expect.git &&
+	git -C dst.git rev-list --objects --all | sort >actual &&
+	git -C expect.git rev-list --objects --all | sort >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'fetch with haves' '
+	git clone --no-local --bare . fetch.git &&
+	test_commit five &&
+	git -C fetch.git fetch --no-tags origin \
+		"+refs/heads/*:refs/heads/*" &&
+	git rev-parse master >expect &&
+	git -C fetch.git rev-parse master >actual &&
+	test_cmp expect actual &&
+	git -C fetch.git fsck
+'
+
+test_expect_success 'protocol v2 fetch generates the pack in-process' '
+	test_commit six &&
+	GIT_TRACE="$PWD/trace" git -C fetch.git -c protocol.version=2 \
+		fetch --no-tags origin "+refs/heads/*:refs/heads/*" &&
+	! grep "built-in: git pack-objects" trace &&
+	git rev-parse master >expect &&
+	git -C fetch.git rev-parse master >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'shallow clones run pack-objects' '
+	GIT_TRACE="$PWD/trace" git clone --no-local --depth=1 . shallow &&
+	grep "built-in: git pack-objects" trace &&
+	git -C shallow fsck
+'
+
+test_expect_success 'the pack-objects hook takes precedence' '
+	write_script .git/hook <<-\EOF &&
+		echo >&2 "hook running"
+		exec "$@"
+	EOF
+	test_config_global uploadpack.packObjectsHook ./hook &&
+	git clone --no-local --bare . hook.git 2>stderr &&
+	grep "hook running" stderr
+'
+
+test_expect_success 'errors of pack-objects are reported' '
+	git clone --bare . corrupt.git &&
+	git -C corrupt.git config uploadpack.packObjectsInProcess true &&
+	blob=$(git rev-parse three:three.t) &&
+	rm -f corrupt.git/objects/$(echo $blob | sed "s|^..|&/|") &&
+	test_must_fail git clone --no-local corrupt.git bad 2>err &&
+	test_i18ngrep "pack-objects died" err
+'
+
+test_done
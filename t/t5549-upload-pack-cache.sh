@@ -0,0 +1,98 @@
+#!/bin/sh
+
+test_description='upload-pack with uploadpack.packCache'
+. ./test-lib.sh
+
+cache_stats () {
+	cat .git/upload-pack-cache/stats
+}
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	git tag -a -m annotated tag-two &&
+	git config uploadpack.packCache true
+'
+
+test_expect_success 'the first clone fills the cache' '
+	git clone --no-local --bare . first.git &&
+	ls .git/upload-pack-cache/*.pack >packs &&
+	test_line_count = 1 packs &&
+	test_write_lines "hits 0" "misses 1" >expect &&
+	cache_stats >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the same clone is answered from the cache' '
+	GIT_TRACE="$PWD/trace" git clone --no-local --bare . second.git &&
+	! grep "pack-objects" trace &&
+	git -C second.git fsck &&
+	git -C first.git for-each-ref >expect &&
+	git -C second.git for-each-ref >actual &&
+	test_cmp expect actual &&
+	test_write_lines "hits 1" "misses 1" >expect &&
+	cache_stats >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'protocol v2 shares the entries' '
+	git -c protocol.version=2 clone --no-local --bare . v2.git &&
+	git -C v2.git fsck &&
+	test_write_lines "hits 2" "misses 1" >expect &&
+	cache_stats >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'updated refs change the key' '
+	test_commit three &&
+	git clone --no-local --bare . third.git &&
+	git rev-parse three >expect &&
+	git -C third.git rev-parse three >actual &&
+	test_cmp expect actual &&
+	test_write_lines "hits 2" "misses 2" >expect &&
+	cache_stats >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'fetches with the same haves share an entry' '
+	git clone --no-local --bare first.git fetch1.git &&
+	git clone --no-local --bare first.git fetch2.git &&
+	git -C fetch1.git fetch .. "+refs/heads/*:refs/heads/*" &&
+	git -C fetch2.git fetch .. "+refs/heads/*:refs/heads/*" &&
+	git -C fetch2.git fsck &&
+	git rev-parse master >expect &&
+	git -C fetch2.git rev-parse master >actual &&
+	test_cmp expect actual &&
+	test_write_lines "hits 3" "misses 3" >expect &&
+	cache_stats >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'shallow clones do not use the cache' '
+	git clone --no-local --depth=1 . shallow &&
+	test_write_lines "hits 3" "misses 3" >expect &&
+	cache_stats >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the least recently used packs are evicted' '
+	test_commit four &&
+	git clone --no-local --bare . lru.git &&
+	ls -t .git/upload-pack-cache/*.pack >packs &&
+	recent=$(head -n 1 packs) &&
+	test-tool chmtime =-100 .git/upload-pack-cache/*.pack &&
+	test-tool chmtime =-200 $recent &&
+	# a hit makes it the most recently used pack again
+	git clone --no-local --bare . lru-again.git &&
+	limit=$((2 * $(wc -c <$recent))) &&
+	test_commit five &&
+	git -C fetch1.git fetch \
+		--upload-pack="git -c uploadpack.packCacheSize=$limit upload-pack" \
+		.. "+refs/heads/*:refs/heads/*" &&
+	ls .git/upload-pack-cache/*.pack >after &&
+	test $(wc -l <after) -lt $(wc -l <packs) &&
+	grep "$recent" after &&
+	test $(cat $(cat after) | wc -c) -le $limit
+'
+
+test_done
@@ -0,0 +1,129 @@
+#!/bin/sh
+
+test_description='test bisecting fetch negotiator'
+. ./test-lib.sh
+
+have_sent () {
+	while test "$#" -ne 0
+	do
+		grep "fetch> have $(git -C client rev-parse $1)" trace
+		if test $? -ne 0
+		then
+			echo "No have $(git -C client rev-parse $1) ($1)"
+			return 1
+		fi
+		shift
+	done
+}
+
+have_not_sent () {
+	while test "$#" -ne 0
+	do
+		grep "fetch> have $(git -C client rev-parse $1)" trace
+		if test $? -eq 0
+		then
+			return 1
+		fi
+		shift
+	done
+}
+
+# trace_fetch <client_dir> <server_dir> [args]
+#
+# Trace the packet output of fetch, but make sure we disable the variable
+# in the child upload-pack, so we don't combine the results in the same file.
+trace_fetch () {
+	client=$1; shift
+	server=$1; shift
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+	git -C "$client" fetch \
+	  --upload-pack 'unset GIT_TRACE_PACKET; git-upload-pack' \
+	  "$server" "$@"
+}
+
+test_expect_success 'setup' '
+	git init client-orig &&
+	for i in $(test_seq 20)
+	do
+		test_commit -C client-orig c$i
+	done &&
+
+	# The server has "c12" but does not advertise it.
+	git init server &&
+	git -C server fetch --no-tags "$(pwd)/client-orig" c12:refs/heads/b &&
+	git -C server checkout b &&
+	test_commit -C server to_fetch &&
+	git -C server branch -f master b &&
+	git -C server checkout master &&
+	git -C server branch -D b
+'
+
+test_expect_success 'skipped commits are bisected' '
+	rm -rf client &&
+	cp -R client-orig client &&
+	git -C client config fetch.negotiationAlgorithm bisecting &&
+
+	# We send "c20" (skip 1) "c18" (skip 2) "c15" (skip 4) "c10" (skip 8)
+	# "c1", which has no parent. The server has "c10", so we bisect the
+	# commits skipped before it and send "c13" then "c12".
+	trace_fetch client "$(pwd)/server" &&
+	have_sent c20 c18 c15 c10 c1 c13 c12 &&
+	have_not_sent c19 c17 c16 c14 c11 c9 c2
+'
+
+test_expect_success 'skipped commits are bisected with protocol v2' '
+	rm -rf client &&
+	cp -R client-orig client &&
+	git -C client config fetch.negotiationAlgorithm bisecting &&
+	git -C client config protocol.version 2 &&
+	trace_fetch client "$(pwd)/server" &&
+	grep "fetch< version 2" trace &&
+	have_sent c20 c18 c15 c10 c1 c13 c12 &&
+	have_not_sent c19 c17 c16 c14 c11 c9 c2
+'
+
+test_expect_success 'the server does not send what it has' '
+	rm -rf client &&
+	cp -R client-orig client &&
+	git -C client config fetch.negotiationAlgorithm bisecting &&
+	git -C client -c fetch.unpackLimit=1 fetch "$(pwd)/server" &&
+	# only "to_fetch", not "c11" or "c12"
+	git verify-pack -v client/.git/objects/pack/pack-*.idx >objects &&
+	grep " commit " objects >commits &&
+	test_line_count = 1 commits
+'
+
+test_expect_success 'tips are walked in generation order' '
+	rm -rf server client trace &&
+	git init server &&
+	test_commit -C server to_fetch &&
+
+	git init client &&
+	test_commit -C client base &&
+	for i in $(test_seq 3)
+	do
+		git -C client checkout -b b$i base &&
+		test_commit -C client b$i.c1 &&
+		test_commit -C client b$i.c2
+	done &&
+
+	# Give the commits of "old" dates far in the past: the walk still
+	# sends "old.c4" first, as it has the highest generation.
+	git -C client checkout -b old base &&
+	test_tick=1000000000 &&
+	for i in $(test_seq 4)
+	do
+		test_commit -C client old.c$i
+	done &&
+	git -C client commit-graph write --reachable &&
+
+	test_config -C client core.commitGraph true &&
+	test_config -C client fetch.negotiationAlgorithm bisecting &&
+	trace_fetch client "$(pwd)/server" &&
+	grep "fetch> have" trace >haves &&
+	head -n 1 haves >first &&
+	grep "$(git -C client rev-parse old.c4)" first
+'
+
+test_done
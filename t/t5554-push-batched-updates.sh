@@ -0,0 +1,104 @@
+#!/bin/sh
+
+test_description='receive-pack updating refs in batches'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	for i in $(test_seq 50)
+	do
+		echo "create refs/tags/t$i HEAD" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+
+	git init --bare upstream-orig &&
+	git -C upstream-orig config receive.batchUpdates true &&
+	git push upstream-orig one:refs/heads/b1 one:refs/heads/b2 one:refs/heads/b3
+'
+
+test_expect_success 'refs are updated in one transaction' '
+	rm -rf upstream &&
+	cp -R upstream-orig upstream &&
+	rm -f trace &&
+	git -C upstream config receive.packRefsThreshold 0 &&
+	GIT_TRACE="$(pwd)/trace" git push upstream "refs/tags/*" \
+		two:refs/heads/b1 two:refs/heads/b2 &&
+	grep "receive-pack: 54 ref update(s) in 1 transaction(s), 0 failed$" trace &&
+	test_path_is_file upstream/refs/tags/t1 &&
+	test_path_is_file upstream/refs/heads/b1 &&
+	git -C upstream rev-parse b1 b2 t50 >actual &&
+	git rev-parse two two t50 >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'refs are written to packed-refs past receive.packRefsThreshold' '
+	rm -rf upstream &&
+	cp -R upstream-orig upstream &&
+	rm -f trace &&
+	git -C upstream config receive.packRefsThreshold 10 &&
+	GIT_TRACE="$(pwd)/trace" git push upstream "refs/tags/*" \
+		two:refs/heads/b1 two:refs/heads/b2 &&
+	grep "54 ref update(s) in 1 transaction(s), 0 failed, written to packed-refs" trace &&
+	test_path_is_missing upstream/refs/tags/t1 &&
+	test_path_is_missing upstream/refs/heads/b1 &&
+	grep "refs/tags/t1$" upstream/packed-refs &&
+	grep "^$(git rev-parse two) refs/heads/b1$" upstream/packed-refs &&
+	git -C upstream rev-parse b1 b2 b3 t50 >actual &&
+	git rev-parse two two one t50 >expect &&
+	test_cmp expect actual &&
+	git -C upstream fsck
+'
+
+test_expect_success 'reflogs are written for refs written to packed-refs' '
+	rm -rf upstream &&
+	cp -R upstream-orig upstream &&
+	git -C upstream config receive.packRefsThreshold 1 &&
+	git -C upstream config core.logAllRefUpdates true &&
+	git push upstream two:refs/heads/b1 two:refs/heads/new &&
+	test_path_is_missing upstream/refs/heads/b1 &&
+	grep "^$(git rev-parse one) $(git rev-parse two) " \
+		upstream/logs/refs/heads/b1 &&
+	grep "^$ZERO_OID $(git rev-parse two) " upstream/logs/refs/heads/new
+'
+
+test_expect_success 'refs that cannot be updated are reported one by one' '
+	rm -rf upstream &&
+	cp -R upstream-orig upstream &&
+	rm -f trace &&
+	git -C upstream config receive.packRefsThreshold 10 &&
+	>upstream/refs/heads/b2.lock &&
+	GIT_TRACE="$(pwd)/trace" test_must_fail git push --porcelain upstream \
+		"refs/tags/*" two:refs/heads/b1 two:refs/heads/b2 >out &&
+	grep "^!	.*:refs/heads/b2	\[remote rejected\] (failed to update ref)" out &&
+	grep "^ 	.*:refs/heads/b1	" out &&
+	grep "54 ref update(s) in [0-9]* transaction(s), 1 failed" trace &&
+	! grep "in 1 transaction(s)" trace &&
+	git -C upstream rev-parse b1 b2 t50 >actual &&
+	git rev-parse two one t50 >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'hooks see every ref, and only updated ones after the fact' '
+	rm -rf upstream &&
+	cp -R upstream-orig upstream &&
+	write_script upstream/hooks/update <<-\EOF &&
+	echo "$1" >>update.log
+	test "$1" != refs/heads/b2
+	EOF
+	write_script upstream/hooks/post-receive <<-\EOF &&
+	cut -d " " -f 3 >>post-receive.log
+	EOF
+	test_must_fail git push upstream \
+		two:refs/heads/b1 two:refs/heads/b2 two:refs/heads/b3 &&
+	test_write_lines refs/heads/b1 refs/heads/b2 refs/heads/b3 >expect &&
+	test_cmp expect upstream/update.log &&
+	test_write_lines refs/heads/b1 refs/heads/b3 >expect &&
+	test_cmp expect upstream/post-receive.log &&
+	git -C upstream rev-parse b1 b2 b3 >actual &&
+	git rev-parse two one two >expect &&
+	test_cmp expect actual
+'
+
+test_done
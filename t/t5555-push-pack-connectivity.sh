@@ -0,0 +1,134 @@
+#!/bin/sh
+
+test_description='receive-pack checking connectivity from the received pack'
+
+. ./test-lib.sh
+
+# push_traced <args>
+#
+# Push with GIT_TRACE to "trace", overwriting what earlier pushes traced.
+push_traced () {
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git push "$@"
+}
+
+walked () {
+	grep "rev-list --objects --stdin --not --all" trace
+}
+
+skipped_walk () {
+	grep "connectivity established from the received pack" trace &&
+	! walked
+}
+
+test_expect_success 'setup' '
+	mkdir -p a/b c &&
+	for i in 1 2 3
+	do
+		echo $i >a/b/$i &&
+		echo $i >c/$i &&
+		echo $i >$i || return 1
+	done &&
+	git add . &&
+	git commit -m initial &&
+	git tag initial &&
+	echo 4 >a/b/4 &&
+	git add a/b/4 &&
+	git commit -m second &&
+	git tag -a -m second second &&
+
+	git init --bare upstream &&
+	git -C upstream config receive.unpackLimit 1 &&
+	git -C upstream config receive.packConnectivityCheck true &&
+	git push upstream master second
+'
+
+test_expect_success 'index-pack reports the objects a thin pack refers to' '
+	echo 5 >a/b/5 &&
+	git add a/b/5 &&
+	git commit -m third &&
+	git pack-objects --revs --thin --stdout >thin.pack <<-EOF &&
+	master
+	^master^
+	EOF
+	git init --bare thin.git &&
+	git -C upstream pack-objects --revs --stdout >base.pack <<-EOF &&
+	master
+	EOF
+	git -C thin.git index-pack --stdin <base.pack &&
+	git -C thin.git index-pack --stdin --fix-thin \
+		--report-foreign="$(pwd)/foreign" <thin.pack &&
+	git rev-parse master^ master^:c master^:a/b/1 >expect &&
+	for oid in $(cat expect)
+	do
+		grep $oid foreign || return 1
+	done &&
+	! grep $(git rev-parse master) foreign &&
+	! grep $(git rev-parse master:a) foreign
+'
+
+test_expect_success 'pushing on top of a branch does not walk the history' '
+	push_traced upstream master &&
+	skipped_walk &&
+	git -C upstream fsck &&
+	git rev-parse master >expect &&
+	git -C upstream rev-parse master >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'pushing what refs already point at does not walk the history' '
+	push_traced upstream master:refs/heads/copy second^0:refs/heads/from-tag &&
+	skipped_walk
+'
+
+test_expect_success 'pushing on top of a commit no ref points at walks the history' '
+	git checkout -b side initial &&
+	echo side >a/b/side &&
+	git add a/b/side &&
+	git commit -m side &&
+	push_traced upstream side &&
+	walked &&
+	git rev-parse side >expect &&
+	git -C upstream rev-parse side >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'trees moved to another path make us walk the history' '
+	git checkout master &&
+	git mv c d &&
+	git commit -m move &&
+	push_traced upstream master &&
+	walked &&
+	git -C upstream fsck
+'
+
+test_expect_success 'index-pack reports missing foreign objects' '
+	git checkout -b missing master &&
+	echo new >new &&
+	git add new &&
+	git commit -m missing &&
+	git rev-list --objects missing ^master >objects &&
+	grep -v $(git rev-parse missing:new) objects |
+	git pack-objects --stdout >missing.pack &&
+	git init --bare missing.git &&
+	git -C missing.git index-pack --stdin \
+		--report-foreign="$(pwd)/foreign" <missing.pack &&
+	grep $(git rev-parse missing:new) foreign &&
+	test_must_fail git -C missing.git index-pack --stdin --strict \
+		--report-foreign="$(pwd)/foreign" <missing.pack 2>err &&
+	test_i18ngrep "did not receive expected object" err
+'
+
+test_expect_success 'shallow pushes walk the history' '
+	git clone --bare --depth=1 "file://$(pwd)/upstream" shallow.git &&
+	git -C shallow.git config receive.unpackLimit 1 &&
+	git -C shallow.git config receive.packConnectivityCheck true &&
+	git checkout master &&
+	echo 6 >6 &&
+	git add 6 &&
+	git commit -m sixth &&
+	push_traced shallow.git master &&
+	walked
+'
+
+test_done
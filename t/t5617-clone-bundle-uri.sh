@@ -0,0 +1,121 @@
+#!/bin/sh
+
+test_description='clone and fetch starting from bundle URIs'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git init server &&
+	test_commit -C server one &&
+	test_commit -C server two &&
+	git -C server bundle create "$(pwd)/base.bundle" master &&
+	test_commit -C server three &&
+	git -C server bundle create "$(pwd)/incr.bundle" two..master &&
+	test_commit -C server four
+'
+
+test_expect_success 'clone --bundle-uri starts from the bundle' '
+	GIT_TRACE_PACKET="$(pwd)/trace" git clone \
+		--bundle-uri="file://$(pwd)/base.bundle" \
+		"file://$(pwd)/server" client &&
+	git -C server rev-parse two >expect &&
+	git -C client rev-parse refs/bundles/master >actual &&
+	test_cmp expect actual &&
+	grep "clone> have $(cat expect)" trace &&
+	git -C client fsck &&
+	git -C server log --format=%s >expect &&
+	git -C client log --format=%s >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'bundles are applied in order' '
+	rm -rf client &&
+	git clone --bundle-uri=base.bundle --bundle-uri=incr.bundle \
+		"file://$(pwd)/server" client &&
+	git -C server rev-parse three >expect &&
+	git -C client rev-parse refs/bundles/master >actual &&
+	test_cmp expect actual &&
+	git -C client fsck
+'
+
+test_expect_success 'bundles that cannot be applied are skipped' '
+	rm -rf client &&
+	echo garbage >bad.bundle &&
+	git clone --bundle-uri=incr.bundle --bundle-uri=bad.bundle \
+		--bundle-uri=missing.bundle \
+		"file://$(pwd)/server" client 2>err &&
+	test_i18ngrep "skipping bundle uri .incr.bundle." err &&
+	test_i18ngrep "skipping bundle uri .bad.bundle." err &&
+	test_i18ngrep "skipping bundle uri .missing.bundle." err &&
+	test_must_fail git -C client rev-parse --verify refs/bundles/master &&
+	git -C client fsck
+'
+
+test_expect_success '--bundle-uri does not go with shallow clones' '
+	test_must_fail git clone --depth=1 --bundle-uri=base.bundle \
+		"file://$(pwd)/server" shallow 2>err &&
+	test_i18ngrep "incompatible" err
+'
+
+test_expect_success 'clone only uses http bundles advertised by the server' '
+	rm -rf client trace &&
+	git -C server config uploadpack.bundleUri "file://$(pwd)/base.bundle" &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -c protocol.version=2 \
+		clone "file://$(pwd)/server" client &&
+	! grep "command=bundle-uri" trace &&
+	test_must_fail git -C client rev-parse --verify refs/bundles/master &&
+	rm -rf client trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -c protocol.version=2 \
+		-c transfer.bundleURI=true \
+		clone "file://$(pwd)/server" client 2>err &&
+	grep "clone> command=bundle-uri" trace &&
+	test_i18ngrep "not an http(s) URL" err &&
+	test_must_fail git -C client rev-parse --verify refs/bundles/master &&
+	git -C client fsck &&
+	git -C server config --unset uploadpack.bundleUri
+'
+
+test_expect_success 'fetch --bundle-uri' '
+	rm -rf client &&
+	git clone --bundle-uri=base.bundle "file://$(pwd)/server" client &&
+	test_commit -C server five &&
+	git -C server bundle create "$(pwd)/update.bundle" four..master &&
+	git -C client fetch --bundle-uri="$(pwd)/update.bundle" origin &&
+	git -C server rev-parse five >expect &&
+	git -C client rev-parse refs/bundles/master >actual &&
+	test_cmp expect actual &&
+	git -C client rev-parse origin/master >actual &&
+	test_cmp expect actual
+'
+
+# Test bundle URIs served over 'http://'
+#
+. "$TEST_DIRECTORY"/lib-httpd.sh
+start_httpd
+
+test_expect_success 'clone --bundle-uri with an http bundle' '
+	rm -rf client &&
+	cp base.bundle "$HTTPD_DOCUMENT_ROOT_PATH/base.bundle" &&
+	git clone --bundle-uri="$HTTPD_URL/dumb/base.bundle" \
+		"file://$(pwd)/server" client &&
+	git -C server rev-parse two >expect &&
+	git -C client rev-parse refs/bundles/master >actual &&
+	test_cmp expect actual &&
+	git -C client fsck
+'
+
+test_expect_success 'clone uses the http bundles advertised by the server' '
+	rm -rf client &&
+	test_when_finished "git -C server config --unset uploadpack.bundleUri" &&
+	git -C server config uploadpack.bundleUri "$HTTPD_URL/dumb/base.bundle" &&
+	git -c protocol.version=2 -c transfer.bundleURI=true \
+		clone "file://$(pwd)/server" client &&
+	git -C server rev-parse two >expect &&
+	git -C client rev-parse refs/bundles/master >actual &&
+	test_cmp expect actual &&
+	git -C client fsck
+'
+
+stop_httpd
+
+test_done
@@ -9,7 +9,7 @@ test_expect_success 'test capability advertisement' '
 	version 2
 	agent=git/$(git version | cut -d" " -f3)
 	ls-refs
-	fetch=shallow
+	fetch=shallow wait-for-done
 	server-option
 	0000
 	EOF
@@ -108,13 +108,9 @@ test_expect_success 'pull with git:// using protocol v2' '
 	grep "fetch< version 2" log
 '
 
-test_expect_success 'push with git:// and a config of v2 does not request v2' '
+test_expect_success 'push with git:// using protocol v2' '
 	test_when_finished "rm -f log" &&
 
-	# Till v2 for push is designed, make sure that if a client has
-	# protocol.version configured to use v2, that the client instead falls
-	# back and uses v0.
-
 	test_commit -C daemon_child three &&
 
 	# Push to another branch, as the target repository has the
@@ -127,9 +123,9 @@ test_expect_success 'push with git:// and a config of v2 does not request v2' '
 	test_cmp expect actual &&
 
 	# Client requested to use protocol v2
-	! grep "push> .*\\\0\\\0version=2\\\0$" log &&
+	grep "push> .*\\\0\\\0version=2\\\0$" log &&
 	# Server responded using protocol v2
-	! grep "push< version 2" log
+	grep "push< version 2" log
 '
 
 stop_git_daemon
@@ -471,6 +467,246 @@ test_expect_success 'upload-pack respects client shallows' '
 	grep "fetch< version 2" trace
 '
 
+test_expect_success 'setup packfile uris' '
+	rm -rf server client trace &&
+
+	git init server &&
+	test_commit -C server one &&
+	git -C server repack -a -d &&
+	pack=$(echo server/.git/objects/pack/pack-*.pack) &&
+	hash=$(basename "$pack" .pack | sed "s/^pack-//") &&
+	echo $hash >packfile-hash &&
+	mkdir -p cdn &&
+	cp "$pack" cdn/ &&
+	git -C server config uploadpack.packfileuri \
+		"$hash file://$(pwd)/cdn/pack-$hash.pack" &&
+	test_commit -C server two
+'
+
+test_expect_success 'clone downloads packs from packfile uris' '
+	hash=$(cat packfile-hash) &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -c protocol.version=2 \
+		-c fetch.uriprotocols=file \
+		clone "file://$(pwd)/server" client &&
+
+	grep "clone< packfile-uris" trace &&
+	grep "clone< $hash file://" trace &&
+	test_path_is_file client/.git/objects/pack/pack-$hash.pack &&
+	# the objects of "one" were not sent a second time
+	git -C client count-objects -v >counts &&
+	grep "^packs: 2$" counts &&
+	grep "^in-pack: 6$" counts &&
+	git -C client fsck &&
+	git -C client log --format=%s >actual &&
+	test_write_lines two one >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'progress is not sent before the packfile uris' '
+	rm -rf client &&
+	hash=$(cat packfile-hash) &&
+	git -c protocol.version=2 -c fetch.uriprotocols=file \
+		clone --progress "file://$(pwd)/server" client 2>err &&
+	test_i18ngrep "Enumerating objects" err &&
+	test_path_is_file client/.git/objects/pack/pack-$hash.pack &&
+	git -C client fsck
+'
+
+test_expect_success 'packfile uris are only used when requested' '
+	rm -rf client trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -c protocol.version=2 \
+		clone "file://$(pwd)/server" client &&
+	! grep "clone> packfile-uris" trace &&
+	git -C client fsck &&
+	rm -rf client trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -c protocol.version=2 \
+		-c fetch.uriprotocols=https \
+		clone "file://$(pwd)/server" client &&
+	grep "clone> packfile-uris https" trace &&
+	! grep "clone< packfile-uris" trace &&
+	git -C client fsck
+'
+
+test_expect_success 'packs the client does not need are not sent' '
+	test_commit -C server three &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C client -c protocol.version=2 \
+		-c fetch.uriprotocols=file fetch origin &&
+	grep "fetch> packfile-uris file" trace &&
+	! grep "fetch< packfile-uris" trace &&
+	git -C client fsck
+'
+
+test_expect_success 'fetch fails if a packfile uri gives another pack' '
+	rm -rf client &&
+	hash=$(cat packfile-hash) &&
+	echo $(git -C server rev-parse three) |
+	git -C server pack-objects --revs ../other >other-hash &&
+	cp other-$(cat other-hash).pack cdn/pack-$hash.pack &&
+	test_must_fail git -c protocol.version=2 -c fetch.uriprotocols=file \
+		clone "file://$(pwd)/server" client 2>err &&
+	test_i18ngrep "did not give the expected pack" err
+'
+
+test_expect_success 'setup push tests' '
+	git init --bare push_parent &&
+	git init push_child &&
+	test_commit -C push_child one &&
+	git -C push_child branch unwanted-branch &&
+	git -C push_child remote add origin "file://$(pwd)/push_parent" &&
+	git -C push_child push origin master unwanted-branch
+'
+
+test_expect_success 'push with file:// using protocol v2' '
+	test_when_finished "rm -f log" &&
+
+	test_commit -C push_child two &&
+	GIT_TRACE_PACKET="$(pwd)/log" git -C push_child -c protocol.version=2 \
+		push origin master &&
+
+	git -C push_child rev-parse master >expect &&
+	git -C push_parent rev-parse master >actual &&
+	test_cmp expect actual &&
+
+	# Server responded using protocol v2
+	grep "push< version 2" log &&
+	grep "push> command=push" log &&
+	grep "push< ok refs/heads/master" log
+'
+
+test_expect_success 'ref advertisement is filtered during push using protocol v2' '
+	test_when_finished "rm -f log" &&
+
+	git -C push_parent update-ref refs/pull/1/head master &&
+	test_commit -C push_child three &&
+	GIT_TRACE_PACKET="$(pwd)/log" git -C push_child -c protocol.version=2 \
+		push origin HEAD &&
+
+	grep "ref-prefix refs/heads/master" log &&
+	grep "push< .* refs/heads/master" log &&
+	! grep "refs/pull/" log &&
+
+	# remote-tracking refs ask for their directory, once
+	grep "push> ref-prefix refs/heads/$" log >prefixes &&
+	test_line_count = 1 prefixes
+'
+
+test_expect_success 'too many ref prefixes are not sent during push' '
+	test_when_finished "rm -f log" &&
+	test_when_finished "git -C push_child for-each-ref \
+		--format=\"delete %(refname)\" refs/remotes/pr |
+		git -C push_child update-ref --stdin" &&
+
+	# every pull request is in a directory of its own
+	for i in $(test_seq 40)
+	do
+		echo "create refs/remotes/pr/$i HEAD" || return 1
+	done >input &&
+	git -C push_child update-ref --stdin <input &&
+	GIT_TRACE_PACKET="$(pwd)/log" git -C push_child -c protocol.version=2 \
+		-c remote.origin.fetch="+refs/pull/*/head:refs/remotes/pr/*" \
+		push origin HEAD &&
+
+	grep "push< .* refs/pull/1/head" log &&
+	! grep "ref-prefix" log
+'
+
+test_expect_success 'pushing a new branch using protocol v2 sends only new objects' '
+	test_when_finished "git -C push_child checkout master" &&
+	git -C push_child checkout -b new-branch &&
+	test_commit -C push_child new-file &&
+	git -C push_child -c protocol.version=2 push --progress \
+		origin new-branch 2>err &&
+	grep "Total 3 " err &&
+
+	# without remote-tracking refs, the other branches are listed
+	git -C push_child update-ref -d refs/remotes/origin/master &&
+	git -C push_child update-ref -d refs/remotes/origin/new-branch &&
+	git -C push_child checkout -b another-branch &&
+	test_commit -C push_child another-file &&
+	GIT_TRACE_PACKET="$(pwd)/log" git -C push_child -c protocol.version=2 \
+		push --progress origin another-branch 2>err &&
+	grep "ref-prefix refs/heads/$" log &&
+	grep "Total 3 " err
+'
+
+test_expect_success 'deleting and rejected updates are reported using protocol v2' '
+	test_when_finished "rm -f log" &&
+
+	git -C push_child commit --amend -m rewritten &&
+	GIT_TRACE_PACKET="$(pwd)/log" \
+	test_must_fail git -C push_child -c protocol.version=2 \
+		push origin :unwanted-branch master &&
+
+	test_must_fail git -C push_parent rev-parse --verify unwanted-branch &&
+	git -C push_child rev-parse three >expect &&
+	git -C push_parent rev-parse master >actual &&
+	test_cmp expect actual &&
+	grep "push< ok refs/heads/unwanted-branch" log
+'
+
+test_expect_success 'atomic push using protocol v2' '
+	test_when_finished "rm -f log push_parent/hooks/update" &&
+
+	write_script push_parent/hooks/update <<-\EOF &&
+	test "$1" != refs/heads/rejected
+	EOF
+	git -C push_child reset --hard three &&
+	test_commit -C push_child four &&
+	GIT_TRACE_PACKET="$(pwd)/log" \
+	test_must_fail git -C push_child -c protocol.version=2 \
+		push --atomic origin master HEAD:rejected &&
+
+	grep "push> atomic" log &&
+	git -C push_child rev-parse three >expect &&
+	git -C push_parent rev-parse master >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'push options are sent using protocol v2' '
+	test_when_finished "rm -f push_parent/hooks/post-receive" &&
+
+	git -C push_parent config receive.advertisePushOptions true &&
+	write_script push_parent/hooks/post-receive <<-\EOF &&
+	echo "$GIT_PUSH_OPTION_0" >../options
+	EOF
+	git -C push_child -c protocol.version=2 \
+		push -o option origin master &&
+
+	echo option >expect &&
+	test_cmp expect options
+'
+
+test_expect_success 'hidden refs are neither listed nor updated using protocol v2' '
+	test_when_finished "rm -f log" &&
+
+	git -C push_parent config receive.hideRefs refs/hidden &&
+	git -C push_parent update-ref refs/hidden/ref master &&
+	GIT_TRACE_PACKET="$(pwd)/log" \
+	test_must_fail git -C push_child -c protocol.version=2 \
+		push origin master:refs/hidden/ref 2>err &&
+
+	grep "ref-prefix refs/hidden/ref" log &&
+	! grep "push< .* refs/hidden/ref$" log &&
+	test_i18ngrep "deny updating a hidden ref" err
+'
+
+test_expect_success 'ls-refs hides the refs the service it serves for hides' '
+	test_when_finished "git -C push_parent config --unset uploadpack.hideRefs" &&
+	git -c protocol.version=2 \
+		ls-remote "file://$(pwd)/push_parent" >refs &&
+	grep refs/hidden/ref refs &&
+	git -C push_parent config uploadpack.hideRefs refs/hidden &&
+	git -c protocol.version=2 \
+		ls-remote "file://$(pwd)/push_parent" >refs &&
+	! grep refs/hidden/ref refs
+'
+
+test_expect_success 'signed push is not supported using protocol v2' '
+	test_must_fail git -C push_child -c protocol.version=2 \
+		push --signed origin master 2>err &&
+	test_i18ngrep "does not support --signed push" err
+'
+
 # Test protocol v2 with 'http://' transport
 #
 . "$TEST_DIRECTORY"/lib-httpd.sh
@@ -537,6 +773,23 @@ test_expect_success 'push with http:// and a config of v2 does not request v2' '
 	! grep "git< version 2" log
 '
 
+test_expect_success 'clone downloads packs from http packfile uris' '
+	test_when_finished "rm -f log" &&
+	hash=$(cat packfile-hash) &&
+	cp server/.git/objects/pack/pack-$hash.pack \
+		"$HTTPD_DOCUMENT_ROOT_PATH/" &&
+	git -C server config uploadpack.packfileuri \
+		"$hash $HTTPD_URL/dumb/pack-$hash.pack" &&
+
+	GIT_TRACE_PACKET="$(pwd)/log" git -c protocol.version=2 \
+		-c fetch.uriprotocols=http \
+		clone "file://$(pwd)/server" http_uri_client &&
+
+	grep "clone< $hash $HTTPD_URL/dumb/pack-$hash.pack" log &&
+	test_path_is_file http_uri_client/.git/objects/pack/pack-$hash.pack &&
+	git -C http_uri_client fsck
+'
+
 
 stop_httpd
 
@@ -0,0 +1,179 @@
+#!/bin/sh
+
+test_description='three-way tree merges done in memory'
+
+. ./test-lib.sh
+
+# Compare the in-memory merge of "$2" and "$3" (with base "$1") to what
+# merge-recursive produces when merging them in the working tree.
+check_against_recursive () {
+	git checkout -q --detach "$2" &&
+	git merge -q --no-edit "$3" &&
+	git rev-parse HEAD^{tree} >expect &&
+	git checkout -q master &&
+	test-tool merge-in-memory "$1" "$2" "$3" >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	test_write_lines 1 2 3 4 5 6 7 8 9 >file &&
+	test_write_lines a b c d e f g h i >renamed &&
+	echo other >other &&
+	mkdir dir &&
+	echo sub >dir/sub &&
+	git add . &&
+	test_commit base &&
+
+	git checkout -b ours &&
+	test_write_lines 1 2 ours 4 5 6 7 8 9 >file &&
+	git mv renamed dir/moved &&
+	echo ours >new-ours &&
+	git add . &&
+	test_commit ours &&
+
+	git checkout -b theirs base &&
+	test_write_lines 1 2 3 4 5 6 7 theirs 9 >file &&
+	test_write_lines a b c d e f g h theirs >renamed &&
+	echo theirs >dir/sub &&
+	git add . &&
+	test_commit theirs &&
+	git checkout master
+'
+
+test_expect_success 'clean merge matches merge-recursive' '
+	check_against_recursive base ours theirs &&
+	git cat-file blob "$(cat actual):dir/moved" >moved &&
+	test_write_lines a b c d e f g h theirs >expect &&
+	test_cmp expect moved
+'
+
+test_expect_success 'merge does not touch the index or the working tree' '
+	git checkout -q ours &&
+	git status --porcelain=2 >expect &&
+	git ls-files -s >>expect &&
+	test-tool merge-in-memory base ours theirs &&
+	git status --porcelain=2 >actual &&
+	git ls-files -s >>actual &&
+	test_cmp expect actual &&
+	git checkout -q master
+'
+
+test_expect_success 'merge works in a bare repository' '
+	test-tool merge-in-memory base ours theirs >expect &&
+	git clone -q --bare . bare.git &&
+	(
+		cd bare.git &&
+		test-tool merge-in-memory base ours theirs >../actual
+	) &&
+	test_cmp expect actual
+'
+
+test_expect_success 'content conflict' '
+	git checkout -q -b conflict base &&
+	test_write_lines 1 2 conflict 4 5 6 7 8 9 >file &&
+	git commit -q -a -m conflict &&
+	git checkout -q master &&
+	test_expect_code 1 test-tool merge-in-memory base ours conflict >out &&
+	echo "content file" >expect &&
+	tail -n +2 out >actual &&
+	test_cmp expect actual &&
+	git cat-file blob "$(head -n 1 out):file" >merged &&
+	grep "^<<<<<<< ours" merged &&
+	grep "^>>>>>>> conflict" merged
+'
+
+test_expect_success 'modify/delete and rename/delete conflicts' '
+	git checkout -q -b delete base &&
+	git rm -q file renamed &&
+	git commit -q -m delete &&
+	git checkout -q master &&
+	test_expect_code 1 test-tool merge-in-memory base ours delete >out &&
+	cat >expect <<-\EOF &&
+	rename/delete dir/moved
+	modify/delete file
+	EOF
+	tail -n +2 out >actual &&
+	test_cmp expect actual &&
+	git ls-tree --name-only -r "$(head -n 1 out)" >actual &&
+	test_write_lines base.t dir/moved dir/sub file new-ours other \
+		ours.t >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rename/rename conflict' '
+	git checkout -q -b rename-other base &&
+	git mv renamed elsewhere &&
+	git commit -q -m rename-other &&
+	git checkout -q master &&
+	test_expect_code 1 \
+		test-tool merge-in-memory base ours rename-other >out &&
+	cat >expect <<-\EOF &&
+	rename/rename dir/moved
+	rename/rename elsewhere
+	EOF
+	tail -n +2 out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'file in the way of a directory is moved aside' '
+	git checkout -q -b df base &&
+	git rm -q other &&
+	mkdir other &&
+	echo df >other/file &&
+	git add other &&
+	git commit -q -m df &&
+	git checkout -q -b df-ours base &&
+	echo changed >other &&
+	git commit -q -a -m df-ours &&
+	git checkout -q master &&
+	test_expect_code 1 test-tool merge-in-memory base df-ours df >out &&
+	echo "modify/delete other~df-ours" >expect &&
+	tail -n +2 out >actual &&
+	test_cmp expect actual &&
+	git ls-tree -r --name-only "$(head -n 1 out)" >actual &&
+	test_write_lines base.t dir/sub file other/file other~df-ours \
+		renamed >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'setup renames across untouched directories' '
+	git checkout -q -b deep-base base &&
+	mkdir -p deep/one deep/two &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 >deep/one/file &&
+	echo two >deep/two/file &&
+	git add deep &&
+	git commit -q -m deep-base &&
+
+	git checkout -q -b deep-ours &&
+	git mv deep/one/file deep/two/moved &&
+	git commit -q -m deep-ours &&
+
+	git checkout -q -b deep-theirs deep-base &&
+	test_write_lines 1 2 3 4 5 6 7 8 theirs >deep/one/file &&
+	git commit -q -a -m deep-theirs &&
+
+	git checkout -q -b deep-other deep-base &&
+	git mv deep/one/file deep/other &&
+	git commit -q -m deep-other &&
+	git checkout -q master
+'
+
+test_expect_success 'rename into a directory the other side did not touch' '
+	check_against_recursive deep-base deep-ours deep-theirs &&
+	git cat-file blob "$(cat actual):deep/two/moved" >moved &&
+	test_write_lines 1 2 3 4 5 6 7 8 theirs >expect &&
+	test_cmp expect moved
+'
+
+test_expect_success 'renames out of a directory that is the same on both sides' '
+	test_expect_code 1 \
+		test-tool merge-in-memory deep-base deep-ours deep-other >out &&
+	cat >expect <<-\EOF &&
+	rename/rename deep/other
+	rename/rename deep/two/moved
+	EOF
+	tail -n +2 out >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -931,6 +931,54 @@ do
 	"
 done
 
+test_expect_success 'threaded grep in the index and in trees' '
+	git grep --threads=1 --cached -n e >expect.cached &&
+	git grep --threads=4 --cached -n e >actual.cached &&
+	test_cmp expect.cached actual.cached &&
+	git grep --threads=1 -n e HEAD HEAD~1 >expect.tree &&
+	git grep --threads=4 -n e HEAD HEAD~1 >actual.tree &&
+	test_cmp expect.tree actual.tree
+'
+
+for threads in 1 4
+do
+	test_expect_success "blobs found in several trees (--threads=$threads)" '
+		tree=$(git rev-parse HEAD^{tree}) &&
+		git grep -n e HEAD >expect &&
+		git grep -n e $tree >>expect &&
+		git grep --threads='$threads' -n e HEAD $tree >actual &&
+		test_cmp expect actual &&
+
+		git grep -c -e e --or -e o HEAD >expect &&
+		git grep -c -e e --or -e o $tree >>expect &&
+		git grep --threads='$threads' -c -e e --or -e o \
+			HEAD $tree >actual &&
+		test_cmp expect actual &&
+
+		git grep --heading --break -C1 -n Hello HEAD >expect &&
+		echo >>expect &&
+		git grep --heading --break -C1 -n Hello $tree >>expect &&
+		git grep --threads='$threads' --heading --break -C1 -n \
+			Hello HEAD $tree >actual &&
+		test_cmp expect actual
+	'
+done
+
+test_expect_success 'the same blob is searched for each of its drivers' '
+	test_when_finished "rm -f .gitattributes" &&
+	echo "*.bin -diff" >.gitattributes &&
+	blob=$(git rev-parse HEAD:hello.c) &&
+	tree=$(printf "100644 blob %s\thello.bin\n100644 blob %s\thello.c\n" \
+		$blob $blob | git mktree) &&
+	commit=$(git commit-tree -m binary $tree) &&
+	cat >expect <<-EOF &&
+	Binary file $commit:hello.bin matches
+	$commit:hello.c:	printf("Hello world.\\n");
+	EOF
+	git grep Hello $commit >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success !PTHREADS,C_LOCALE_OUTPUT 'grep --threads=N or pack.threads=N warns when no pthreads' '
 	git grep --threads=2 Hello hello_world 2>err &&
 	grep ^warning: err >warnings &&
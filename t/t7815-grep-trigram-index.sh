@@ -0,0 +1,132 @@
+#!/bin/sh
+
+test_description='git grep with grep.trigramIndex'
+
+. ./test-lib.sh
+
+# The file of the loose object "$1".
+loose_path () {
+	echo "$1" | sed -e "s|^..|.git/objects/&/|"
+}
+
+test_expect_success 'setup' '
+	test_write_lines "int main(void)" "{" "	return 0;" "}" >main.c &&
+	test_write_lines "static int helper(int x)" "{" "	return x + 1;" \
+		"}" >helper.c &&
+	test_write_lines "Hello World" "hello again" >README &&
+	git add . &&
+	test_commit initial &&
+	git config grep.trigramIndex true
+'
+
+test_expect_success 'grep with the index finds the same matches' '
+	git -c grep.trigramIndex=false grep -n return HEAD >expect &&
+	git grep -n return HEAD >actual &&
+	test_cmp expect actual &&
+	test_path_is_file .git/objects/info/grep-index &&
+	git grep -n return HEAD >actual &&
+	test_cmp expect actual &&
+	git -c grep.trigramIndex=false grep -i -e hello -e main >expect &&
+	git grep -i -e hello -e main >actual &&
+	test_cmp expect actual &&
+	git grep -i -e hello -e main >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'blobs that cannot match are not read' '
+	git grep -c . HEAD &&
+	blob=$(git rev-parse HEAD:helper.c) &&
+	file=$(loose_path $blob) &&
+	mv "$file" helper.blob &&
+	git -c grep.trigramIndex=false grep main HEAD 2>err &&
+	test_i18ngrep "unable to read $blob" err &&
+	echo "HEAD:main.c:int main(void)" >expect &&
+	git grep main HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_must_be_empty err &&
+	git grep -E "ma+in" HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_must_be_empty err &&
+	test_must_fail git grep helper HEAD 2>err &&
+	test_i18ngrep "unable to read $blob" err &&
+	mv helper.blob "$file"
+'
+
+test_expect_success 'patterns that cannot be narrowed down search everything' '
+	blob=$(git rev-parse HEAD:helper.c) &&
+	file=$(loose_path $blob) &&
+	mv "$file" helper.blob &&
+	for args in "-E main|nothing" "-v main" "-L main" \
+		"-e main --and -e void"
+	do
+		test_might_fail git grep $args HEAD 2>err &&
+		test_i18ngrep "unable to read $blob" err || return 1
+	done &&
+	mv helper.blob "$file"
+'
+
+test_expect_success PCRE 'Perl escapes do not narrow the search down' '
+	printf "fooAbar\nfoo\001bar\nabc+def\n" >escapes &&
+	git add escapes &&
+	test_tick &&
+	git commit -q -m escapes &&
+	git grep -c . HEAD &&
+	for pattern in "foo\\x41bar" "foo\\101bar" "foo\\cAbar" \
+		"foo\\o{101}bar" "foo\\N{U+41}bar" "f(o)\\g1Abar" \
+		"f(o)\\g{1}Abar" "f(?<x>o)\\k<x>Abar" "\\Qabc+def\\E" \
+		"foo\\pLbar"
+	do
+		test_might_fail git -c grep.trigramIndex=false \
+			grep -P "$pattern" HEAD >expect 2>&1 &&
+		test_might_fail git grep -P "$pattern" HEAD >actual 2>&1 &&
+		test_cmp expect actual || return 1
+	done &&
+	echo "HEAD:escapes:fooAbar" >expect &&
+	git grep -P "foo\\x41bar" HEAD >actual &&
+	test_cmp expect actual &&
+	echo "HEAD:escapes:abc+def" >expect &&
+	git grep -P "\\Qabc+def\\E" HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'modified files in the working tree are searched' '
+	git grep -c . &&
+	echo "int main_helper;" >>helper.c &&
+	git grep -l main >actual &&
+	test_write_lines helper.c main.c >expect &&
+	test_cmp expect actual &&
+	git checkout helper.c
+'
+
+test_expect_success 'an unreadable index is ignored' '
+	cp .git/objects/info/grep-index saved &&
+	echo garbage >.git/objects/info/grep-index &&
+	git grep -n return >actual 2>err &&
+	git -c grep.trigramIndex=false grep -n return >expect &&
+	test_cmp expect actual &&
+	test_i18ngrep "grep index" err &&
+	mv saved .git/objects/info/grep-index
+'
+
+test_expect_success 'a corrupt index is ignored and written afresh' '
+	index=.git/objects/info/grep-index &&
+	git -c grep.trigramIndex=false grep -n return HEAD >expect &&
+	cp $index saved &&
+	printf "\377\377\377\377" |
+	dd of=$index bs=1 seek=12 conv=notrunc &&
+	git grep -n return HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_i18ngrep "grep index .* is corrupt" err &&
+	git grep -n return HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_must_be_empty err &&
+	cp saved $index &&
+	size=$(wc -c <$index) &&
+	printf XXXX | dd of=$index bs=1 seek=$(($size - 4)) conv=notrunc &&
+	git grep -n return HEAD >actual 2>err &&
+	test_cmp expect actual &&
+	test_i18ngrep "grep index .* is corrupt" err &&
+	mv saved $index
+'
+
+test_done
@@ -4,6 +4,7 @@
 struct ref;
 struct transport;
 struct argv_array;
+struct string_list;
 
 struct transport_vtable {
 	/**
@@ -71,6 +72,13 @@ struct transport_vtable {
 	 * use. disconnect() releases these resources.
 	 **/
 	int (*disconnect)(struct transport *connection);
+
+	/**
+	 * Appends the URIs of the bundles the remote side offers to
+	 * bootstrap clones to "uris".  Optional.
+	 **/
+	void (*get_bundle_uris)(struct transport *transport,
+				struct string_list *uris);
 };
 
 #endif
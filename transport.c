@@ -307,6 +307,25 @@ static struct ref *get_refs_via_connect(struct transport *transport, int for_pus
 	return handshake(transport, for_push, ref_prefixes, 1);
 }
 
+static void get_bundle_uris_via_connect(struct transport *transport,
+					struct string_list *uris)
+{
+	struct git_transport_data *data = transport->data;
+	struct packet_reader reader;
+
+	if (!data->got_remote_heads)
+		free_refs(handshake(transport, 0, NULL, 0));
+
+	if (data->version != protocol_v2 ||
+	    !server_supports_v2("bundle-uri", 0))
+		return;
+
+	packet_reader_init(&reader, data->fd[0], NULL, 0,
+			   PACKET_READ_CHOMP_NEWLINE);
+	get_remote_bundle_uris(data->fd[1], &reader, uris,
+			       transport->server_options);
+}
+
 static int fetch_refs_via_pack(struct transport *transport,
 			       int nr_heads, struct ref **to_fetch)
 {
@@ -686,12 +705,10 @@ static int git_transport_push(struct transport *transport, struct ref *remote_re
 
 	switch (data->version) {
 	case protocol_v2:
-		die(_("support for protocol v2 not implemented yet"));
-		break;
 	case protocol_v1:
 	case protocol_v0:
 		ret = send_pack(&args, data->fd, data->conn, remote_refs,
-				&data->extra_have);
+				&data->extra_have, data->version);
 		break;
 	case protocol_unknown_version:
 		BUG("unknown protocol version");
@@ -739,7 +756,8 @@ static struct transport_vtable taken_over_vtable = {
 	fetch_refs_via_pack,
 	git_transport_push,
 	NULL,
-	disconnect_git
+	disconnect_git,
+	get_bundle_uris_via_connect
 };
 
 void transport_take_over(struct transport *transport,
@@ -899,7 +917,8 @@ static struct transport_vtable builtin_smart_vtable = {
 	fetch_refs_via_pack,
 	git_transport_push,
 	connect_git,
-	disconnect_git
+	disconnect_git,
+	get_bundle_uris_via_connect
 };
 
 struct transport *transport_get(struct remote *remote, const char *url)
@@ -1105,6 +1124,116 @@ static int run_pre_push_hook(struct transport *transport,
 	return ret;
 }
 
+/*
+ * The server matches every ref against every prefix we send; past this
+ * many, asking for all the refs is cheaper for both sides.
+ */
+#define MAX_PUSH_REF_PREFIXES 32
+
+struct tracked_ref_cb {
+	struct remote *remote;
+	struct string_list dirs;
+};
+
+/*
+ * Collect the directories of the remote refs our remote-tracking refs
+ * say the remote has, e.g. "refs/heads/" for "refs/remotes/origin/main".
+ */
+static int add_tracked_ref(const char *refname, const struct object_id *oid,
+			   int flags, void *cb_data)
+{
+	struct tracked_ref_cb *cb = cb_data;
+	struct refspec_item query;
+	const char *slash;
+
+	memset(&query, 0, sizeof(query));
+	query.dst = (char *)refname;
+	if (remote_find_tracking(cb->remote, &query))
+		return 0;
+	slash = strrchr(query.src, '/');
+	if (slash && slash - query.src > strlen("refs"))
+		query.src[slash + 1 - query.src] = '\0';
+	string_list_insert(&cb->dirs, query.src);
+	free(query.src);
+	return 0;
+}
+
+/*
+ * Compute the prefixes of the remote refs pushing "rs" needs to know about,
+ * or leave "ref_prefixes" empty if the push may need any of them.
+ */
+static void push_ref_prefixes(struct remote *remote,
+			      const struct refspec *rs, int flags,
+			      struct argv_array *ref_prefixes)
+{
+	struct tracked_ref_cb cb = { NULL, STRING_LIST_INIT_DUP };
+	const char *last = NULL;
+	int i, nr;
+
+	if (flags & (TRANSPORT_PUSH_ALL | TRANSPORT_PUSH_MIRROR))
+		return;
+	for (i = 0; i < rs->nr; i++)
+		if (rs->items[i].matching)
+			return;
+
+	refspec_ref_prefixes(rs, ref_prefixes);
+	if (!ref_prefixes->argc)
+		return;
+
+	/*
+	 * A source without destination that is a symref, like "HEAD",
+	 * updates the remote ref named after what it points at.
+	 */
+	for (i = 0; i < rs->nr; i++) {
+		const struct refspec_item *item = &rs->items[i];
+		const char *target;
+		int flag;
+
+		if (item->dst || item->pattern || !item->src)
+			continue;
+		target = resolve_ref_unsafe(item->src, RESOLVE_REF_READING,
+					    NULL, &flag);
+		if (target && (flag & REF_ISSYMREF) && starts_with(target, "refs/"))
+			argv_array_push(ref_prefixes, target);
+	}
+	if (flags & TRANSPORT_PUSH_FOLLOW_TAGS)
+		argv_array_push(ref_prefixes, "refs/tags/");
+
+	/*
+	 * The remote refs we have the objects of are what tells
+	 * pack-objects which objects not to send.  Ask for those our
+	 * remote-tracking refs say the remote has or, without any, for
+	 * the other refs next to the ones we push, so that pushing a
+	 * new branch does not send its whole history.
+	 */
+	nr = ref_prefixes->argc;
+	cb.remote = remote;
+	if (remote)
+		for_each_ref(add_tracked_ref, &cb);
+	/* the list is sorted, so a directory comes before those inside it */
+	for (i = 0; i < cb.dirs.nr; i++) {
+		const char *dir = cb.dirs.items[i].string;
+
+		if (last && starts_with(dir, last) &&
+		    last[strlen(last) - 1] == '/')
+			continue;
+		argv_array_push(ref_prefixes, dir);
+		last = dir;
+	}
+	for (i = 0; !cb.dirs.nr && i < nr; i++) {
+		const char *prefix = ref_prefixes->argv[i];
+		const char *slash = strrchr(prefix, '/');
+
+		if (slash && slash[1] && slash - prefix > strlen("refs"))
+			argv_array_pushf(ref_prefixes, "%.*s",
+					 (int)(slash + 1 - prefix), prefix);
+	}
+	string_list_clear(&cb.dirs, 0);
+
+	if (ref_prefixes->argc > MAX_PUSH_REF_PREFIXES)
+		argv_array_clear(ref_prefixes);
+}
+
 int transport_push(struct transport *transport,
 		   struct refspec *rs, int flags,
 		   unsigned int *reject_reasons)
@@ -1128,7 +1257,7 @@ int transport_push(struct transport *transport,
 		if (check_push_refs(local_refs, rs) < 0)
 			return -1;
 
-		refspec_ref_prefixes(rs, &ref_prefixes);
+		push_ref_prefixes(transport->remote, rs, flags, &ref_prefixes);
 
 		remote_refs = transport->vtable->get_refs_list(transport, 1,
 							       &ref_prefixes);
@@ -1253,6 +1382,13 @@ const struct ref *transport_get_remote_refs(struct transport *transport,
 	return transport->remote_refs;
 }
 
+void transport_get_bundle_uris(struct transport *transport,
+			       struct string_list *uris)
+{
+	if (transport->vtable->get_bundle_uris)
+		transport->vtable->get_bundle_uris(transport, uris);
+}
+
 int transport_fetch_refs(struct transport *transport, struct ref *refs)
 {
 	int rc;
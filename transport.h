@@ -239,6 +239,13 @@ int transport_push(struct transport *connection,
 const struct ref *transport_get_remote_refs(struct transport *transport,
 					    const struct argv_array *ref_prefixes);
 
+/*
+ * Append the URIs of the bundles the remote offers to bootstrap clones
+ * (see bundle-uri.h) to "uris".  Only protocol v2 remotes offer them.
+ */
+void transport_get_bundle_uris(struct transport *transport,
+			       struct string_list *uris);
+
 int transport_fetch_refs(struct transport *transport, struct ref *refs);
 void transport_unlock_pack(struct transport *transport);
 int transport_disconnect(struct transport *transport);
@@ -26,6 +26,10 @@
 #include "serve.h"
 #include "commit-graph.h"
 #include "commit-reach.h"
+#include "pack-bitmap.h"
+#include "sha1-array.h"
+#include "tempfile.h"
+#include "lockfile.h"
 
 /* Remember to update object flag allocation in object.h */
 #define THEY_HAVE	(1u << 11)
@@ -43,6 +47,9 @@
 
 static timestamp_t oldest_have;
 
+static struct trace_key trace_negotiation = TRACE_KEY_INIT(NEGOTIATION);
+static int negotiation_rounds;
+
 static int deepen_relative;
 static int multi_ack;
 static int no_done;
@@ -65,12 +72,20 @@ static int keepalive = 5;
 static int use_sideband;
 static int stateless_rpc;
 static const char *pack_objects_hook;
+static int pack_objects_in_process;
+int (*upload_pack_pack_objects)(int argc, const char **argv, const char *prefix);
 
 static int filter_capability_requested;
 static int allow_filter;
 static int allow_ref_in_want;
 static struct list_objects_filter_options filter_options;
 
+static int allow_packfile_uris;
+
+static int pack_cache_enabled;
+static unsigned long pack_cache_size = 1024 * 1024 * 1024;
+static struct string_list uri_protocols = STRING_LIST_INIT_DUP;
+
 static void reset_timeout(void)
 {
 	alarm(timeout);
@@ -101,9 +116,263 @@ static int write_one_shallow(const struct commit_graft *graft, void *cb_data)
 	return 0;
 }
 
+/*
+ * pack-objects run with --uri-protocol starts its output with the
+ * packs the client has to download, one "<pack-hash> <uri>" line each,
+ * followed by an empty line.  Send the complete lines in "buf" to the
+ * client as the "packfile-uris" section, and start the "packfile"
+ * section at the empty line.  Returns 1 once that is done, leaving the
+ * start of the pack data in "buf".
+ */
+static int relay_packfile_uris(struct strbuf *buf, int *section_started)
+{
+	char *eol;
+
+	while ((eol = memchr(buf->buf, '\n', buf->len))) {
+		size_t len = eol - buf->buf;
+
+		if (!len) {
+			strbuf_remove(buf, 0, 1);
+			if (*section_started)
+				packet_delim(1);
+			packet_write_fmt(1, "packfile\n");
+			return 1;
+		}
+		if (!*section_started) {
+			packet_write_fmt(1, "packfile-uris\n");
+			*section_started = 1;
+		}
+		packet_write_fmt(1, "%.*s\n", (int)len, buf->buf);
+		strbuf_remove(buf, 0, len + 1);
+	}
+	return 0;
+}
+
+/*
+ * The pack cache keeps the packs sent to clients in
+ * $GIT_DIR/upload-pack-cache, named by a hash of everything that
+ * determines their contents: the wants, the haves we have in common
+ * with the client, the pack-objects options and the state of the refs.
+ * A request with the same key is answered from the cache, with the
+ * side-band framing of this session.  Entries are evicted least
+ * recently used first once they take up more than
+ * uploadpack.packCacheSize.  Hits and misses are counted in the
+ * "stats" file of the cache.
+ */
+static int use_pack_cache(void)
+{
+	return pack_cache_enabled && !shallow_nr && !uri_protocols.nr &&
+		!pack_objects_hook;
+}
+
+static int hash_oid(const struct object_id *oid, void *data)
+{
+	git_hash_ctx *ctx = data;
+	the_hash_algo->update_fn(ctx, oid->hash, the_hash_algo->rawsz);
+	return 0;
+}
+
+static void hash_objects(git_hash_ctx *ctx, const struct object_array *objs)
+{
+	struct oid_array oids = OID_ARRAY_INIT;
+	int i;
+
+	for (i = 0; i < objs->nr; i++)
+		oid_array_append(&oids, &objs->objects[i].item->oid);
+	oid_array_for_each_unique(&oids, hash_oid, ctx);
+	the_hash_algo->update_fn(ctx, "", 1);
+	oid_array_clear(&oids);
+}
+
+static int hash_ref(const char *refname, const struct object_id *oid,
+		    int flag, void *data)
+{
+	git_hash_ctx *ctx = data;
+	the_hash_algo->update_fn(ctx, refname, strlen(refname) + 1);
+	return hash_oid(oid, ctx);
+}
+
+static void pack_cache_path(struct strbuf *path,
+			    const struct object_array *have_obj,
+			    const struct object_array *want_obj)
+{
+	git_hash_ctx ctx;
+	struct object_id key;
+	struct strbuf options = STRBUF_INIT;
+
+	the_hash_algo->init_fn(&ctx);
+	hash_objects(&ctx, want_obj);
+	hash_objects(&ctx, have_obj);
+	strbuf_addf(&options, "thin=%d ofs-delta=%d include-tag=%d filter=%s",
+		    use_thin_pack, use_ofs_delta, use_include_tag,
+		    filter_options.filter_spec ? filter_options.filter_spec : "");
+	the_hash_algo->update_fn(&ctx, options.buf, options.len + 1);
+	head_ref(hash_ref, &ctx);
+	for_each_ref(hash_ref, &ctx);
+	the_hash_algo->final_fn(key.hash, &ctx);
+
+	strbuf_git_path(path, "upload-pack-cache/%s.pack", oid_to_hex(&key));
+	strbuf_release(&options);
+}
+
+static void pack_cache_count(int hit)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf path = STRBUF_INIT, buf = STRBUF_INIT;
+	uintmax_t hits = 0, misses = 0;
+	const char *p;
+
+	strbuf_git_path(&path, "upload-pack-cache/stats");
+	if (safe_create_leading_directories(path.buf) ||
+	    hold_lock_file_for_update_timeout(&lock, path.buf, 0, 100) < 0)
+		goto out; /* the counters are best effort */
+
+	if (strbuf_read_file(&buf, path.buf, 0) >= 0) {
+		if ((p = strstr(buf.buf, "hits ")))
+			hits = strtoumax(p + 5, NULL, 10);
+		if ((p = strstr(buf.buf, "misses ")))
+			misses = strtoumax(p + 7, NULL, 10);
+	}
+	if (hit)
+		hits++;
+	else
+		misses++;
+	strbuf_reset(&buf);
+	strbuf_addf(&buf, "hits %"PRIuMAX"\nmisses %"PRIuMAX"\n", hits, misses);
+	if (write_in_full(get_lock_file_fd(&lock), buf.buf, buf.len) < 0 ||
+	    commit_lock_file(&lock))
+		rollback_lock_file(&lock);
+out:
+	strbuf_release(&path);
+	strbuf_release(&buf);
+}
+
+static int send_cached_pack(const char *path)
+{
+	char data[8192];
+	ssize_t sz;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return 0;
+	/* the modification time is what pack_cache_prune() goes by */
+	utime(path, NULL);
+
+	while ((sz = xread(fd, data, sizeof(data))) > 0)
+		send_client_data(1, data, sz);
+	if (sz < 0)
+		die_errno("git upload-pack: unable to read '%s'", path);
+	close(fd);
+	if (use_sideband)
+		packet_flush(1);
+	return 1;
+}
+
+struct pack_cache_file {
+	char *path;
+	off_t size;
+	time_t mtime;
+};
+
+static int pack_cache_file_cmp(const void *a_, const void *b_)
+{
+	const struct pack_cache_file *a = a_, *b = b_;
+
+	if (a->mtime != b->mtime)
+		return a->mtime < b->mtime ? -1 : 1;
+	return strcmp(a->path, b->path);
+}
+
+static void pack_cache_prune(void)
+{
+	struct pack_cache_file *files = NULL;
+	size_t nr = 0, alloc = 0, i;
+	uintmax_t total = 0;
+	struct strbuf path = STRBUF_INIT;
+	size_t dirlen;
+	struct dirent *de;
+	DIR *dir;
+
+	strbuf_git_path(&path, "upload-pack-cache/");
+	dirlen = path.len;
+	dir = opendir(path.buf);
+	if (!dir) {
+		strbuf_release(&path);
+		return;
+	}
+	while ((de = readdir(dir))) {
+		struct stat st;
+
+		if (!ends_with(de->d_name, ".pack"))
+			continue;
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, de->d_name);
+		if (stat(path.buf, &st))
+			continue;
+		ALLOC_GROW(files, nr + 1, alloc);
+		files[nr].path = xstrdup(path.buf);
+		files[nr].size = st.st_size;
+		files[nr].mtime = st.st_mtime;
+		total += st.st_size;
+		nr++;
+	}
+	closedir(dir);
+
+	QSORT(files, nr, pack_cache_file_cmp);
+	for (i = 0; i < nr; i++) {
+		if (total > pack_cache_size && !unlink(files[i].path))
+			total -= files[i].size;
+		free(files[i].path);
+	}
+	free(files);
+	strbuf_release(&path);
+}
+
+static struct tempfile *start_pack_cache_entry(void)
+{
+	struct strbuf template = STRBUF_INIT;
+	struct tempfile *tmp = NULL;
+
+	strbuf_git_path(&template, "upload-pack-cache/tmp_pack_XXXXXX");
+	if (!safe_create_leading_directories(template.buf))
+		tmp = mks_tempfile(template.buf);
+	strbuf_release(&template);
+	return tmp;
+}
+
+static void write_pack_cache_entry(struct tempfile **tmp, off_t *written,
+				   const char *data, ssize_t sz)
+{
+	if (!*tmp)
+		return;
+	*written += sz;
+	if (*written > pack_cache_size ||
+	    write_in_full(get_tempfile_fd(*tmp), data, sz) < 0)
+		delete_tempfile(tmp);
+}
+
+/*
+ * Run in the child forked by start_command_in_fork(): the objects we
+ * have parsed carry our negotiation flags, which pack-objects does not
+ * expect to find.
+ */
+static int pack_objects_in_fork(int argc, const char **argv, const char *prefix)
+{
+	clear_object_flags(ALL_FLAGS);
+	return upload_pack_pack_objects(argc, argv, prefix);
+}
+
+static int use_pack_objects_in_process(void)
+{
+	return pack_objects_in_process && upload_pack_pack_objects &&
+		!pack_objects_hook && !shallow_nr;
+}
+
 static void create_pack_file(const struct object_array *have_obj,
 			     const struct object_array *want_obj)
 {
+	struct strbuf uris = STRBUF_INIT, held_progress = STRBUF_INIT;
+	int relaying_uris = !!uri_protocols.nr, uris_sent = 0;
 	struct child_process pack_objects = CHILD_PROCESS_INIT;
 	char data[8193], progress[128];
 	char abort_msg[] = "aborting due to possible repository "
@@ -112,6 +381,20 @@ static void create_pack_file(const struct object_array *have_obj,
 	ssize_t sz;
 	int i;
 	FILE *pipe_fd;
+	struct strbuf cache_path = STRBUF_INIT;
+	struct tempfile *cache_tmp = NULL;
+	off_t cache_written = 0;
+
+	if (use_pack_cache()) {
+		pack_cache_path(&cache_path, have_obj, want_obj);
+		if (send_cached_pack(cache_path.buf)) {
+			pack_cache_count(1);
+			strbuf_release(&cache_path);
+			return;
+		}
+		pack_cache_count(0);
+		cache_tmp = start_pack_cache_entry();
+	}
 
 	if (!pack_objects_hook)
 		pack_objects.git_cmd = 1;
@@ -150,12 +433,24 @@ static void create_pack_file(const struct object_array *have_obj,
 					 filter_options.filter_spec);
 		}
 	}
+	for (i = 0; i < uri_protocols.nr; i++)
+		argv_array_pushf(&pack_objects.args, "--uri-protocol=%s",
+				 uri_protocols.items[i].string);
 
 	pack_objects.in = -1;
 	pack_objects.out = -1;
 	pack_objects.err = -1;
 
-	if (start_command(&pack_objects))
+	if (use_pack_objects_in_process()) {
+		/*
+		 * Load the bitmaps before forking, so that the pack-objects
+		 * of every request of this session finds them ready.
+		 */
+		if (!filter_options.filter_spec)
+			preload_bitmap_index();
+		if (start_command_in_fork(&pack_objects, pack_objects_in_fork))
+			die("git upload-pack: unable to fork git-pack-objects");
+	} else if (start_command(&pack_objects))
 		die("git upload-pack: unable to fork git-pack-objects");
 
 	pipe_fd = xfdopen(pack_objects.in, "w");
@@ -223,7 +518,14 @@ static void create_pack_file(const struct object_array *have_obj,
 			 */
 			sz = xread(pack_objects.err, progress,
 				  sizeof(progress));
-			if (0 < sz)
+			/*
+			 * Nothing but the packfile uris may come before
+			 * the section header, which is only written once
+			 * they have all been relayed.
+			 */
+			if (0 < sz && relaying_uris)
+				strbuf_add(&held_progress, progress, sz);
+			else if (0 < sz)
 				send_client_data(2, progress, sz);
 			else if (sz == 0) {
 				close(pack_objects.err);
@@ -261,6 +563,22 @@ static void create_pack_file(const struct object_array *have_obj,
 			else
 				goto fail;
 			sz += outsz;
+			if (relaying_uris) {
+				if (!sz)
+					goto fail;
+				strbuf_add(&uris, data, sz);
+				if (!relay_packfile_uris(&uris, &uris_sent))
+					continue;
+				relaying_uris = 0;
+				if (held_progress.len)
+					send_client_data(2, held_progress.buf,
+							 held_progress.len);
+				strbuf_release(&held_progress);
+				/* what is left came with the last read */
+				sz = uris.len;
+				memcpy(data, uris.buf, sz);
+				strbuf_release(&uris);
+			}
 			if (1 < sz) {
 				buffered = data[sz-1] & 0xFF;
 				sz--;
@@ -268,6 +586,8 @@ static void create_pack_file(const struct object_array *have_obj,
 			else
 				buffered = -1;
 			send_client_data(1, data, sz);
+			write_pack_cache_entry(&cache_tmp, &cache_written,
+					       data, sz);
 		}
 
 		/*
@@ -278,9 +598,10 @@ static void create_pack_file(const struct object_array *have_obj,
 		 *
 		 * If we don't have a sideband channel, there's no room in the
 		 * protocol to say anything, so those clients are just out of
-		 * luck.
+		 * luck.  Neither is there before the section header is
+		 * written, while packfile uris are relayed.
 		 */
-		if (!ret && use_sideband) {
+		if (!ret && use_sideband && !relaying_uris) {
 			static const char buf[] = "0005\1";
 			write_or_die(1, buf, 5);
 		}
@@ -295,10 +616,14 @@ static void create_pack_file(const struct object_array *have_obj,
 	if (0 <= buffered) {
 		data[0] = buffered;
 		send_client_data(1, data, 1);
+		write_pack_cache_entry(&cache_tmp, &cache_written, data, 1);
 		fprintf(stderr, "flushed.\n");
 	}
 	if (use_sideband)
 		packet_flush(1);
+	if (cache_tmp && !rename_tempfile(&cache_tmp, cache_path.buf))
+		pack_cache_prune();
+	strbuf_release(&cache_path);
 	return;
 
  fail:
@@ -341,17 +666,81 @@ static int got_oid(const char *hex, struct object_id *oid,
 	return 0;
 }
 
+/*
+ * What the bitmap of each want told ok_to_give_up() so far in this
+ * negotiation, so that its later calls only test the haves added since.
+ * Only the first MAX_KEPT_WANT_BITMAPS wants keep their inflated
+ * bitmap between calls.
+ */
+static struct bitmap_reach *want_reach;
+static int want_reach_nr;
+#define MAX_KEPT_WANT_BITMAPS 64
+
+static void clear_want_reach(void)
+{
+	int i;
+
+	for (i = 0; i < want_reach_nr; i++)
+		bitmap_reach_release(&want_reach[i]);
+	FREE_AND_NULL(want_reach);
+	want_reach_nr = 0;
+}
+
 static int ok_to_give_up(const struct object_array *have_obj,
 			 struct object_array *want_obj)
 {
 	uint32_t min_generation = GENERATION_NUMBER_ZERO;
+	struct object_array unproven = OBJECT_ARRAY_INIT;
+	struct bitmap_index *bitmap_git;
+	int i, ret;
 
 	if (!have_obj->nr)
 		return 0;
 
-	return can_all_from_reach_with_flag(want_obj, THEY_HAVE,
-					    COMMON_KNOWN, oldest_have,
-					    min_generation);
+	/*
+	 * The bitmap of a want tells in one go whether it reaches any of
+	 * the haves; only the wants it cannot vouch for have to be walked.
+	 */
+	if (!(bitmap_git = preload_bitmap_index()))
+		return can_all_from_reach_with_flag(want_obj, THEY_HAVE,
+						    COMMON_KNOWN, oldest_have,
+						    min_generation);
+
+	if (want_reach_nr != want_obj->nr) {
+		clear_want_reach();
+		want_reach_nr = want_obj->nr;
+		want_reach = xcalloc(want_reach_nr, sizeof(*want_reach));
+	}
+	for (i = 0; i < want_obj->nr; i++) {
+		struct object *o = deref_tag(the_repository,
+					     want_obj->objects[i].item, NULL, 0);
+		int reaches = -1;
+
+		if (o && o->type == OBJ_COMMIT)
+			reaches = bitmap_commit_reaches_any(bitmap_git,
+							    (struct commit *)o,
+							    have_obj,
+							    &want_reach[i]);
+		if (i >= MAX_KEPT_WANT_BITMAPS)
+			bitmap_reach_release(&want_reach[i]);
+		if (reaches == 1)
+			continue;
+		add_object_array(want_obj->objects[i].item, NULL, &unproven);
+	}
+	ret = !unproven.nr ||
+		can_all_from_reach_with_flag(&unproven, THEY_HAVE,
+					     COMMON_KNOWN, oldest_have,
+					     min_generation);
+	object_array_clear(&unproven);
+	return ret;
+}
+
+static void trace_negotiation_rounds(int haves, int sent_ready)
+{
+	trace_printf_key(&trace_negotiation,
+			 "upload-pack: %d negotiation round(s), %d have(s) in common%s",
+			 negotiation_rounds, haves,
+			 sent_ready ? ", sent ready" : "");
 }
 
 static int get_common_commits(struct object_array *have_obj,
@@ -360,7 +749,6 @@ static int get_common_commits(struct object_array *have_obj,
 	struct object_id oid;
 	char last_hex[GIT_MAX_HEXSZ + 1];
 	int got_common = 0;
-	int got_other = 0;
 	int sent_ready = 0;
 
 	save_commit_buffer = 0;
@@ -372,8 +760,13 @@ static int get_common_commits(struct object_array *have_obj,
 		reset_timeout();
 
 		if (!line) {
-			if (multi_ack == 2 && got_common
-			    && !got_other && ok_to_give_up(have_obj, want_obj)) {
+			negotiation_rounds++;
+			/*
+			 * Even when this round also had haves we do not know,
+			 * what we have in common may be enough already.
+			 */
+			if (multi_ack == 2 && got_common && !sent_ready
+			    && ok_to_give_up(have_obj, want_obj)) {
 				sent_ready = 1;
 				packet_write_fmt(1, "ACK %s ready\n", last_hex);
 			}
@@ -382,18 +775,19 @@ static int get_common_commits(struct object_array *have_obj,
 
 			if (no_done && sent_ready) {
 				packet_write_fmt(1, "ACK %s\n", last_hex);
+				trace_negotiation_rounds(have_obj->nr, sent_ready);
 				return 0;
 			}
-			if (stateless_rpc)
+			if (stateless_rpc) {
+				trace_negotiation_rounds(have_obj->nr, sent_ready);
 				exit(0);
+			}
 			got_common = 0;
-			got_other = 0;
 			continue;
 		}
 		if (skip_prefix(line, "have ", &arg)) {
 			switch (got_oid(arg, &oid, have_obj)) {
 			case -1: /* they have what we do not */
-				got_other = 1;
 				if (multi_ack && ok_to_give_up(have_obj, want_obj)) {
 					const char *hex = oid_to_hex(&oid);
 					if (multi_ack == 2) {
@@ -417,6 +811,8 @@ static int get_common_commits(struct object_array *have_obj,
 			continue;
 		}
 		if (!strcmp(line, "done")) {
+			negotiation_rounds++;
+			trace_negotiation_rounds(have_obj->nr, sent_ready);
 			if (have_obj->nr > 0) {
 				if (multi_ack)
 					packet_write_fmt(1, "ACK %s\n", last_hex);
@@ -551,41 +947,76 @@ static int get_reachable_list(struct object_array *src,
 	return 0;
 }
 
+/*
+ * Whether some of the commits in "src" (or that its tags point to) are
+ * neither our refs nor reachable from them.  Like the rev-list this
+ * used to run, this does not look at the other kinds of objects.
+ */
 static int has_unreachable(struct object_array *src)
 {
-	struct child_process cmd = CHILD_PROCESS_INIT;
-	char buf[1];
-	int i;
+	struct commit **tips = NULL, **wants = NULL;
+	int nr_tips = 0, alloc_tips = 0, nr_wants = 0, alloc_wants = 0;
+	struct bitmap_index *bitmap_git;
+	int i, ret = 1;
 
-	if (do_reachable_revlist(&cmd, src, NULL) < 0)
-		return 1;
+	for (i = 0; i < src->nr; i++) {
+		struct object *o = src->objects[i].item;
 
-	/*
-	 * The commits out of the rev-list are not ancestors of
-	 * our ref.
-	 */
-	i = read_in_full(cmd.out, buf, 1);
-	if (i)
-		goto error;
-	close(cmd.out);
-	cmd.out = -1;
+		if (is_our_ref(o))
+			continue;
+		o = deref_tag(the_repository, o, NULL, 0);
+		if (!o)
+			goto out;
+		if (o->type != OBJ_COMMIT)
+			continue;
+		if (parse_commit((struct commit *)o))
+			goto out;
+		ALLOC_GROW(wants, nr_wants + 1, alloc_wants);
+		wants[nr_wants++] = (struct commit *)o;
+	}
+	if (!nr_wants) {
+		ret = 0;
+		goto out;
+	}
 
-	/*
-	 * rev-list may have died by encountering a bad commit
-	 * in the history, in which case we do want to bail out
-	 * even when it showed no commit.
-	 */
-	if (finish_command(&cmd))
-		goto error;
+	for (i = get_max_object_index(); 0 < i; ) {
+		struct object *o = get_indexed_object(--i);
+		struct commit *commit;
 
-	/* All the non-tip ones are ancestors of what we advertised */
-	return 0;
+		if (!o || !is_our_ref(o))
+			continue;
+		commit = lookup_commit_reference_gently(the_repository,
+							&o->oid, 1);
+		if (!commit)
+			continue;
+		ALLOC_GROW(tips, nr_tips + 1, alloc_tips);
+		tips[nr_tips++] = commit;
+	}
 
-error:
-	sigchain_pop(SIGPIPE);
-	if (cmd.out >= 0)
-		close(cmd.out);
-	return 1;
+	/* The bitmaps of our refs may tell without walking at all */
+	if ((bitmap_git = preload_bitmap_index()))
+		nr_wants = bitmap_filter_reachable(bitmap_git, tips, nr_tips,
+						   wants, nr_wants);
+
+	if (nr_wants) {
+		struct commit_list *found;
+
+		found = get_reachable_subset(tips, nr_tips, wants, nr_wants,
+					     TMP_MARK);
+		free_commit_list(found);
+		for (i = 0; i < nr_wants; i++)
+			if (!(wants[i]->object.flags & TMP_MARK))
+				break;
+		ret = i < nr_wants;
+		for (i = 0; i < nr_wants; i++)
+			wants[i]->object.flags &= ~TMP_MARK;
+	} else
+		ret = 0;
+
+out:
+	free(tips);
+	free(wants);
+	return ret;
 }
 
 static void check_non_tip(struct object_array *want_obj)
@@ -1041,6 +1472,14 @@ static int upload_pack_config(const char *var, const char *value, void *unused)
 		allow_filter = git_config_bool(var, value);
 	} else if (!strcmp("uploadpack.allowrefinwant", var)) {
 		allow_ref_in_want = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.packfileuri", var)) {
+		allow_packfile_uris = 1;
+	} else if (!strcmp("uploadpack.packobjectsinprocess", var)) {
+		pack_objects_in_process = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.packcache", var)) {
+		pack_cache_enabled = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.packcachesize", var)) {
+		pack_cache_size = git_config_ulong(var, value);
 	}
 
 	if (current_config_scope() != CONFIG_SCOPE_REPO) {
@@ -1082,6 +1521,7 @@ void upload_pack(struct upload_pack_options *options)
 	if (want_obj.nr) {
 		struct object_array have_obj = OBJECT_ARRAY_INIT;
 		get_common_commits(&have_obj, &want_obj);
+		clear_want_reach();
 		create_pack_file(&have_obj, &want_obj);
 	}
 }
@@ -1105,6 +1545,7 @@ struct upload_pack_data {
 	unsigned no_progress : 1;
 	unsigned use_include_tag : 1;
 	unsigned done : 1;
+	unsigned wait_for_done : 1;
 };
 
 static void upload_pack_data_init(struct upload_pack_data *data)
@@ -1207,6 +1648,22 @@ static int parse_have(const char *line, struct oid_array *haves)
 	return 0;
 }
 
+static void parse_uri_protocols(const char *arg)
+{
+	int i;
+
+	string_list_split(&uri_protocols, arg, ',', -1);
+	for (i = 0; i < uri_protocols.nr; i++) {
+		const char *protocol = uri_protocols.items[i].string;
+
+		/* they end up on the command line of the pack-objects hook */
+		if (!*protocol ||
+		    protocol[strspn(protocol, "abcdefghijklmnopqrstuvwxyz"
+					      "0123456789+-.")])
+			die("invalid packfile-uris protocol: '%s'", protocol);
+	}
+}
+
 static void process_args(struct packet_reader *request,
 			 struct upload_pack_data *data,
 			 struct object_array *want_obj)
@@ -1246,6 +1703,10 @@ static void process_args(struct packet_reader *request,
 			data->done = 1;
 			continue;
 		}
+		if (!strcmp(arg, "wait-for-done")) {
+			data->wait_for_done = 1;
+			continue;
+		}
 
 		/* Shallow related arguments */
 		if (process_shallow(arg, &data->shallows))
@@ -1268,6 +1729,12 @@ static void process_args(struct packet_reader *request,
 			continue;
 		}
 
+		if (allow_packfile_uris &&
+		    skip_prefix(arg, "packfile-uris ", &p)) {
+			parse_uri_protocols(p);
+			continue;
+		}
+
 		/* ignore unknown lines maybe? */
 		die("unexpected line: '%s'", arg);
 	}
@@ -1345,12 +1812,15 @@ static int process_haves_and_send_acks(struct upload_pack_data *data,
 {
 	struct oid_array common = OID_ARRAY_INIT;
 	struct strbuf response = STRBUF_INIT;
-	int ret = 0;
+	int ret = 0, sent_ready = 0;
 
+	negotiation_rounds++;
 	process_haves(&data->haves, &common, have_obj);
 	if (data->done) {
 		ret = 1;
-	} else if (send_acks(&common, &response, have_obj, want_obj)) {
+	} else if ((sent_ready = send_acks(&common, &response, have_obj,
+					   want_obj)) &&
+		   !data->wait_for_done) {
 		packet_buf_delim(&response);
 		ret = 1;
 	} else {
@@ -1362,6 +1832,7 @@ static int process_haves_and_send_acks(struct upload_pack_data *data,
 	/* Send response */
 	write_or_die(1, response.buf, response.len);
 	strbuf_release(&response);
+	trace_negotiation_rounds(have_obj->nr, sent_ready);
 
 	oid_array_clear(&data->haves);
 	oid_array_clear(&common);
@@ -1463,7 +1934,12 @@ int upload_pack_v2(struct repository *r, struct argv_array *keys,
 			send_wanted_ref_info(&data);
 			send_shallow_info(&data, &want_obj);
 
-			packet_write_fmt(1, "packfile\n");
+			/*
+			 * With packfile URIs, the "packfile" section header is
+			 * written once we know which packs to list before it.
+			 */
+			if (!uri_protocols.nr)
+				packet_write_fmt(1, "packfile\n");
 			create_pack_file(&have_obj, &want_obj);
 			state = FETCH_DONE;
 			break;
@@ -1472,7 +1948,9 @@ int upload_pack_v2(struct repository *r, struct argv_array *keys,
 		}
 	}
 
+	clear_want_reach();
 	upload_pack_data_clear(&data);
+	string_list_clear(&uri_protocols, 0);
 	object_array_clear(&have_obj);
 	object_array_clear(&want_obj);
 	return 0;
@@ -1485,7 +1963,7 @@ int upload_pack_advertise(struct repository *r,
 		int allow_filter_value;
 		int allow_ref_in_want;
 
-		strbuf_addstr(value, "shallow");
+		strbuf_addstr(value, "shallow wait-for-done");
 
 		if (!repo_config_get_bool(the_repository,
 					 "uploadpack.allowfilter",
@@ -1498,6 +1976,10 @@ int upload_pack_advertise(struct repository *r,
 					 &allow_ref_in_want) &&
 		    allow_ref_in_want)
 			strbuf_addstr(value, " ref-in-want");
+
+		if (repo_config_get_value_multi(the_repository,
+						"uploadpack.packfileuri"))
+			strbuf_addstr(value, " packfile-uris");
 	}
 
 	return 1;
@@ -10,6 +10,16 @@ struct upload_pack_options {
 
 void upload_pack(struct upload_pack_options *options);
 
+/*
+ * The pack-objects builtin, set by programs that have it linked in.
+ * With uploadpack.packObjectsInProcess, packs are then generated by
+ * calling it in a forked copy of upload-pack instead of exec'ing a
+ * new "git pack-objects", which saves loading the packs, indexes and
+ * bitmaps anew for every request.
+ */
+extern int (*upload_pack_pack_objects)(int argc, const char **argv,
+				       const char *prefix);
+
 struct repository;
 struct argv_array;
 struct packet_reader;
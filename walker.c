@@ -71,6 +71,7 @@ static int process_tree(struct walker *walker, struct tree *tree)
 #define COMPLETE	(1U << 0)
 #define SEEN		(1U << 1)
 #define TO_SCAN		(1U << 2)
+#define PICKED		(1U << 3)
 
 static struct commit_list *complete = NULL;
 
@@ -113,6 +114,13 @@ static int process_tag(struct walker *walker, struct tag *tag)
 static struct object_list *process_queue = NULL;
 static struct object_list **process_queue_end = &process_queue;
 
+/*
+ * Queued objects that arrived before those ahead of them in the
+ * process_queue. They are processed first, so that the objects they
+ * refer to are requested while we wait for the others.
+ */
+static struct object_list *arrived = NULL;
+
 static int process_object(struct walker *walker, struct object *obj)
 {
 	if (obj->type == OBJ_COMMIT) {
@@ -151,7 +159,7 @@ static int process(struct walker *walker, struct object *obj)
 	else {
 		if (obj->flags & COMPLETE)
 			return 0;
-		walker->prefetch(walker, obj->oid.hash);
+		walker->prefetch(walker, obj->oid.hash, obj->type == OBJ_BLOB);
 	}
 
 	object_list_insert(obj, process_queue_end);
@@ -159,18 +167,53 @@ static int process(struct walker *walker, struct object *obj)
 	return 0;
 }
 
-static int loop(struct walker *walker)
+void walker_object_arrived(struct walker *walker, const struct object_id *oid)
+{
+	struct object *obj = lookup_object(the_repository, oid->hash);
+
+	if (!obj || !(obj->flags & SEEN) || (obj->flags & (TO_SCAN | PICKED)))
+		return;
+	obj->flags |= PICKED;
+	object_list_insert(obj, &arrived);
+}
+
+/*
+ * Return the next object to process, or NULL if there is none left.
+ */
+static struct object *next_object(void)
 {
 	struct object_list *elem;
+	struct object *obj;
+
+	if (arrived) {
+		elem = arrived;
+		arrived = elem->next;
+		obj = elem->item;
+		free(elem);
+		return obj;
+	}
 
 	while (process_queue) {
-		struct object *obj = process_queue->item;
 		elem = process_queue;
 		process_queue = elem->next;
+		obj = elem->item;
 		free(elem);
 		if (!process_queue)
 			process_queue_end = &process_queue;
+		/* we already took it from "arrived" */
+		if (obj->flags & PICKED)
+			continue;
+		obj->flags |= PICKED;
+		return obj;
+	}
+	return NULL;
+}
+
+static int loop(struct walker *walker)
+{
+	struct object *obj;
 
+	while ((obj = next_object())) {
 		/* If we are not scanning this object, we placed it in
 		 * the queue because we needed to fetch it first.
 		 */
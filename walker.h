@@ -6,7 +6,11 @@
 struct walker {
 	void *data;
 	int (*fetch_ref)(struct walker *, struct ref *ref);
-	void (*prefetch)(struct walker *, unsigned char *sha1);
+	/*
+	 * "leaf" is set for objects that do not refer to any other, which
+	 * can wait until those that do have been requested.
+	 */
+	void (*prefetch)(struct walker *, unsigned char *sha1, int leaf);
 	int (*fetch)(struct walker *, unsigned char *sha1);
 	void (*cleanup)(struct walker *);
 	int get_verbosely;
@@ -19,6 +23,12 @@ struct walker {
 __attribute__((format (printf, 2, 3)))
 void walker_say(struct walker *walker, const char *fmt, ...);
 
+/*
+ * Tell the walker that an object it asked to prefetch has arrived, so that
+ * it can be processed before those still waiting to be fetched.
+ */
+void walker_object_arrived(struct walker *walker, const struct object_id *oid);
+
 /* Load pull targets from stdin */
 int walker_targets_stdin(char ***target, const char ***write_ref);
 
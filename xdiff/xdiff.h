@@ -82,6 +82,14 @@ typedef struct s_xpparam {
 	/* See Documentation/diff-options.txt. */
 	char **anchors;
 	size_t anchors_nr;
+
+	/*
+	 * Maximum size in bytes of the working memory of the Myers
+	 * algorithm, or 0 for no limit.  Changed regions of the files
+	 * that would need more are emitted as a whole.  Setting it also
+	 * lets large files be matched up on their unique lines first.
+	 */
+	unsigned long memory_limit;
 } xpparam_t;
 
 typedef struct s_xdemitcb {
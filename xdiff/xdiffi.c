@@ -27,6 +27,7 @@
 #define XDL_LINE_MAX (long)((1UL << (CHAR_BIT * sizeof(long) - 1)) - 1)
 #define XDL_SNAKE_CNT 20
 #define XDL_K_HEUR 4
+#define XDL_ANCHOR_MIN_RECORDS 65536
 
 typedef struct s_xdpsplit {
 	long i1, i2;
@@ -304,12 +305,214 @@ int xdl_recs_cmp(diffdata_t *dd1, long off1, long lim1,
 }
 
 
+/*
+ * Run xdl_recs_cmp() on the box (off1, off2, lim1, lim2), with K vectors
+ * that are only as large as the box.  "*kvd" and "*kvdsize" hold a
+ * buffer that is reused and grown from one box to the next.  If the K
+ * vectors would need more than "limit" bytes (unless it is 0), all the
+ * records in the box are marked as changed instead.
+ */
+static int xdl_diff_box(diffdata_t *dd1, long off1, long lim1,
+			diffdata_t *dd2, long off2, long lim2,
+			long **kvd, unsigned long *kvdsize,
+			unsigned long limit, xpparam_t const *xpp) {
+	long ndiags, *kvdf, *kvdb;
+	unsigned long size;
+	xdalgoenv_t xenv;
+	diffdata_t box1, box2;
+
+	ndiags = (lim1 - off1) + (lim2 - off2) + 3;
+	size = (2 * ndiags + 2) * sizeof(long);
+	if (limit && size > limit) {
+		for (; off1 < lim1; off1++)
+			dd1->rchg[dd1->rindex[off1]] = 1;
+		for (; off2 < lim2; off2++)
+			dd2->rchg[dd2->rindex[off2]] = 1;
+		return 0;
+	}
+	if (size > *kvdsize) {
+		xdl_free(*kvd);
+		if (!(*kvd = (long *) xdl_malloc(size))) {
+			*kvdsize = 0;
+			return -1;
+		}
+		*kvdsize = size;
+	}
+
+	/*
+	 * One K vector stores the forward path and one the backward path.
+	 */
+	kvdf = *kvd;
+	kvdb = kvdf + ndiags;
+	kvdf += lim2 - off2 + 1;
+	kvdb += lim2 - off2 + 1;
+
+	xenv.mxcost = xdl_bogosqrt(ndiags);
+	if (xenv.mxcost < XDL_MAX_COST_MIN)
+		xenv.mxcost = XDL_MAX_COST_MIN;
+	xenv.snake_cnt = XDL_SNAKE_CNT;
+	xenv.heur_min = XDL_HEUR_MIN_COST;
+
+	box1.nrec = lim1 - off1;
+	box1.ha = dd1->ha + off1;
+	box1.rchg = dd1->rchg;
+	box1.rindex = dd1->rindex + off1;
+	box2.nrec = lim2 - off2;
+	box2.ha = dd2->ha + off2;
+	box2.rchg = dd2->rchg;
+	box2.rindex = dd2->rindex + off2;
+
+	return xdl_recs_cmp(&box1, 0, box1.nrec, &box2, 0, box2.nrec,
+			    kvdf, kvdb, (xpp->flags & XDF_NEED_MINIMAL) != 0, &xenv);
+}
+
+
+/*
+ * Find the nearest "anchor" after (i1, i2): a pair of records that are
+ * the only occurrences of their line in each file, minimizing the
+ * number of records skipped on both sides to reach it; "a1" and "a2"
+ * are left alone if there is none.  "pos" gives, for each line class
+ * "c", its position in the first and second file at pos[2 * c] and
+ * pos[2 * c + 1], or a negative value if it does not occur exactly
+ * once there.
+ */
+static void xdl_find_anchor(diffdata_t *dd1, long i1, diffdata_t *dd2, long i2,
+			    long const *pos, long *a1, long *a2) {
+	long s, p, best = -1;
+	long const *cpos;
+
+	/*
+	 * Any anchor found at step "s" or later skips at least "s"
+	 * records, so stop looking once that cannot beat the best one.
+	 */
+	for (s = 0; best < 0 || s < best; s++) {
+		int more1 = i1 + s < dd1->nrec, more2 = i2 + s < dd2->nrec;
+
+		if (!more1 && !more2)
+			break;
+		if (more1) {
+			cpos = pos + 2 * dd1->ha[i1 + s];
+			if (cpos[0] >= 0 && (p = cpos[1]) >= i2 &&
+			    (best < 0 || s + p - i2 < best)) {
+				best = s + p - i2;
+				*a1 = i1 + s;
+				*a2 = p;
+			}
+		}
+		if (more2) {
+			cpos = pos + 2 * dd2->ha[i2 + s];
+			if (cpos[1] >= 0 && (p = cpos[0]) >= i1 &&
+			    (best < 0 || s + p - i1 < best)) {
+				best = s + p - i1;
+				*a1 = p;
+				*a2 = i2 + s;
+			}
+		}
+	}
+}
+
+
+/*
+ * Allocate and fill the positions of the line classes for
+ * xdl_find_anchor(), unless that would take more than "limit" bytes
+ * (unless it is 0).  Returns the size used, or 0 if it was not
+ * allocated.
+ */
+static unsigned long xdl_record_positions(diffdata_t *dd1, diffdata_t *dd2,
+					  unsigned long limit, long **pos) {
+	long i, nclass;
+	unsigned long size;
+
+	for (nclass = 0, i = 0; i < dd1->nrec; i++)
+		if ((long) dd1->ha[i] >= nclass)
+			nclass = dd1->ha[i] + 1;
+	for (i = 0; i < dd2->nrec; i++)
+		if ((long) dd2->ha[i] >= nclass)
+			nclass = dd2->ha[i] + 1;
+
+	size = 2 * nclass * sizeof(long);
+	if ((limit && size >= limit) || !(*pos = (long *) xdl_malloc(size)))
+		return 0;
+	for (i = 0; i < 2 * nclass; i++)
+		(*pos)[i] = -1;
+	for (i = 0; i < dd1->nrec; i++) {
+		long *cpos = *pos + 2 * dd1->ha[i];
+		cpos[0] = cpos[0] == -1 ? i : -2;
+	}
+	for (i = 0; i < dd2->nrec; i++) {
+		long *cpos = *pos + 2 * dd2->ha[i];
+		cpos[1] = cpos[1] == -1 ? i : -2;
+	}
+	return size;
+}
+
+
+/*
+ * Diff large files by streaming through both of them: runs of equal
+ * records are matched up directly, and after each difference the
+ * nearest anchor (see xdl_find_anchor()) is looked for.  Only the gap
+ * before the anchor is handed to the Myers algorithm, so the K vectors
+ * are sized after the largest gap rather than after the whole files.
+ * The positions needed to find anchors count towards the memory
+ * limit; if they do not fit, the rest of the files is one gap.
+ */
+static int xdl_anchored_diff(diffdata_t *dd1, diffdata_t *dd2,
+			     xpparam_t const *xpp) {
+	long i1, i2, a1, a2, *pos = NULL, *kvd = NULL;
+	unsigned long kvdsize = 0, limit = xpp->memory_limit, possize;
+	int ret = -1;
+
+	for (i1 = i2 = 0;;) {
+		while (i1 < dd1->nrec && i2 < dd2->nrec &&
+		       dd1->ha[i1] == dd2->ha[i2])
+			i1++, i2++;
+		if (i1 == dd1->nrec && i2 == dd2->nrec)
+			break;
+
+		/*
+		 * Files that only differ in lines that the other one
+		 * does not have at all never get here, so wait for the
+		 * first difference to pay for the positions.
+		 */
+		if (!pos) {
+			possize = xdl_record_positions(dd1, dd2, limit, &pos);
+			if (!possize) {
+				if (!limit)
+					goto out;
+				a1 = dd1->nrec;
+				a2 = dd2->nrec;
+				ret = xdl_diff_box(dd1, i1, a1, dd2, i2, a2,
+						   &kvd, &kvdsize, limit, xpp);
+				goto out;
+			}
+			if (limit)
+				limit -= possize;
+		}
+
+		a1 = dd1->nrec;
+		a2 = dd2->nrec;
+		xdl_find_anchor(dd1, i1, dd2, i2, pos, &a1, &a2);
+		if (xdl_diff_box(dd1, i1, a1, dd2, i2, a2,
+				 &kvd, &kvdsize, limit, xpp) < 0)
+			goto out;
+		i1 = a1;
+		i2 = a2;
+	}
+	ret = 0;
+
+out:
+	xdl_free(kvd);
+	xdl_free(pos);
+	return ret;
+}
+
+
 int xdl_do_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 		xdfenv_t *xe) {
-	long ndiags;
-	long *kvd, *kvdf, *kvdb;
-	xdalgoenv_t xenv;
+	long *kvd = NULL;
+	unsigned long kvdsize = 0;
 	diffdata_t dd1, dd2;
+	int ret;
 
 	if (XDF_DIFF_ALG(xpp->flags) == XDF_PATIENCE_DIFF)
 		return xdl_do_patience_diff(mf1, mf2, xpp, xe);
@@ -322,27 +525,6 @@ int xdl_do_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 		return -1;
 	}
 
-	/*
-	 * Allocate and setup K vectors to be used by the differential algorithm.
-	 * One is to store the forward path and one to store the backward path.
-	 */
-	ndiags = xe->xdf1.nreff + xe->xdf2.nreff + 3;
-	if (!(kvd = (long *) xdl_malloc((2 * ndiags + 2) * sizeof(long)))) {
-
-		xdl_free_env(xe);
-		return -1;
-	}
-	kvdf = kvd;
-	kvdb = kvdf + ndiags;
-	kvdf += xe->xdf2.nreff + 1;
-	kvdb += xe->xdf2.nreff + 1;
-
-	xenv.mxcost = xdl_bogosqrt(ndiags);
-	if (xenv.mxcost < XDL_MAX_COST_MIN)
-		xenv.mxcost = XDL_MAX_COST_MIN;
-	xenv.snake_cnt = XDL_SNAKE_CNT;
-	xenv.heur_min = XDL_HEUR_MIN_COST;
-
 	dd1.nrec = xe->xdf1.nreff;
 	dd1.ha = xe->xdf1.ha;
 	dd1.rchg = xe->xdf1.rchg;
@@ -352,16 +534,30 @@ int xdl_do_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	dd2.rchg = xe->xdf2.rchg;
 	dd2.rindex = xe->xdf2.rindex;
 
-	if (xdl_recs_cmp(&dd1, 0, dd1.nrec, &dd2, 0, dd2.nrec,
-			 kvdf, kvdb, (xpp->flags & XDF_NEED_MINIMAL) != 0, &xenv) < 0) {
-
+	/*
+	 * With a memory limit, huge files (usually generated ones that
+	 * differ in a handful of places) are matched up on their unique
+	 * lines first, unless a minimal diff was asked for.  This is also
+	 * the only way to stay within the limit if the K vectors for the
+	 * whole files would not fit.
+	 */
+	if (xpp->memory_limit &&
+	    ((!(xpp->flags & XDF_NEED_MINIMAL) &&
+	      dd1.nrec + dd2.nrec >= XDL_ANCHOR_MIN_RECORDS) ||
+	     (2 * (dd1.nrec + dd2.nrec + 3) + 2) * sizeof(long) > xpp->memory_limit))
+		ret = xdl_anchored_diff(&dd1, &dd2, xpp);
+	else {
+		ret = xdl_diff_box(&dd1, 0, dd1.nrec, &dd2, 0, dd2.nrec,
+				   &kvd, &kvdsize, xpp->memory_limit, xpp);
 		xdl_free(kvd);
+	}
+
+	if (ret < 0) {
+
 		xdl_free_env(xe);
 		return -1;
 	}
 
-	xdl_free(kvd);
-
 	return 0;
 }
 
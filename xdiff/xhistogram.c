@@ -237,7 +237,10 @@ static int fall_back_to_classic_diff(xpparam_t const *xpp, xdfenv_t *env,
 		int line1, int count1, int line2, int count2)
 {
 	xpparam_t xpparam;
+
+	memset(&xpparam, 0, sizeof(xpparam));
 	xpparam.flags = xpp->flags & ~XDF_DIFF_ALGORITHM_MASK;
+	xpparam.memory_limit = xpp->memory_limit;
 
 	return xdl_fall_back_diff(env, &xpparam,
 				  line1, count1, line2, count2);